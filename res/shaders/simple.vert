@@ -5,6 +5,7 @@ layout(location = 1) in vec3 normal_in;
 layout(location = 2) in vec2 textureCoordinates_in;
 layout(location = 7) in vec3 tangent_in;
 layout(location = 8) in vec3 bitangent_in;
+layout(location = 9) in mat4 instanceModel;       // per instance, locations 9 to 12 (see src/instancing.hpp)
 
 layout(location = 3) uniform mat4 modelMatrix;    // Model matrix
 layout(location = 4) uniform mat4 MVP;            // Model-View-Projection matrix
@@ -19,6 +20,16 @@ uniform bool isWater;
 uniform float time;    
 uniform vec3 boatWorldPosition;
 
+// Instanced draws take the model matrix from instanceModel instead of the matrix uniforms
+uniform bool instanced;
+uniform mat4 viewProjection;
+
+// Compact vertices (see src/utilities/compactVertex.hpp): positions are normalized relative to the mesh
+// bounds, and normals are octahedral encoded in normal_in.xy
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 // Output til fragmentshaderen
 out vec3 fragPosition;
 out vec3 fragNormal;
@@ -27,17 +38,28 @@ out mat3 TBN;
 out vec3 TexCoords;
 out vec4 fragPosLightSpace;
 
+vec3 octahedralDecode(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0) {
+        vec2 signNotZero = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signNotZero;
+    }
+    return normalize(n);
+}
+
 void main() {
-    vec3 newPosition = position;
+    vec3 localPosition = compactVertices ? positionOffset + positionScale * position : position;
+    vec3 normal = compactVertices ? octahedralDecode(normal_in.xy) : normal_in;
+    vec3 newPosition = localPosition;
 
 if (isWater) {
     float waveStrength = 0.7;
     float waveSpeed = 2.0;
     float waveFrequency = 0.2;
 
-    float wave1 = sin(time * waveSpeed + position.x * waveFrequency) * waveStrength;
-    float wave2 = cos(time * waveSpeed * 1.2 + position.z * waveFrequency * 1.5) * (waveStrength * 0.7);
-    float wave3 = sin(time * waveSpeed * 0.9 + (position.x + position.z) * waveFrequency * 1.1) * (waveStrength * 0.5);
+    float wave1 = sin(time * waveSpeed + localPosition.x * waveFrequency) * waveStrength;
+    float wave2 = cos(time * waveSpeed * 1.2 + localPosition.z * waveFrequency * 1.5) * (waveStrength * 0.7);
+    float wave3 = sin(time * waveSpeed * 0.9 + (localPosition.x + localPosition.z) * waveFrequency * 1.1) * (waveStrength * 0.5);
 
     float baseWave = wave1 + wave2 + wave3;
     newPosition.y += baseWave;
@@ -51,14 +73,24 @@ if (isWater) {
     } 
 
     if (isGeometry) {
-        gl_Position = MVP * vec4(newPosition, 1.0);
-        fragPosition = vec3(modelMatrix * vec4(newPosition, 1.0));
-        fragNormal = normalize(normalMatrix * normal_in);
+        mat4 model = modelMatrix;
+        mat3 normalTransform = normalMatrix;
+        if (instanced) {
+            model = instanceModel;
+            // The cofactor matrix is the inverse transpose times the determinant, so only its sign is needed
+            mat3 m = mat3(model);
+            normalTransform = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1])) * sign(determinant(m));
+            gl_Position = viewProjection * model * vec4(newPosition, 1.0);
+        } else {
+            gl_Position = MVP * vec4(newPosition, 1.0);
+        }
+        fragPosition = vec3(model * vec4(newPosition, 1.0));
+        fragNormal = normalize(normalTransform * normal);
         textureCoordinates_out = textureCoordinates_in;
 
-        vec3 T = normalize(vec3(modelMatrix * vec4(tangent_in, 0.0)));
-        vec3 B = normalize(vec3(modelMatrix * vec4(bitangent_in, 0.0)));
-        vec3 N = normalize(vec3(modelMatrix * vec4(normal_in, 0.0)));
+        vec3 T = normalize(vec3(model * vec4(tangent_in, 0.0)));
+        vec3 B = normalize(vec3(model * vec4(bitangent_in, 0.0)));
+        vec3 N = normalize(vec3(model * vec4(normal, 0.0)));
 
         TBN = mat3(T, B, N);
 
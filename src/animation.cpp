@@ -0,0 +1,223 @@
+#include "animation.hpp"
+#include <cmath>
+#include "utilities/fastTrig.hpp"
+
+AnimationComponents animations;
+
+namespace {
+
+// Inputs and outputs of the batch kernels, kept between frames
+std::vector<float> scratchX, scratchY, scratchZ, scratchRotationX, scratchRotationY, scratchRotationZ;
+
+// Swaps the last component into slot i, for nodes that no longer exist
+template <typename T>
+void removeComponent(std::vector<T>& values, size_t i) {
+    values[i] = values.back();
+    values.pop_back();
+}
+
+// Offset from the node's position, the same for the fish and the trees
+float positionPhase(const glm::vec3& position) {
+    return position.x * 0.1f + position.z * 0.1f;
+}
+
+void updateSway(SwayComponents& sway, float time) {
+    for (size_t i = 0; i < sway.nodes.size();) {
+        if (getSceneNode(sway.nodes[i])) {
+            i++;
+            continue;
+        }
+        removeComponent(sway.nodes, i);
+        removeComponent(sway.phases, i);
+    }
+    int count = (int)sway.nodes.size();
+    scratchRotationX.resize(count);
+    scratchRotationZ.resize(count);
+    swayBatch(sway, time, sway.phases.data(), count, scratchRotationX.data(), scratchRotationZ.data());
+
+    for (int i = 0; i < count; i++) {
+        SceneNode* node = getSceneNode(sway.nodes[i]);
+        glm::vec3 rotation = node->rotation();
+        rotation.x = scratchRotationX[i];    // Forward/backward sway
+        rotation.z = scratchRotationZ[i];    // Side-to-side sway
+        node->setRotation(rotation);
+    }
+}
+
+void updateSwim(SwimComponents& swim, float time) {
+    for (size_t i = 0; i < swim.nodes.size();) {
+        if (getSceneNode(swim.nodes[i])) {
+            i++;
+            continue;
+        }
+        removeComponent(swim.nodes, i);
+    }
+    int count = (int)swim.nodes.size();
+    scratchX.resize(count);
+    scratchZ.resize(count);
+    scratchRotationY.resize(count);
+    for (int i = 0; i < count; i++) {
+        const glm::vec3& position = getSceneNode(swim.nodes[i])->position();
+        scratchX[i] = position.x;
+        scratchZ[i] = position.z;
+    }
+    swimBatch(swim, time, scratchX.data(), scratchZ.data(), count, scratchRotationY.data());
+
+    for (int i = 0; i < count; i++) {
+        SceneNode* node = getSceneNode(swim.nodes[i]);
+        glm::vec3 position = node->position();
+        glm::vec3 rotation = node->rotation();
+        position.x = scratchX[i];
+        position.z = scratchZ[i];
+        rotation.y = scratchRotationY[i];
+        node->setPosition(position);
+        node->setRotation(rotation);
+    }
+}
+
+void updateBob(BobComponents& bob, float time) {
+    for (size_t i = 0; i < bob.nodes.size();) {
+        if (getSceneNode(bob.nodes[i])) {
+            i++;
+            continue;
+        }
+        removeComponent(bob.nodes, i);
+        removeComponent(bob.baseHeights, i);
+    }
+    int count = (int)bob.nodes.size();
+    scratchX.resize(count);
+    scratchY.resize(count);
+    scratchZ.resize(count);
+    for (int i = 0; i < count; i++) {
+        const glm::vec3& position = getSceneNode(bob.nodes[i])->position();
+        scratchX[i] = position.x;
+        scratchZ[i] = position.z;
+    }
+    bobBatch(bob, time, scratchX.data(), scratchZ.data(), bob.baseHeights.data(), count, scratchY.data());
+
+    // Every boat rocks the same way
+    float rockX, rockZ, unused;
+    fastSinCos(animationPhase(time, 1.5f), rockX, unused);
+    fastSinCos(animationPhase(time, 1.3f), unused, rockZ);
+    for (int i = 0; i < count; i++) {
+        SceneNode* node = getSceneNode(bob.nodes[i]);
+        glm::vec3 position = node->position();
+        glm::vec3 rotation = node->rotation();
+        position.y = scratchY[i];
+        rotation.x = rockX * bob.rock;
+        rotation.z = rockZ * bob.rock;
+        node->setPosition(position);
+        node->setRotation(rotation);
+    }
+}
+
+} // namespace
+
+float animationPhase(float time, float speed) {
+    const double twoPi = 6.283185307179586;
+    return (float)std::fmod((double)time * speed, twoPi);
+}
+
+void swayBatch(const SwayComponents& sway, float time, const float* phases, int count, float* rotationX, float* rotationZ) {
+    float base = animationPhase(time, sway.speed);
+    int i = 0;
+#ifdef FAST_TRIG_HAS_SSE2
+    const __m128 baseV = _mm_set1_ps(base);
+    const __m128 amount = _mm_set1_ps(sway.amount);
+    for (; i + 4 <= count; i += 4) {
+        __m128 sine, cosine;
+        fastSinCos(_mm_add_ps(baseV, _mm_loadu_ps(phases + i)), sine, cosine);
+        _mm_storeu_ps(rotationX + i, _mm_mul_ps(sine, amount));
+        _mm_storeu_ps(rotationZ + i, _mm_mul_ps(cosine, amount));
+    }
+#endif
+    for (; i < count; i++) {
+        float sine, cosine;
+        fastSinCos(base + phases[i], sine, cosine);
+        rotationX[i] = sine * sway.amount;
+        rotationZ[i] = cosine * sway.amount;
+    }
+}
+
+void swimBatch(const SwimComponents& swim, float time, float* x, float* z, int count, float* rotationY) {
+    float base = animationPhase(time, swim.speed);
+    int i = 0;
+#ifdef FAST_TRIG_HAS_SSE2
+    const __m128 baseV = _mm_set1_ps(base);
+    const __m128 tenth = _mm_set1_ps(0.1f);
+    const __m128 drift = _mm_set1_ps(swim.drift);
+    const __m128 turn = _mm_set1_ps(swim.turn);
+    for (; i + 4 <= count; i += 4) {
+        __m128 xs = _mm_loadu_ps(x + i);
+        __m128 zs = _mm_loadu_ps(z + i);
+        // Same phase as positionPhase()
+        __m128 phase = _mm_add_ps(_mm_mul_ps(xs, tenth), _mm_mul_ps(zs, tenth));
+        __m128 sine, cosine;
+        fastSinCos(_mm_add_ps(baseV, phase), sine, cosine);
+        _mm_storeu_ps(x + i, _mm_add_ps(xs, _mm_mul_ps(sine, drift)));
+        _mm_storeu_ps(z + i, _mm_add_ps(zs, _mm_mul_ps(cosine, drift)));
+        _mm_storeu_ps(rotationY + i, _mm_mul_ps(sine, turn));
+    }
+#endif
+    for (; i < count; i++) {
+        float sine, cosine;
+        fastSinCos(base + (x[i] * 0.1f + z[i] * 0.1f), sine, cosine);
+        x[i] += sine * swim.drift;
+        z[i] += cosine * swim.drift;
+        rotationY[i] = sine * swim.turn;
+    }
+}
+
+void bobBatch(const BobComponents& bob, float time, const float* x, const float* z, const float* baseHeights, int count, float* y) {
+    float base1 = animationPhase(time, bob.speed);
+    float base2 = animationPhase(time, bob.speed * 1.2f);
+    float base3 = animationPhase(time, bob.speed * 0.9f);
+    float frequency1 = bob.frequency;
+    float frequency2 = bob.frequency * 1.5f;
+    float frequency3 = bob.frequency * 1.1f;
+    float strength1 = bob.strength;
+    float strength2 = bob.strength * 0.7f;
+    float strength3 = bob.strength * 0.5f;
+    int i = 0;
+#ifdef FAST_TRIG_HAS_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 xs = _mm_loadu_ps(x + i);
+        __m128 zs = _mm_loadu_ps(z + i);
+        __m128 sine1, sine3, cosine2, unused;
+        fastSinCos(_mm_add_ps(_mm_set1_ps(base1), _mm_mul_ps(xs, _mm_set1_ps(frequency1))), sine1, unused);
+        fastSinCos(_mm_add_ps(_mm_set1_ps(base2), _mm_mul_ps(zs, _mm_set1_ps(frequency2))), unused, cosine2);
+        fastSinCos(_mm_add_ps(_mm_set1_ps(base3), _mm_mul_ps(_mm_add_ps(xs, zs), _mm_set1_ps(frequency3))), sine3, unused);
+        __m128 height = _mm_add_ps(_mm_loadu_ps(baseHeights + i), _mm_mul_ps(sine1, _mm_set1_ps(strength1)));
+        height = _mm_add_ps(height, _mm_mul_ps(cosine2, _mm_set1_ps(strength2)));
+        height = _mm_add_ps(height, _mm_mul_ps(sine3, _mm_set1_ps(strength3)));
+        _mm_storeu_ps(y + i, height);
+    }
+#endif
+    for (; i < count; i++) {
+        float sine1, sine3, cosine2, unused;
+        fastSinCos(base1 + x[i] * frequency1, sine1, unused);
+        fastSinCos(base2 + z[i] * frequency2, unused, cosine2);
+        fastSinCos(base3 + (x[i] + z[i]) * frequency3, sine3, unused);
+        y[i] = baseHeights[i] + sine1 * strength1 + cosine2 * strength2 + sine3 * strength3;
+    }
+}
+
+void addSway(SceneNode* node) {
+    animations.sway.nodes.push_back(node->handle);
+    animations.sway.phases.push_back(positionPhase(node->position()));
+}
+
+void addSwim(SceneNode* node) {
+    animations.swim.nodes.push_back(node->handle);
+}
+
+void addBob(SceneNode* node, float baseHeight) {
+    animations.bob.nodes.push_back(node->handle);
+    animations.bob.baseHeights.push_back(baseHeight);
+}
+
+void updateAnimations(float time) {
+    updateSway(animations.sway, time);
+    updateSwim(animations.swim, time);
+    updateBob(animations.bob, time);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include "sceneGraph.hpp"
+
+// Procedural animations, stored as one array per behaviour and field instead of being looked up per node.
+// updateAnimations() gathers the inputs of each behaviour, evaluates all instances with the batch kernels below
+// and writes the results through the scene store setters. Components of destroyed nodes are dropped on the next
+// update.
+
+// Trees lean back and forth and from side to side
+struct SwayComponents {
+    std::vector<SceneNodeHandle> nodes;
+    std::vector<float> phases;              // so neighbouring trees do not move in lockstep
+    float amount = 0.0872665f;              // maximum lean, 5 degrees in radians
+    float speed = 0.7f;
+};
+
+// Fish drift in small circles and turn with the current
+struct SwimComponents {
+    std::vector<SceneNodeHandle> nodes;
+    float speed = 1.5f;
+    float drift = 0.06f;                    // distance moved per update
+    float turn = 0.523599f;                 // maximum heading change, 30 degrees in radians
+};
+
+// Boats ride three overlapping waves and rock with them
+struct BobComponents {
+    std::vector<SceneNodeHandle> nodes;
+    std::vector<float> baseHeights;
+    float strength = 0.6f;
+    float speed = 2.0f;
+    float frequency = 0.2f;
+    float rock = 0.0349066f;                // maximum roll and pitch, 2 degrees in radians
+};
+
+struct AnimationComponents {
+    SwayComponents sway;
+    SwimComponents swim;
+    BobComponents bob;
+};
+
+extern AnimationComponents animations;
+
+void addSway(SceneNode* node);
+void addSwim(SceneNode* node);
+void addBob(SceneNode* node, float baseHeight);
+
+// time is in seconds since the start
+void updateAnimations(float time);
+
+// time * speed wrapped into [0, 2 pi), so phases stay small however long the program runs
+float animationPhase(float time, float speed);
+
+// The batch kernels, four instances at a time with SSE2 and fastSinCos() (see utilities/fastTrig.hpp).
+// The angles they take the sine of must stay within FAST_SINCOS_RANGE: they wrap time with animationPhase()
+// and add per instance offsets from the positions, which stay small within the terrain.
+
+// rotationX[i] = sin(time * speed + phases[i]) * amount, and rotationZ the same with cos
+void swayBatch(const SwayComponents& sway, float time, const float* phases, int count, float* rotationX, float* rotationZ);
+// Moves x and z one drift step along their circles and sets the heading in rotationY
+void swimBatch(const SwimComponents& swim, float time, float* x, float* z, int count, float* rotationY);
+// y[i] = baseHeights[i] + the three waves at (x[i], z[i])
+void bobBatch(const BobComponents& bob, float time, const float* x, const float* z, const float* baseHeights, int count, float* y);
@@ -0,0 +1,593 @@
+#include "benchmarks.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "stb_perlin.h"
+#include "animation.hpp"
+#include "occlusionCulling.hpp"
+#include "renderQueue.hpp"
+#include "terrain.hpp"
+#include "utilities/fastTrig.hpp"
+#include "utilities/meshCache.hpp"
+#include "utilities/objectLoader.hpp"
+#include "utilities/perlinNoise.hpp"
+#include "utilities/threadPool.hpp"
+
+// Calls run() until at least minSeconds have passed and returns the average time per call in seconds
+template <class Function>
+static double timePerCall(Function run, double minSeconds = 0.25) {
+    int calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        run();
+        calls++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    return elapsed / calls;
+}
+
+static void benchmarkNoise() {
+    const int sampleCount = 1 << 20;
+    std::vector<float> x(sampleCount), y(sampleCount), z(sampleCount);
+    std::vector<float> reference(sampleCount), result(sampleCount);
+
+    // Same kind of coordinates as the terrain: a 2D slice through the noise at z = 0
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(0.0f, 200.0f);
+    for (int i = 0; i < sampleCount; i++) {
+        x[i] = coordinate(random);
+        y[i] = coordinate(random);
+        z[i] = 0.0f;
+    }
+
+    double stbSeconds = timePerCall([&]() {
+        for (int i = 0; i < sampleCount; i++) {
+            reference[i] = stb_perlin_noise3(x[i], y[i], z[i], 0, 0, 0);
+        }
+    });
+    printf("%-8s %8.1f Msamples/s\n", "stb", sampleCount / stbSeconds * 1e-6);
+
+    for (NoiseISA isa : {NoiseISA::Scalar, NoiseISA::SSE2, NoiseISA::AVX2}) {
+        if (!noiseISASupported(isa)) {
+            printf("%-8s not supported on this CPU/compiler\n", noiseISAName(isa));
+            continue;
+        }
+        double seconds = timePerCall([&]() {
+            perlinNoise3Batch(isa, x.data(), y.data(), z.data(), result.data(), sampleCount);
+        });
+        float maxError = 0.0f;
+        for (int i = 0; i < sampleCount; i++) {
+            maxError = std::fmax(maxError, std::fabs(result[i] - reference[i]));
+        }
+        printf("%-8s %8.1f Msamples/s  (%.2fx stb, max error %g, tolerance %g)\n", noiseISAName(isa),
+               sampleCount / seconds * 1e-6, stbSeconds / seconds, maxError, PERLIN_BATCH_TOLERANCE);
+    }
+}
+
+// Writes an OBJ file of about targetBytes to path: a randomly displaced grid with UVs and normals, mostly quads
+// with every fifth cell as two triangles, in the number format exporters use
+static bool writeSyntheticOBJ(const std::string& path, size_t targetBytes) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    // About 155 bytes per grid vertex: one v, vt and vn line each and one face
+    int side = (int)std::sqrt(targetBytes / 155.0) + 1;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            fprintf(file, "v %.6f %.6f %.6f\n", x * 0.1f, unit(random), z * 0.1f);
+        }
+    }
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            fprintf(file, "vt %.6f %.6f\n", x / (float)(side - 1), z / (float)(side - 1));
+        }
+    }
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            float nx = unit(random) * 0.3f, nz = unit(random) * 0.3f;
+            float length = std::sqrt(nx * nx + 1.0f + nz * nz);
+            fprintf(file, "vn %.4f %.4f %.4f\n", nx / length, 1.0f / length, nz / length);
+        }
+    }
+    for (int z = 0; z + 1 < side; z++) {
+        for (int x = 0; x + 1 < side; x++) {
+            int a = z * side + x + 1, b = a + 1, c = a + side + 1, d = a + side;
+            if ((x + z) % 5 == 0) {
+                fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c);
+                fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, d, d, d);
+            } else {
+                fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d);
+            }
+        }
+    }
+    return fclose(file) == 0;
+}
+
+static void benchmarkOBJ() {
+    createDirectories(MESH_CACHE_DIRECTORY);
+    for (size_t megabytes : {10, 40}) {
+        std::string path = std::string(MESH_CACHE_DIRECTORY) + "benchmark-" + std::to_string(megabytes) + "mb.obj";
+        if (!writeSyntheticOBJ(path, megabytes << 20)) {
+            printf("Could not write %s\n", path.c_str());
+            return;
+        }
+        FILE* file = fopen(path.c_str(), "rb");
+        fseek(file, 0, SEEK_END);
+        double fileMB = ftell(file) / (1024.0 * 1024.0);
+        fclose(file);
+
+        std::vector<Vertex> referenceVertices, vertices;
+        std::vector<unsigned int> referenceIndices, indices;
+        double referenceSeconds = timePerCall([&]() {
+            referenceVertices.clear();
+            referenceIndices.clear();
+            loadOBJReference(path, referenceVertices, referenceIndices);
+        }, 0.0);
+        double seconds = timePerCall([&]() {
+            vertices.clear();
+            indices.clear();
+            loadOBJ(path, vertices, indices);
+        }, 0.0);
+
+        bool identical = vertices.size() == referenceVertices.size() && indices == referenceIndices &&
+                         memcmp(vertices.data(), referenceVertices.data(), vertices.size() * sizeof(Vertex)) == 0;
+        printf("%6.1f MB  reference %6.1f MB/s  mmap %7.1f MB/s  (%.1fx, %s)\n", fileMB, fileMB / referenceSeconds,
+               fileMB / seconds, referenceSeconds / seconds, identical ? "identical output" : "OUTPUT DIFFERS");
+        remove(path.c_str());
+    }
+}
+
+static void benchmarkOBJScaling() {
+    const size_t megabytes = 500;
+    createDirectories(MESH_CACHE_DIRECTORY);
+    std::string path = std::string(MESH_CACHE_DIRECTORY) + "benchmark-scaling.obj";
+    printf("Writing a %zu MB OBJ file...\n", megabytes);
+    if (!writeSyntheticOBJ(path, megabytes << 20)) {
+        printf("Could not write %s\n", path.c_str());
+        return;
+    }
+    FILE* file = fopen(path.c_str(), "rb");
+    fseek(file, 0, SEEK_END);
+    double fileMB = ftell(file) / (1024.0 * 1024.0);
+    fclose(file);
+
+    std::vector<unsigned int> threadCounts;
+    unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreads);
+
+    std::vector<Vertex> firstVertices;
+    std::vector<unsigned int> firstIndices;
+    double oneThreadSeconds = 0.0;
+    for (unsigned int threads : threadCounts) {
+        ThreadPool pool(threads);
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        double seconds = timePerCall([&]() {
+            vertices.clear();
+            indices.clear();
+            loadOBJ(path, vertices, indices, pool);
+        }, 0.0);
+
+        bool identical = true;
+        if (threads == 1) {
+            oneThreadSeconds = seconds;
+            firstVertices.swap(vertices);
+            firstIndices.swap(indices);
+        } else {
+            identical = vertices.size() == firstVertices.size() && indices == firstIndices &&
+                        memcmp(vertices.data(), firstVertices.data(), vertices.size() * sizeof(Vertex)) == 0;
+        }
+        printf("%3u threads %7.1f MB/s  %5.2fx  (%s)\n", threads, fileMB / seconds, oneThreadSeconds / seconds,
+               identical ? "same output as 1 thread" : "OUTPUT DIFFERS");
+    }
+    remove(path.c_str());
+}
+
+struct Benchmark {
+    const char* name;
+    const char* description;
+    void (*run)();
+};
+
+// Tree sway, fish swim and boat waves for 1k to 100k instances: the batch kernels against std::sin/std::cos one
+// instance at a time, like the animation code used to do
+static void benchmarkAnimation() {
+    SwayComponents sway;
+    SwimComponents swim;
+    BobComponents bob;
+    const float time = 1234.5f;
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+    for (int count : {1000, 10000, 100000}) {
+        std::vector<float> x(count), z(count), phases(count), baseHeights(count, -2.5f);
+        for (int i = 0; i < count; i++) {
+            x[i] = coordinate(random);
+            z[i] = coordinate(random);
+            phases[i] = x[i] * 0.1f + z[i] * 0.1f;
+        }
+        std::vector<float> rotationX(count), rotationY(count), rotationZ(count), y(count);
+        std::vector<float> referenceX(count), referenceZ(count);
+
+        double referenceSeconds = timePerCall([&]() {
+            float base = animationPhase(time, sway.speed);
+            for (int i = 0; i < count; i++) {
+                float angle = base + phases[i];
+                referenceX[i] = std::sin(angle) * sway.amount;
+                referenceZ[i] = std::cos(angle) * sway.amount;
+            }
+        });
+        double swaySeconds = timePerCall([&]() {
+            swayBatch(sway, time, phases.data(), count, rotationX.data(), rotationZ.data());
+        });
+        float maxError = 0.0f;
+        for (int i = 0; i < count; i++) {
+            maxError = std::fmax(maxError, std::fabs(rotationX[i] - referenceX[i]));
+            maxError = std::fmax(maxError, std::fabs(rotationZ[i] - referenceZ[i]));
+        }
+
+        // The fish keep drifting from call to call, like they do from frame to frame
+        std::vector<float> fishX(x), fishZ(z);
+        double swimSeconds = timePerCall([&]() {
+            swimBatch(swim, time, fishX.data(), fishZ.data(), count, rotationY.data());
+        });
+        double bobSeconds = timePerCall([&]() {
+            bobBatch(bob, time, x.data(), z.data(), baseHeights.data(), count, y.data());
+        });
+
+        printf("%6d instances: sway %8.0f/ms (std::sin %6.0f/ms, %.1fx), swim %8.0f/ms, bob %8.0f/ms, "
+               "max sway error %.2g (sin/cos tolerance %.2g)\n",
+               count, count / (swaySeconds * 1e3), count / (referenceSeconds * 1e3), referenceSeconds / swaySeconds,
+               count / (swimSeconds * 1e3), count / (bobSeconds * 1e3), maxError, FAST_SINCOS_TOLERANCE);
+    }
+}
+
+// World matrix updates of 100k trees with one child each, all of them moving, with 1 to N threads
+static void benchmarkTransforms() {
+    const int treeCount = 100000;
+    SceneNode* root = createSceneNode();
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+    for (int i = 0; i < treeCount; i++) {
+        SceneNode* tree = createSceneNode();
+        tree->setPosition(glm::vec3(coordinate(random), 0.0f, coordinate(random)));
+        addChild(root, tree);
+        SceneNode* branch = createSceneNode();
+        branch->setPosition(glm::vec3(0.0f, 5.0f, 0.0f));
+        addChild(tree, branch);
+    }
+    sceneStore.updateWorldMatrices();
+
+    std::vector<unsigned int> threadCounts;
+    unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreads);
+
+    std::vector<glm::mat4> firstMatrices;
+    double oneThreadSeconds = 0.0;
+    for (unsigned int threads : threadCounts) {
+        ThreadPool pool(threads);
+        float angle = 0.0f;
+        double seconds = timePerCall([&]() {
+            angle += 0.01f;
+            for (SceneNode* tree : root->children) {
+                tree->setRotation(glm::vec3(angle, 0.0f, 0.0f));
+            }
+            sceneStore.updateWorldMatrices(pool);
+        });
+
+        // Same input for every thread count before comparing
+        for (SceneNode* tree : root->children) {
+            tree->setRotation(glm::vec3(0.5f, 0.0f, 0.0f));
+        }
+        sceneStore.updateWorldMatrices(pool);
+        bool identical = true;
+        if (threads == 1) {
+            oneThreadSeconds = seconds;
+            firstMatrices = sceneStore.worldMatrices;
+        } else {
+            identical = memcmp(firstMatrices.data(), sceneStore.worldMatrices.data(), firstMatrices.size() * sizeof(glm::mat4)) == 0;
+        }
+        printf("%3u threads %7.2f ms per update of %zu nodes  %5.2fx  (%s)\n", threads, seconds * 1e3, sceneStore.size(),
+               oneThreadSeconds / seconds, identical ? "same matrices as 1 thread" : "MATRICES DIFFER");
+    }
+    destroySceneNode(root);
+    sceneStore.updateWorldMatrices();
+}
+
+// Frustum culling of 100k trees through the BVH, against testing the bounds of every node, for a camera turning
+// around in the middle of the forest
+static void benchmarkCulling() {
+    const int treeCount = 100000;
+    const int viewCount = 16;
+    SceneNode* root = createSceneNode();
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+    for (int i = 0; i < treeCount; i++) {
+        SceneNode* tree = createSceneNode();
+        tree->setPosition(glm::vec3(coordinate(random), 0.0f, coordinate(random)));
+        tree->setLocalBounds(glm::vec3(-2.0f, 0.0f, -2.0f), glm::vec3(2.0f, 12.0f, 2.0f));
+        addChild(root, tree);
+    }
+    double buildSeconds = timePerCall([&]() { sceneStore.updateWorldMatrices(); }, 0.0);
+    printf("BVH of %zu nodes built in %.1f ms, height %i\n", sceneStore.bvh.size(), buildSeconds * 1e3, sceneStore.bvh.height());
+
+    std::vector<Frustum> frustums;
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.5f, 1000.0f);
+    glm::vec3 eye(0.0f, 20.0f, 0.0f);
+    for (int view = 0; view < viewCount; view++) {
+        float angle = view * 6.2831853f / viewCount;
+        glm::mat4 viewMatrix = glm::lookAt(eye, eye + glm::vec3(std::cos(angle), -0.1f, std::sin(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+        frustums.push_back(frustumFromMatrix(projection * viewMatrix));
+    }
+
+    std::vector<int> visible;
+    size_t bvhVisible = 0;
+    double bvhSeconds = timePerCall([&]() {
+        bvhVisible = 0;
+        for (const Frustum& frustum : frustums) {
+            visible.clear();
+            sceneStore.bvh.queryFrustum(frustum, visible);
+            bvhVisible += visible.size();
+        }
+    });
+    size_t bruteVisible = 0;
+    double bruteSeconds = timePerCall([&]() {
+        bruteVisible = 0;
+        for (const Frustum& frustum : frustums) {
+            for (size_t slot = 0; slot < sceneStore.size(); slot++) {
+                if (!sceneStore.worldBounds[slot].empty() && frustumOverlaps(frustum, sceneStore.worldBounds[slot])) bruteVisible++;
+            }
+        }
+    });
+    printf("%.0f of %i nodes visible per view: BVH %.3f ms, testing every node %.3f ms  %5.1fx  (%s)\n",
+           (double)bvhVisible / viewCount, treeCount, bvhSeconds * 1e3 / viewCount, bruteSeconds * 1e3 / viewCount,
+           bruteSeconds / bvhSeconds, bvhVisible == bruteVisible ? "same nodes" : "NODE COUNTS DIFFER");
+
+    // Rays at trunk height and spheres around random points, checked against scanning every node
+    const int queryCount = 256;
+    std::vector<glm::vec3> origins, directions;
+    for (int i = 0; i < queryCount; i++) {
+        float angle = coordinate(random) * 6.2831853f / 1000.0f;
+        origins.push_back(glm::vec3(coordinate(random), 6.0f, coordinate(random)));
+        directions.push_back(glm::vec3(std::cos(angle), 0.0f, std::sin(angle)));
+    }
+    const float rayLength = 1000.0f;
+    std::vector<float> bvhDistances(queryCount), bruteDistances(queryCount);
+    double raySeconds = timePerCall([&]() {
+        for (int i = 0; i < queryCount; i++) {
+            float distance;
+            if (sceneStore.bvh.raycast(origins[i], directions[i], rayLength, distance) < 0) distance = -1.0f;
+            bvhDistances[i] = distance;
+        }
+    });
+    double bruteRaySeconds = timePerCall([&]() {
+        for (int i = 0; i < queryCount; i++) {
+            glm::vec3 inverseDirection(1.0f / directions[i].x, 1.0f / directions[i].y, 1.0f / directions[i].z);
+            float closest = rayLength;
+            bool hit = false;
+            for (size_t slot = 0; slot < sceneStore.size(); slot++) {
+                float distance;
+                if (sceneStore.worldBounds[slot].empty()) continue;
+                if (rayIntersectsAABB(origins[i], inverseDirection, sceneStore.worldBounds[slot], closest, distance)) {
+                    closest = distance;
+                    hit = true;
+                }
+            }
+            bruteDistances[i] = hit ? closest : -1.0f;
+        }
+    });
+    int rayHits = 0;
+    for (int i = 0; i < queryCount; i++) {
+        if (bvhDistances[i] >= 0.0f) rayHits++;
+    }
+    printf("%i of %i rays hit a node: BVH %.2f us per ray, testing every node %.2f us  %5.1fx  (%s)\n",
+           rayHits, queryCount, raySeconds * 1e6 / queryCount, bruteRaySeconds * 1e6 / queryCount,
+           bruteRaySeconds / raySeconds, bvhDistances == bruteDistances ? "same hits" : "HITS DIFFER");
+
+    const float radius = 25.0f;
+    size_t bvhInRadius = 0;
+    double radiusSeconds = timePerCall([&]() {
+        bvhInRadius = 0;
+        for (int i = 0; i < queryCount; i++) {
+            visible.clear();
+            sceneStore.bvh.queryRadius(origins[i], radius, visible);
+            bvhInRadius += visible.size();
+        }
+    });
+    size_t bruteInRadius = 0;
+    double bruteRadiusSeconds = timePerCall([&]() {
+        bruteInRadius = 0;
+        for (int i = 0; i < queryCount; i++) {
+            for (size_t slot = 0; slot < sceneStore.size(); slot++) {
+                if (!sceneStore.worldBounds[slot].empty() && sphereOverlapsAABB(origins[i], radius, sceneStore.worldBounds[slot])) {
+                    bruteInRadius++;
+                }
+            }
+        }
+    });
+    printf("%.1f nodes within %.0f units per query: BVH %.2f us per query, testing every node %.2f us  %5.1fx  (%s)\n",
+           (double)bvhInRadius / queryCount, radius, radiusSeconds * 1e6 / queryCount, bruteRadiusSeconds * 1e6 / queryCount,
+           bruteRadiusSeconds / radiusSeconds, bvhInRadius == bruteInRadius ? "same nodes" : "NODE COUNTS DIFFER");
+
+    // A tenth of the trees walking around, which refits or reinserts their leaves
+    float step = 0.0f;
+    double refitSeconds = timePerCall([&]() {
+        step += 0.2f;
+        for (size_t i = 0; i < root->children.size(); i += 10) {
+            SceneNode* tree = root->children[i];
+            tree->setPosition(tree->position() + glm::vec3(std::sin(step + i) * 0.2f, 0.0f, std::cos(step + i) * 0.2f));
+        }
+        sceneStore.updateWorldMatrices();
+    });
+    printf("Moving %i nodes: %.3f ms per update including the BVH refit, height %i\n",
+           treeCount / 10, refitSeconds * 1e3, sceneStore.bvh.height());
+
+    destroySceneNode(root);
+    sceneStore.updateWorldMatrices();
+}
+
+// Occlusion culling of 100k trees standing on the terrain, for a camera turning around down in the lake, where
+// the shore hides most of the forest. The trees in each view's frustum are tested against the coarse terrain
+// drawn into the occlusion buffer, with 1 to N threads drawing and testing.
+static void benchmarkOcclusion() {
+    const int treeCount = 100000;
+    const int viewCount = 16;
+    std::vector<OccluderMesh> occluders = buildTerrainOccluders({1000, 4, 0.02f});
+
+    DynamicBVH trees;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+    for (int i = 0; i < treeCount; i++) {
+        glm::vec3 position(coordinate(random), 0.0f, coordinate(random));
+        trees.createProxy(AABB(position + glm::vec3(-2.0f, -4.0f, -2.0f), position + glm::vec3(2.0f, 12.0f, 2.0f)), nullptr);
+    }
+
+    std::vector<glm::mat4> viewProjections;
+    std::vector<std::vector<int>> inFrustum(viewCount);
+    size_t frustumTotal = 0;
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.5f, 1000.0f);
+    glm::vec3 eye(200.0f, -15.0f, -100.0f);
+    for (int view = 0; view < viewCount; view++) {
+        float angle = view * 6.2831853f / viewCount;
+        glm::mat4 viewMatrix = glm::lookAt(eye, eye + glm::vec3(std::cos(angle), -0.05f, std::sin(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+        viewProjections.push_back(projection * viewMatrix);
+        trees.queryFrustum(frustumFromMatrix(viewProjections.back()), inFrustum[view]);
+        frustumTotal += inFrustum[view].size();
+    }
+
+    std::vector<unsigned int> threadCounts;
+    unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreads);
+
+    OcclusionBuffer buffer;
+    std::vector<float> firstDepths;
+    size_t firstHidden = 0;
+    double oneThreadSeconds = 0.0;
+    for (unsigned int threads : threadCounts) {
+        ThreadPool pool(threads);
+        size_t hidden = 0;
+        unsigned int triangles = 0;
+        double renderSeconds = 0.0;
+        double seconds = timePerCall([&]() {
+            hidden = 0;
+            triangles = 0;
+            renderSeconds = 0.0;
+            for (int view = 0; view < viewCount; view++) {
+                auto start = std::chrono::steady_clock::now();
+                buffer.render(occluders, viewProjections[view], pool);
+                renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                triangles += buffer.trianglesDrawn();
+                const std::vector<int>& candidates = inFrustum[view];
+                std::atomic<size_t> viewHidden(0);
+                pool.parallelFor(0, (int)candidates.size(), [&](int begin, int end) {
+                    size_t count = 0;
+                    for (int i = begin; i < end; i++) {
+                        if (!buffer.isVisible(trees.bounds(candidates[i]))) count++;
+                    }
+                    viewHidden += count;
+                });
+                hidden += viewHidden;
+            }
+        });
+
+        // The buffer of the first view, which every thread count must draw the same
+        buffer.render(occluders, viewProjections[0], pool);
+        bool identical = true;
+        if (threads == 1) {
+            oneThreadSeconds = seconds;
+            firstDepths.assign(buffer.depths(), buffer.depths() + OCCLUSION_WIDTH * OCCLUSION_HEIGHT);
+            firstHidden = hidden;
+            buffer.writeImage("occlusion-benchmark.pgm");
+        } else {
+            identical = hidden == firstHidden &&
+                        memcmp(firstDepths.data(), buffer.depths(), firstDepths.size() * sizeof(float)) == 0;
+        }
+        printf("%3u threads %7.3f ms per view (drawing %u triangles %.3f ms), %.0f of %.0f nodes in the frustum hidden  %5.2fx  (%s)\n",
+               threads, seconds * 1e3 / viewCount, triangles / viewCount, renderSeconds * 1e3 / viewCount,
+               (double)hidden / viewCount, (double)frustumTotal / viewCount, oneThreadSeconds / seconds,
+               identical ? "same as 1 thread" : "RESULTS DIFFER");
+    }
+}
+
+// Sorting the render queue of a 50k tree forest: the keys of a handful of meshes, levels of detail and textures
+// with random depths, through the radix sort and std::stable_sort
+static void benchmarkRenderQueue() {
+    const int packetCount = 50000;
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<int> pick(0, 7);
+    std::uniform_real_distribution<float> distance(0.0f, 1000.0f);
+    std::vector<SortItem> keys(packetCount);
+    for (int i = 0; i < packetCount; i++) {
+        RenderPacket packet = RenderPacket();
+        int kind = pick(random);
+        packet.layer = kind == 7 ? LAYER_TRANSPARENT : LAYER_OPAQUE;
+        packet.variant = kind == 7 ? VARIANT_WATER : VARIANT_INSTANCED;
+        packet.textureID = 2 + kind % 3;
+        packet.VAO = 5 + kind % 3;
+        packet.lodLevel = pick(random) % 5;
+        packet.depth = distance(random);
+        keys[i].key = renderSortKey(MAIN_PASS, packet, 1000.0f);
+        keys[i].index = i;
+    }
+
+    std::vector<SortItem> radixSorted;
+    std::vector<SortItem> scratch;
+    double radixSeconds = timePerCall([&]() {
+        radixSorted = keys;
+        radixSortByKey(radixSorted, scratch);
+    });
+    std::vector<SortItem> stdSorted;
+    double stdSeconds = timePerCall([&]() {
+        stdSorted = keys;
+        std::stable_sort(stdSorted.begin(), stdSorted.end(), [](const SortItem& a, const SortItem& b) { return a.key < b.key; });
+    });
+    bool identical = true;
+    for (int i = 0; i < packetCount; i++) {
+        identical = identical && radixSorted[i].index == stdSorted[i].index;
+    }
+    printf("%i packets: radix sort %.3f ms, std::stable_sort %.3f ms  %5.2fx  (%s)\n", packetCount, radixSeconds * 1e3,
+           stdSeconds * 1e3, stdSeconds / radixSeconds, identical ? "same order" : "ORDER DIFFERS");
+}
+
+static const Benchmark benchmarks[] = {
+    {"noise", "Perlin noise samples per second for each instruction set", benchmarkNoise},
+    {"obj", "OBJ parsing throughput on synthetic 10 and 40 MB files, against the istream parser", benchmarkOBJ},
+    {"obj-scaling", "Parallel OBJ parsing of a synthetic 500 MB file with 1 to N threads", benchmarkOBJScaling},
+    {"animation", "Batched tree sway, fish swim and boat wave animation for 1k, 10k and 100k instances", benchmarkAnimation},
+    {"transforms", "World matrix updates of 200k moving scene nodes with 1 to N threads", benchmarkTransforms},
+    {"culling", "Frustum, ray and radius queries over 100k scene nodes through the BVH and node by node", benchmarkCulling},
+    {"occlusion", "Occlusion culling of 100k trees behind the coarse terrain with 1 to N threads", benchmarkOcclusion},
+    {"render-queue", "Radix sorting the 64 bit keys of 50k render packets, against std::stable_sort", benchmarkRenderQueue},
+};
+
+int runBenchmark(const std::string& name) {
+    for (const Benchmark& benchmark : benchmarks) {
+        if (name == benchmark.name || name == "all") {
+            printf("== %s: %s\n", benchmark.name, benchmark.description);
+            benchmark.run();
+            if (name != "all") return 0;
+        }
+    }
+    if (name == "all") return 0;
+
+    fprintf(stderr, "Unknown benchmark '%s'. Available benchmarks:\n", name.c_str());
+    for (const Benchmark& benchmark : benchmarks) {
+        fprintf(stderr, "    %-16s %s\n", benchmark.name, benchmark.description);
+    }
+    fprintf(stderr, "    %-16s %s\n", "all", "Run every benchmark");
+    return 1;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+// CPU side micro benchmarks. They run without opening a window (see --benchmark in main.cpp).
+// Returns the process exit code.
+int runBenchmark(const std::string& name);
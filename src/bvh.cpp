@@ -0,0 +1,249 @@
+#include "bvh.hpp"
+#include <algorithm>
+#include <utility>
+
+int DynamicBVH::allocateNode() {
+    int index;
+    if (freeList >= 0) {
+        index = freeList;
+        freeList = links[index].parent;
+    } else {
+        index = (int)nodes.size();
+        nodes.emplace_back();
+        links.emplace_back();
+    }
+    nodes[index].child1 = -1;
+    nodes[index].child2 = -1;
+    links[index].sceneNode = nullptr;
+    links[index].parent = -1;
+    links[index].height = 0;
+    return index;
+}
+
+void DynamicBVH::freeNode(int index) {
+    links[index].parent = freeList;
+    links[index].height = -1;
+    freeList = index;
+}
+
+int DynamicBVH::createProxy(const AABB& bounds, SceneNode* node) {
+    int proxy = allocateNode();
+    nodes[proxy].bounds = bounds;
+    links[proxy].fatBounds = AABB(bounds.min - glm::vec3(BVH_FAT_MARGIN), bounds.max + glm::vec3(BVH_FAT_MARGIN));
+    links[proxy].sceneNode = node;
+    insertLeaf(proxy);
+    proxyCount++;
+    return proxy;
+}
+
+void DynamicBVH::destroyProxy(int proxy) {
+    removeLeaf(proxy);
+    freeNode(proxy);
+    proxyCount--;
+}
+
+bool DynamicBVH::moveProxy(int proxy, const AABB& bounds) {
+    nodes[proxy].bounds = bounds;
+    if (links[proxy].fatBounds.contains(bounds)) return false;
+    removeLeaf(proxy);
+    links[proxy].fatBounds = AABB(bounds.min - glm::vec3(BVH_FAT_MARGIN), bounds.max + glm::vec3(BVH_FAT_MARGIN));
+    insertLeaf(proxy);
+    return true;
+}
+
+void DynamicBVH::insertLeaf(int leaf) {
+    if (root < 0) {
+        root = leaf;
+        links[root].parent = -1;
+        return;
+    }
+
+    // Walk down to the sibling that makes the tree's surface area grow the least. Going down one more level
+    // costs the growth of every box on the way, so stop once pairing with the current node is cheaper.
+    AABB leafBounds = links[leaf].fatBounds;
+    int index = root;
+    while (!nodes[index].isLeaf()) {
+        const Node& node = nodes[index];
+        float area = node.bounds.halfArea();
+        float combinedArea = merge(node.bounds, leafBounds).halfArea();
+        float cost = 2.0f * combinedArea;
+        float inheritedCost = 2.0f * (combinedArea - area);
+
+        auto descendCost = [&](int child) {
+            const AABB& childBounds = fatBounds(child);
+            float grownArea = merge(childBounds, leafBounds).halfArea();
+            return nodes[child].isLeaf() ? grownArea + inheritedCost
+                                         : grownArea - childBounds.halfArea() + inheritedCost;
+        };
+        float cost1 = descendCost(node.child1);
+        float cost2 = descendCost(node.child2);
+        if (cost < cost1 && cost < cost2) break;
+        index = cost1 < cost2 ? node.child1 : node.child2;
+    }
+
+    // A new parent takes the sibling's place, with the sibling and the leaf below it
+    int sibling = index;
+    int oldParent = links[sibling].parent;
+    int newParent = allocateNode();
+    links[newParent].parent = oldParent;
+    links[newParent].height = links[sibling].height + 1;
+    nodes[newParent].bounds = merge(leafBounds, fatBounds(sibling));
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    links[sibling].parent = newParent;
+    links[leaf].parent = newParent;
+    if (oldParent < 0) {
+        root = newParent;
+    } else if (nodes[oldParent].child1 == sibling) {
+        nodes[oldParent].child1 = newParent;
+    } else {
+        nodes[oldParent].child2 = newParent;
+    }
+
+    refitAncestors(newParent);
+}
+
+void DynamicBVH::removeLeaf(int leaf) {
+    if (leaf == root) {
+        root = -1;
+        return;
+    }
+
+    // The sibling takes the place of the parent, which goes away
+    int parent = links[leaf].parent;
+    int grandParent = links[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+    freeNode(parent);
+    links[sibling].parent = grandParent;
+    if (grandParent < 0) {
+        root = sibling;
+        return;
+    }
+    if (nodes[grandParent].child1 == parent) {
+        nodes[grandParent].child1 = sibling;
+    } else {
+        nodes[grandParent].child2 = sibling;
+    }
+    refitAncestors(grandParent);
+}
+
+void DynamicBVH::refitAncestors(int index) {
+    while (index >= 0) {
+        index = balance(index);
+        Node& node = nodes[index];
+        links[index].height = 1 + std::max(links[node.child1].height, links[node.child2].height);
+        node.bounds = merge(fatBounds(node.child1), fatBounds(node.child2));
+        index = links[index].parent;
+    }
+}
+
+int DynamicBVH::balance(int indexA) {
+    Node& a = nodes[indexA];
+    if (a.isLeaf() || links[indexA].height < 2) return indexA;
+
+    int difference = links[a.child2].height - links[a.child1].height;
+    if (difference >= -1 && difference <= 1) return indexA;
+
+    // The taller child moves up into a's place. a keeps the shorter child and takes the shorter of the
+    // grandchildren in place of the one that moved up, the taller grandchild stays below the moved child.
+    bool rightTaller = difference > 1;
+    int indexUp = rightTaller ? a.child2 : a.child1;
+    int indexOther = rightTaller ? a.child1 : a.child2;
+    Node& up = nodes[indexUp];
+    int indexTall = up.child1;
+    int indexShort = up.child2;
+    if (links[indexTall].height < links[indexShort].height) std::swap(indexTall, indexShort);
+
+    int parent = links[indexA].parent;
+    links[indexUp].parent = parent;
+    if (parent < 0) {
+        root = indexUp;
+    } else if (nodes[parent].child1 == indexA) {
+        nodes[parent].child1 = indexUp;
+    } else {
+        nodes[parent].child2 = indexUp;
+    }
+    up.child1 = indexA;
+    up.child2 = indexTall;
+    links[indexA].parent = indexUp;
+    if (rightTaller) {
+        a.child2 = indexShort;
+    } else {
+        a.child1 = indexShort;
+    }
+    links[indexShort].parent = indexA;
+
+    a.bounds = merge(fatBounds(indexOther), fatBounds(indexShort));
+    links[indexA].height = 1 + std::max(links[indexOther].height, links[indexShort].height);
+    up.bounds = merge(a.bounds, fatBounds(indexTall));
+    links[indexUp].height = 1 + std::max(links[indexA].height, links[indexTall].height);
+    return indexUp;
+}
+
+void DynamicBVH::queryFrustum(const Frustum& frustum, std::vector<int>& result) const {
+    if (root < 0) return;
+    // Each entry carries the planes its parent was not completely inside
+    std::vector<std::pair<int, unsigned int>> stack;
+    stack.reserve(64);
+    stack.push_back(std::make_pair(root, ALL_FRUSTUM_PLANES));
+    while (!stack.empty()) {
+        int index = stack.back().first;
+        unsigned int planeMask = stack.back().second;
+        stack.pop_back();
+        const Node& node = nodes[index];
+        // Below a box inside the frustum the mask is empty, and everything passes without a test
+        if (planeMask && classifyAABB(frustum, node.bounds, planeMask) == FRUSTUM_OUTSIDE) continue;
+        if (node.isLeaf()) {
+            result.push_back(index);
+        } else {
+            stack.push_back(std::make_pair(node.child1, planeMask));
+            stack.push_back(std::make_pair(node.child2, planeMask));
+        }
+    }
+}
+
+void DynamicBVH::queryRadius(glm::vec3 center, float radius, std::vector<int>& result) const {
+    if (root < 0) return;
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(root);
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[index];
+        if (!sphereOverlapsAABB(center, radius, node.bounds)) continue;
+        if (node.isLeaf()) {
+            result.push_back(index);
+        } else {
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+}
+
+int DynamicBVH::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float& distance) const {
+    int closest = -1;
+    if (root < 0) return closest;
+    glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    float closestDistance = maxDistance;
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(root);
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[index];
+        // Boxes the ray enters behind the closest hit so far cannot hold a closer one
+        float entry;
+        if (!rayIntersectsAABB(origin, inverseDirection, node.bounds, closestDistance, entry)) continue;
+        if (node.isLeaf()) {
+            closest = index;
+            closestDistance = entry;
+        } else {
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+    distance = closestDistance;
+    return closest;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "utilities/bounds.hpp"
+
+struct SceneNode;
+
+// How far a leaf's stored box reaches past the node's real bounds. A node can move this far before the tree has
+// to change shape, so swaying trees and bobbing boats never reinsert and the fish only do now and then.
+const float BVH_FAT_MARGIN = 2.0f;
+
+// A dynamic bounding volume hierarchy over scene nodes, balanced like an AVL tree. Leaves are inserted next to
+// the sibling that grows the total surface area the least, and rotations keep the height logarithmic.
+//
+// A moved node whose bounds still fit in its enlarged leaf box costs nothing but storing the new bounds. Only
+// one that leaves it is taken out and reinserted, which refits the boxes on the way to the root.
+//
+// Queries test the enlarged boxes on the way down and the node's real bounds at the leaves. What they read is
+// kept apart from what only changing the tree needs, so a query touches 32 bytes per box, half a cache line.
+// For the same reason the queries return proxies, and only callers that need the scene nodes look them up.
+// A frustum query only tests the planes a box's parent was not completely inside of, so everything below a box
+// inside the frustum is taken without a test.
+class DynamicBVH {
+public:
+    // Returns the proxy of the new leaf, which stays the same until it is destroyed
+    int createProxy(const AABB& bounds, SceneNode* node);
+    void destroyProxy(int proxy);
+    // Returns true if the leaf had to be reinserted
+    bool moveProxy(int proxy, const AABB& bounds);
+
+    const AABB& bounds(int proxy) const { return nodes[proxy].bounds; }
+    SceneNode* sceneNode(int proxy) const { return links[proxy].sceneNode; }
+
+    // Appends the proxies whose bounds intersect the frustum
+    void queryFrustum(const Frustum& frustum, std::vector<int>& result) const;
+    // Appends the proxies whose bounds are within radius of center
+    void queryRadius(glm::vec3 center, float radius, std::vector<int>& result) const;
+    // The proxy whose bounds the ray hits first within maxDistance, or -1. distance is in multiples of direction.
+    int raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float& distance) const;
+
+    size_t size() const { return proxyCount; }
+    // Every proxy is below this
+    size_t proxyLimit() const { return nodes.size(); }
+    // 0 for a single leaf, -1 for an empty tree
+    int height() const { return root < 0 ? -1 : links[root].height; }
+
+private:
+    // What the queries read
+    struct Node {
+        AABB bounds;            // the real bounds for leaves, the union of the children's enlarged boxes otherwise
+        int child1;             // -1 for leaves
+        int child2;
+
+        bool isLeaf() const { return child1 < 0; }
+    };
+
+    // The rest, with the same index
+    struct Links {
+        AABB fatBounds;         // leaves only, the bounds enlarged by BVH_FAT_MARGIN
+        SceneNode* sceneNode;   // leaves only
+        int parent;             // the next free node, for free nodes
+        int height;             // 0 for leaves, -1 for free nodes
+    };
+
+    // The box the parent has to cover
+    const AABB& fatBounds(int index) const { return nodes[index].isLeaf() ? links[index].fatBounds : nodes[index].bounds; }
+
+    int allocateNode();
+    void freeNode(int index);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    // Rotates the subtree if one side is more than one level taller, returns the index of its new root
+    int balance(int index);
+    // Recomputes bounds and heights from index up to the root, balancing on the way
+    void refitAncestors(int index);
+
+    std::vector<Node> nodes;
+    std::vector<Links> links;
+    int root = -1;
+    int freeList = -1;
+    size_t proxyCount = 0;
+};
@@ -0,0 +1,111 @@
+#include "frameStats.hpp"
+#include <chrono>
+#include <cstdio>
+
+FrameStats frameStats;
+
+namespace {
+
+const double REPORT_INTERVAL_SECONDS = 5.0;
+
+// Sums of the frames since the last report
+FrameStats accumulated;
+unsigned int accumulatedFrames = 0;
+std::chrono::steady_clock::time_point lastReport = std::chrono::steady_clock::now();
+
+} // namespace
+
+void beginFrameStats() {
+    frameStats = FrameStats();
+}
+
+void endFrameStats() {
+    accumulated.drawCalls += frameStats.drawCalls;
+    accumulated.instanceBatches += frameStats.instanceBatches;
+    accumulated.instancedNodes += frameStats.instancedNodes;
+    accumulated.triangles += frameStats.triangles;
+    accumulated.lodTrianglesSaved += frameStats.lodTrianglesSaved;
+    for (int level = 0; level < MAX_MESH_LODS; level++) {
+        accumulated.lodNodes[level] += frameStats.lodNodes[level];
+    }
+    for (int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        accumulated.terrainChunks[pass] += frameStats.terrainChunks[pass];
+        accumulated.terrainTriangles[pass] += frameStats.terrainTriangles[pass];
+    }
+    accumulated.terrainTrianglesSaved += frameStats.terrainTrianglesSaved;
+    accumulated.matricesUpdated += frameStats.matricesUpdated;
+    accumulated.transformMs += frameStats.transformMs;
+    for (int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        accumulated.nodesDrawn[pass] += frameStats.nodesDrawn[pass];
+        accumulated.nodesCulled[pass] += frameStats.nodesCulled[pass];
+    }
+    accumulated.cullMs += frameStats.cullMs;
+    accumulated.nodesOccluded += frameStats.nodesOccluded;
+    accumulated.occluderTriangles += frameStats.occluderTriangles;
+    accumulated.occlusionMs += frameStats.occlusionMs;
+    accumulated.streaming = accumulated.streaming || frameStats.streaming;
+    accumulated.residentTiles += frameStats.residentTiles;
+    accumulated.pendingTiles += frameStats.pendingTiles;
+    accumulated.readyTiles += frameStats.readyTiles;
+    accumulated.residentTileBytes += frameStats.residentTileBytes;
+    accumulated.tileBudgetBytes = frameStats.tileBudgetBytes;
+    accumulated.tileUploads += frameStats.tileUploads;
+    accumulated.tileEvictions += frameStats.tileEvictions;
+    accumulated.tileUploadMs += frameStats.tileUploadMs;
+    accumulated.glCallsIssued += frameStats.glCallsIssued;
+    accumulated.glCallsSkipped += frameStats.glCallsSkipped;
+    accumulated.glStateMismatches += frameStats.glStateMismatches;
+    accumulatedFrames++;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastReport).count();
+    if (seconds < REPORT_INTERVAL_SECONDS) return;
+
+    double frames = accumulatedFrames;
+    printf("Frame stats (%.1f fps): %.0f draw calls, %.0f triangles, LODs saved %.0f mesh and %.0f terrain triangles, "
+           "nodes per LOD:", frames / seconds, accumulated.drawCalls / frames, accumulated.triangles / frames,
+           accumulated.lodTrianglesSaved / frames, accumulated.terrainTrianglesSaved / frames);
+    for (int level = 0; level < MAX_MESH_LODS; level++) {
+        printf(" %.1f", accumulated.lodNodes[level] / frames);
+    }
+    printf(", %.0f matrices updated in %.3f ms\n", accumulated.matricesUpdated / frames, accumulated.transformMs / frames);
+    printf("Terrain: shadow pass %.0f chunks, %.0f triangles; main pass %.0f chunks, %.0f triangles\n",
+           accumulated.terrainChunks[SHADOW_PASS] / frames, accumulated.terrainTriangles[SHADOW_PASS] / frames,
+           accumulated.terrainChunks[MAIN_PASS] / frames, accumulated.terrainTriangles[MAIN_PASS] / frames);
+    printf("Instancing: %.0f nodes in %.0f instanced draw calls\n",
+           accumulated.instancedNodes / frames, accumulated.instanceBatches / frames);
+    printf("Culling: shadow pass %.0f drawn, %.0f culled; main pass %.0f drawn, %.0f culled; %.3f ms\n",
+           accumulated.nodesDrawn[SHADOW_PASS] / frames, accumulated.nodesCulled[SHADOW_PASS] / frames,
+           accumulated.nodesDrawn[MAIN_PASS] / frames, accumulated.nodesCulled[MAIN_PASS] / frames,
+           accumulated.cullMs / frames);
+    printf("Occlusion: %.0f of the main pass's culled nodes hidden behind %.0f occluder triangles; %.3f ms\n",
+           accumulated.nodesOccluded / frames, accumulated.occluderTriangles / frames, accumulated.occlusionMs / frames);
+    if (accumulated.streaming) {
+        printf("Streaming: %.0f resident tiles, %.1f of %.0f MB; %.1f pending, %.1f ready; "
+               "%.0f uploads and %.0f evictions in %.1f s, %.3f ms uploading per frame\n",
+               accumulated.residentTiles / frames, accumulated.residentTileBytes / frames / (1024.0 * 1024.0),
+               accumulated.tileBudgetBytes / (1024.0 * 1024.0), accumulated.pendingTiles / frames,
+               accumulated.readyTiles / frames, (double)accumulated.tileUploads, (double)accumulated.tileEvictions,
+               seconds, accumulated.tileUploadMs / frames);
+    }
+    printf("GL state: %.0f state and uniform calls issued, %.0f skipped as redundant; %u mismatches with GL\n",
+           accumulated.glCallsIssued / frames, accumulated.glCallsSkipped / frames, accumulated.glStateMismatches);
+
+    accumulated = FrameStats();
+    accumulatedFrames = 0;
+    lastReport = now;
+}
+
+void countMeshDraw(const MeshLODSet& lods, int level) {
+    frameStats.triangles += lods.levels[level].indexCount / 3;
+    frameStats.lodTrianglesSaved += (lods.levels[0].indexCount - lods.levels[level].indexCount) / 3;
+    frameStats.lodNodes[level]++;
+}
+
+void countTerrainDraw(RenderPass pass, unsigned int chunks, unsigned int triangles, unsigned int fullDetailTriangles) {
+    frameStats.drawCalls += chunks;
+    frameStats.triangles += triangles;
+    frameStats.terrainChunks[pass] += chunks;
+    frameStats.terrainTriangles[pass] += triangles;
+    frameStats.terrainTrianglesSaved += fullDetailTriangles - triangles;
+}
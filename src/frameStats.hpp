@@ -0,0 +1,51 @@
+#pragma once
+
+#include "utilities/meshSimplifier.hpp"
+
+enum RenderPass { SHADOW_PASS, MAIN_PASS, RENDER_PASS_COUNT };
+
+// Counters for what the current frame did, from beginFrameStats() in updateFrame() to endFrameStats() at the
+// end of renderFrame(), which prints averages every few seconds.
+struct FrameStats {
+    unsigned int drawCalls = 0;
+    unsigned int instanceBatches = 0;           // instanced draw calls, one per mesh, level of detail and material
+    unsigned int instancedNodes = 0;            // nodes drawn through them
+    unsigned long long triangles = 0;           // drawn, after picking the levels of detail
+    unsigned long long lodTrianglesSaved = 0;   // full detail triangles that a coarser level replaced
+    unsigned int lodNodes[MAX_MESH_LODS] = {};  // nodes drawn at each level of detail
+    unsigned int terrainChunks[RENDER_PASS_COUNT] = {};         // terrain chunks or streamed tiles drawn, a call each
+    unsigned long long terrainTriangles[RENDER_PASS_COUNT] = {};    // and their triangles
+    unsigned long long terrainTrianglesSaved = 0;   // full detail terrain triangles that coarser levels replaced
+    unsigned int matricesUpdated = 0;           // world matrices recomputed for nodes that moved
+    double transformMs = 0.0;                   // wall time of the world matrix updates
+    unsigned int nodesDrawn[RENDER_PASS_COUNT] = {};    // geometry nodes that passed the frustum test
+    unsigned int nodesCulled[RENDER_PASS_COUNT] = {};   // nodes with bounds outside the pass's frustum
+    double cullMs = 0.0;                        // wall time of the frustum queries
+    unsigned int nodesOccluded = 0;             // main pass nodes in the frustum but behind the occluders
+    unsigned int occluderTriangles = 0;         // drawn into the occlusion buffer after clipping
+    double occlusionMs = 0.0;                   // wall time of drawing the occlusion buffer and testing against it
+    bool streaming = false;                     // the rest of this block is only filled with --stream-terrain
+    unsigned int residentTiles = 0;             // streamed terrain tiles on the GPU
+    unsigned int pendingTiles = 0;              // queued or being generated on the workers
+    unsigned int readyTiles = 0;                // generated, waiting for their upload
+    unsigned long long residentTileBytes = 0;
+    unsigned long long tileBudgetBytes = 0;     // the memory budget of the resident tiles
+    unsigned int tileUploads = 0;               // limited to a few per frame
+    unsigned int tileEvictions = 0;
+    double tileUploadMs = 0.0;
+    unsigned int glCallsIssued = 0;             // state and uniform calls the GL state cache passed on
+    unsigned int glCallsSkipped = 0;            // and those it dropped as redundant
+    unsigned int glStateMismatches = 0;         // cached state that GL disagreed with (--check-gl-state)
+};
+
+extern FrameStats frameStats;
+
+void beginFrameStats();
+void endFrameStats();
+
+// Counts one node drawn at the given level of its LOD set. The draw call is counted where it is issued, since
+// the node may share it with others (see instancing.hpp).
+void countMeshDraw(const MeshLODSet& lods, int level);
+
+// Counts the terrain chunks (or streamed tiles) one pass drew, one draw call each
+void countTerrainDraw(RenderPass pass, unsigned int chunks, unsigned int triangles, unsigned int fullDetailTriangles);
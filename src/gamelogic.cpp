@@ -1,3 +1,4 @@
+#include <atomic>
 #include <chrono>
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
@@ -15,15 +16,25 @@
 #include <fmt/format.h>
 #include "gamelogic.h"
 #include "sceneGraph.hpp"
+#include "terrain.hpp"
+#include "terrainStreaming.hpp"
+#include "water.hpp"
+#include "frameStats.hpp"
+#include "animation.hpp"
+#include "occlusionCulling.hpp"
+#include "instancing.hpp"
+#include "renderQueue.hpp"
 #define GLM_ENABLE_EXPERIMENTAL
-#define STB_PERLIN_IMPLEMENTATION
 #include <glm/gtx/transform.hpp>
 #include "utilities/imageLoader.hpp"
 #include "utilities/glfont.h"
+#include "utilities/glStateCache.hpp"
+#include "utilities/meshOptimizer.hpp"
+#include "utilities/meshSimplifier.hpp"
 #include "utilities/objectLoader.hpp"
+#include "utilities/threadPool.hpp"
 #include <vector>
 #include <glm/gtx/string_cast.hpp>
-#include "stb_perlin.h"
 #include <filesystem> 
 
 
@@ -43,258 +54,43 @@ SceneNode* boatNode;
 SceneNode* dirLight;
 SceneNode* waterNode;
 SceneNode* tree1Node;
+TerrainMesh terrainMesh;
+TerrainStreamer* terrainStreamer = nullptr;
+MeshLODSet treeLODs;
+MeshLODSet boatLODs;
+MeshLODSet fishLODs;
 const unsigned int SHADOW_WIDTH = 20000;
 const unsigned int SHADOW_HEIGHT = 20000;
 
-unsigned int depthMapFBO;
-unsigned int depthMap;
-bool renderingShadowMap = false;
-
-Gloom::Shader* shader;
-
-struct TerrainMesh {
-    unsigned int VAO, VBO, EBO;
-    int indexCount;
-};
-
-struct WaterMesh {
-    unsigned int VAO, VBO, EBO;
-    int indexCount;
-};
-
-WaterMesh generateWaterMesh(int size, glm::vec2 lakeCenter, float lakeRadius, float waterLevel, float uvScale) {
-    std::vector<float> waterVertices; // Stores vertex atrributes, position, UV and normal
-    std::vector<unsigned int> waterIndices;// Triangle indices
-    std::vector<int> validIndices(size * size, -1); //Keeps track of valid indices -> That is inside the lake
-
-    int index = 0;
-
-    //Precompute heights for normal calculation 
-    std::vector<float> heights(size * size, waterLevel);
-
-    // Generate vertices
-    for (int z = 0; z < size; ++z) {
-        for (int x = 0; x < size; ++x) {
-            // Create an elliptical lake shape
-            float ellipseFactorX = 1.3f;
-            float ellipseFactorZ = 0.8f;
-            float baseDistance = glm::distance(glm::vec2((x - lakeCenter.x) * ellipseFactorX,
-                                                         (z - lakeCenter.y) * ellipseFactorZ), glm::vec2(0.0f));
-            //If we are inside the lake
-            if (baseDistance < lakeRadius) { 
-                float height = waterLevel;
-
-                waterVertices.push_back((float)x - size * 0.5f);  // X
-                waterVertices.push_back(height);                 // Y 
-                waterVertices.push_back((float)z - size * 0.5f); // Z
-
-                heights[z * size + x] = height;
-
-                // UV coordinates
-                waterVertices.push_back((float)x / (size * uvScale));
-                waterVertices.push_back((float)z / (size * uvScale));
-
-                // Normal (initial: up)
-                waterVertices.push_back(0.0f); // Normal X
-                waterVertices.push_back(1.0f); // Normal Y
-                waterVertices.push_back(0.0f); // Normal Z
+// Height in pixels of what is being rendered, the window or the shadow map, for picking levels of detail
+float viewportHeight = 1.0f;
+// How far a level of detail may move the surface on screen before a finer one is used
+const float MAX_LOD_PIXEL_ERROR = 1.0f;
 
-                validIndices[z * size + x] = index++;
-            }
-        }
-    }
-    //Calculate normals based on surrounding height differences
-    for (int z = 1; z < size - 1; ++z) {
-        for (int x = 1; x < size - 1; ++x) {
-            if (validIndices[z * size + x] == -1) continue;
-
-            int index = validIndices[z * size + x] * 8; // 8 attributes per vertex
-
-            float hL = heights[z * size + (x - 1)];
-            float hR = heights[z * size + (x + 1)];
-            float hD = heights[(z - 1) * size + x];
-            float hU = heights[(z + 1) * size + x];
-
-            glm::vec3 normal = glm::normalize(glm::vec3(hL - hR, 2.0f, hD - hU));
-
-            // Update normal
-            waterVertices[index + 5] = normal.x;
-            waterVertices[index + 6] = normal.y;
-            waterVertices[index + 7] = normal.z;
-        }
-    }
-    //Genrerte indices for triangles. Two triangles per quad
-    for (int z = 0; z < size - 1; ++z) {
-        for (int x = 0; x < size - 1; ++x) {
-            int topLeft = z * size + x;
-            int topRight = topLeft + 1;
-            int bottomLeft = (z + 1) * size + x;
-            int bottomRight = bottomLeft + 1;
-
-            if (validIndices[topLeft] != -1 && validIndices[bottomLeft] != -1 && validIndices[topRight] != -1) {
-                waterIndices.push_back(validIndices[topLeft]);
-                waterIndices.push_back(validIndices[bottomLeft]);
-                waterIndices.push_back(validIndices[topRight]);
-            }
-            if (validIndices[topRight] != -1 && validIndices[bottomLeft] != -1 && validIndices[bottomRight] != -1) {
-                waterIndices.push_back(validIndices[topRight]);
-                waterIndices.push_back(validIndices[bottomLeft]);
-                waterIndices.push_back(validIndices[bottomRight]);
-            }
-        }
-    }
-    //Create and return a WaterMesh struct
-    WaterMesh waterMesh;
-    waterMesh.indexCount = waterIndices.size();
-
-    glGenVertexArrays(1, &waterMesh.VAO);
-    glGenBuffers(1, &waterMesh.VBO);
-    glGenBuffers(1, &waterMesh.EBO);
-
-    glBindVertexArray(waterMesh.VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, waterMesh.VBO);
-    glBufferData(GL_ARRAY_BUFFER, waterVertices.size() * sizeof(float), waterVertices.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, waterMesh.EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, waterIndices.size() * sizeof(unsigned int), waterIndices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);         // Posisjon
-    glEnableVertexAttribArray(0);
+// The pass being drawn, and which BVH proxies are in its frustum, see cullScene()
+RenderPass currentPass = MAIN_PASS;
+std::vector<unsigned char> proxyVisible;
+std::vector<int> visibleProxies;
 
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float))); // UV
-    glEnableVertexAttribArray(1);
+// Coarse terrain drawn into a small CPU depth buffer before the main pass, see cullScene()
+std::vector<OccluderMesh> terrainOccluders;
+OcclusionBuffer occlusionBuffer;
+bool occlusionCullingEnabled = true;
 
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float))); // Normal
-    glEnableVertexAttribArray(2);
+// Compare the GL state cache with what GL reports once per frame (--check-gl-state)
+bool checkGLState = false;
 
-    glBindVertexArray(0);
-
-    return waterMesh;
-}
-
-
-
-
-TerrainMesh generateUnevenTerrain(int size, float heightScale, float uvScale) {
-    std::vector<float> vertices;
-    std::vector<float> normals(size * size * 3, 0.0f);
-    std::vector<unsigned int> indices;
-
-    float noiseScale = 0.1f;
-    float centerX = size / 2.0f;
-    float centerZ = size / 2.0f;
-
-    glm::vec2 lakeCenter = glm::vec2(size * 0.7f, size * 0.4f); //Move the lake to the side
-    float lakeRadius = size * 0.08f; // Lake size
-
-    // Generate vertex positions using Perlin noise
-    for (int z = 0; z < size; ++z) {
-        for (int x = 0; x < size; ++x) {
-
-            float noiseFactor = stb_perlin_noise3(x * 0.2f, z * 0.2f, 0.0f, 0, 0, 0) * 8.0f;
-
-            float ellipseFactorX = 1.3f;  // Stretch in x-direction
-            float ellipseFactorZ = 0.8f;  // Compress in z-direction
-            float baseDistance = glm::distance(glm::vec2((x - lakeCenter.x) * ellipseFactorX,
-                                                         (z - lakeCenter.y) * ellipseFactorZ), glm::vec2(0.0f));
-
-            float distortedDistance = baseDistance + noiseFactor;
-
-            float height = stb_perlin_noise3(x * noiseScale, z * noiseScale, 0.0f, 0, 0, 0) * heightScale;
-
-            if (distortedDistance < lakeRadius) {
-                float blend = glm::smoothstep(lakeRadius - 10.0f, lakeRadius, distortedDistance);
-                height = glm::mix(-20.0f, height, blend);
-                
-            }
-
-            vertices.push_back((float)x - size * 0.5f); // X
-            vertices.push_back(height);                 // Y
-            vertices.push_back((float)z - size * 0.5f); // Z
-            vertices.push_back((float)x / (size * uvScale));
-            vertices.push_back((float)z / (size * uvScale));
-        }
-    }
-
-    for (int z = 0; z < size - 1; ++z) {
-        for (int x = 0; x < size - 1; ++x) {
-            int topLeft = (z * size) + x;
-            int topRight = topLeft + 1;
-            int bottomLeft = ((z + 1) * size) + x;
-            int bottomRight = bottomLeft + 1;
-
-            indices.push_back(topLeft);
-            indices.push_back(bottomLeft);
-            indices.push_back(topRight);
-
-            indices.push_back(topRight);
-            indices.push_back(bottomLeft);
-            indices.push_back(bottomRight);
-        }
-    }
-
-    for (int z = 1; z < size - 1; ++z) {
-        for (int x = 1; x < size - 1; ++x) {
-            int idx = (z * size + x) * 5;
-
-            float hL = vertices[idx + 1 - 5];
-            float hR = vertices[idx + 1 + 5];
-            float hD = vertices[idx + 1 - 5 * size];
-            float hU = vertices[idx + 1 + 5 * size];
-
-            glm::vec3 normal = glm::normalize(glm::vec3(hL - hR, 2.0f, hD - hU));
-
-            if (glm::distance(glm::vec2(x, z), lakeCenter) < lakeRadius) {
-                normal = glm::vec3(0.0f, 1.0f, 0.0f);
-            }
-
-            int normalIdx = (z * size + x) * 3;
-            normals[normalIdx] = normal.x;
-            normals[normalIdx + 1] = normal.y;
-            normals[normalIdx + 2] = normal.z;
-        }
-    }
-
-    TerrainMesh terrain;
-    terrain.indexCount = indices.size();
-
-    glGenVertexArrays(1, &terrain.VAO);
-    glGenBuffers(1, &terrain.VBO);
-    glGenBuffers(1, &terrain.EBO);
-
-    glBindVertexArray(terrain.VAO);
-
-    std::vector<float> vertexData;
-    for (int i = 0; i < size * size; ++i) {
-        vertexData.push_back(vertices[i * 5]);
-        vertexData.push_back(vertices[i * 5 + 1]);
-        vertexData.push_back(vertices[i * 5 + 2]);
-        vertexData.push_back(normals[i * 3]);
-        vertexData.push_back(normals[i * 3 + 1]);
-        vertexData.push_back(normals[i * 3 + 2]);
-        vertexData.push_back(vertices[i * 5 + 3]);
-        vertexData.push_back(vertices[i * 5 + 4]);
-    }
-
-    glBindBuffer(GL_ARRAY_BUFFER, terrain.VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), vertexData.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain.EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+// What the current pass draws, collected from the scene graph and sorted before drawing, see collectNode()
+RenderQueue renderQueue;
+const float RENDER_FAR_DEPTH = 1000.0f;
+// How far up the boat is moved for the shadow pass
+const glm::vec3 SHADOW_BOAT_LIFT = glm::vec3(0.0f, 30.0f, 0.0f);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+unsigned int depthMapFBO;
+unsigned int depthMap;
+bool renderingShadowMap = false;
 
-    glBindVertexArray(0);
-    return terrain;
-}
+Gloom::Shader* shader;
 
 
 SceneNode* createTerrainNode(const TerrainMesh& terrainMesh) {
@@ -302,6 +98,8 @@ SceneNode* createTerrainNode(const TerrainMesh& terrainMesh) {
     terrainNode->nodeType = GEOMETRY;
     terrainNode->vertexArrayObjectID = terrainMesh.VAO;
     terrainNode->VAOIndexCount = terrainMesh.indexCount;
+    terrainNode->vertexQuantization = terrainMesh.quantization;
+    terrainNode->setLocalBounds(terrainMesh.boundsMin, terrainMesh.boundsMax);
     return terrainNode;
 }
 
@@ -506,17 +304,20 @@ SceneNode* createSkyboxNode(GLuint cubemapTexture) {
     skyboxNode->textureID = cubemapTexture;
 
     // Large scale so the skybox surrounds the scene
-    skyboxNode->scale = glm::vec3(1000.0f);
+    skyboxNode->setScale(glm::vec3(1000.0f));
 
     return skyboxNode;
 }
 
 
-SceneNode* createTreeNode(Mesh treeMesh, unsigned int treeVAO, unsigned int treeTextureID) {
+SceneNode* createTreeNode(Mesh treeMesh, unsigned int treeVAO, const VertexQuantization& treeQuantization, const AABB& treeBounds, unsigned int treeTextureID) {
     SceneNode* treeNode = createSceneNode();
     treeNode->nodeType = GEOMETRY;
     treeNode->vertexArrayObjectID = treeVAO;          // VAO for texure
     treeNode->VAOIndexCount = treeMesh.indices.size(); 
+    treeNode->vertexQuantization = treeQuantization;
+    treeNode->lodSet = &treeLODs;
+    treeNode->setLocalBounds(treeBounds.min, treeBounds.max);
     treeNode->textureID = treeTextureID;
 
     return treeNode;
@@ -524,7 +325,33 @@ SceneNode* createTreeNode(Mesh treeMesh, unsigned int treeVAO, unsigned int tree
 
 
 
-unsigned int createTreeVAO(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
+void optimizeObjMesh(const char* name, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    MeshOptimizationReport report = optimizeMesh(vertices.data(), vertices.size(), sizeof(Vertex), offsetof(Vertex, position),
+                                                 indices.data(), indices.size());
+    vertices.resize(report.vertexCount);
+    printMeshOptimizationReport(name, report);
+}
+
+// Vertex is 8 floats: position, normal, UV
+const FloatVertexLayout OBJ_FLOAT_LAYOUT = {8, 0, 3, 6};
+
+AABB objMeshBounds(const std::vector<Vertex>& vertices) {
+    static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must be tightly packed floats");
+    AABB bounds;
+    if (!vertices.empty()) floatVertexBounds((const float*)vertices.data(), vertices.size(), OBJ_FLOAT_LAYOUT, bounds.min, bounds.max);
+    return bounds;
+}
+
+// Appends the coarser levels to indices, so the index buffer holds all of them
+MeshLODSet buildObjLODs(const char* name, const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    static_assert(sizeof(Vertex) % sizeof(float) == 0, "Vertex must be made of floats");
+    const float* positions = vertices.empty() ? nullptr : &vertices[0].position.x;
+    MeshLODSet lods = buildMeshLODs(indices, positions, sizeof(Vertex) / sizeof(float), vertices.size());
+    printMeshLODs(name, lods);
+    return lods;
+}
+
+unsigned int createTreeVAO(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, VertexQuantization& quantization) {
     unsigned int VAO, VBO, EBO;
 
     glGenVertexArrays(1, &VAO);
@@ -534,22 +361,38 @@ unsigned int createTreeVAO(const std::vector<Vertex>& vertices, const std::vecto
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    if (compactVerticesEnabled()) {
+        AABB bounds = objMeshBounds(vertices);
+        quantization = vertexQuantization(bounds.min, bounds.max);
+
+        std::vector<CompactVertex> compact(vertices.size());
+        CompactVertexReport report = compactVertices((const float*)vertices.data(), vertices.size(), OBJ_FLOAT_LAYOUT, quantization, compact.data());
+        printCompactVertexReport("OBJ mesh", report);
+        glBufferData(GL_ARRAY_BUFFER, compact.size() * sizeof(CompactVertex), compact.data(), GL_STATIC_DRAW);
+    } else {
+        quantization = VertexQuantization();
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    }
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
-    // Position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-    glEnableVertexAttribArray(0);
+    if (quantization.compact) {
+        setCompactVertexAttributes();
+    } else {
+        // Position
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(0);
 
-    // Normal
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    glEnableVertexAttribArray(1);
+        // Normal
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
 
-    // UV
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
-    glEnableVertexAttribArray(2);
+        // UV
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+        glEnableVertexAttribArray(2);
+    }
+    setInstanceAttributes();
 
     glBindVertexArray(0);
 
@@ -601,10 +444,14 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
     cameraPos += cameraFront * (yOffset * moveSpeed);
 }
 
-void initGame(GLFWwindow* window) {
+void initGame(GLFWwindow* window, CommandLineOptions options) {
     glfwSetCursorPosCallback(window, mouseCallback);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
+    setWorkerThreadCount(std::max(options.workerThreads, 0));
+    setCompactVertices(options.compactVertices);
+    occlusionCullingEnabled = options.occlusionCulling;
+    checkGLState = options.checkGLState;
     glm::vec2 lakeCenter = glm::vec2(700, 400);
     float lakeRadius = 80.0f;
     float waterLevel = -18.0f;
@@ -633,22 +480,25 @@ void initGame(GLFWwindow* window) {
     std::vector<Vertex> boatVertices;
     std::vector<unsigned int> boatIndices;
     
-    if (!loadOBJ("../res/obj/boat.obj", boatVertices, boatIndices)) {
+    if (!loadCachedOBJ("../res/obj/boat.obj", boatVertices, boatIndices)) {
         std::cerr << "Failed to load boat model!" << std::endl;
-    } 
+    }
+    optimizeObjMesh("Boat", boatVertices, boatIndices);
     std::vector<Vertex> treeVertices;
     std::vector<unsigned int> treeIndices;
 
-    if (!loadOBJ("../res/obj/RedDeliciousApple.obj", treeVertices, treeIndices)) {
+    if (!loadCachedOBJ("../res/obj/RedDeliciousApple.obj", treeVertices, treeIndices)) {
         std::cerr << "Failed to load tree model!" << std::endl;
     }
+    optimizeObjMesh("Tree", treeVertices, treeIndices);
 
     std::vector<Vertex> fishVertices;
     std::vector<unsigned int> fishIndices;
 
-    if (!loadOBJ("../res/obj/fish.obj", fishVertices, fishIndices)) {
+    if (!loadCachedOBJ("../res/obj/fish.obj", fishVertices, fishIndices)) {
         std::cerr << "Failed to load fish model!" << std::endl;
     }
+    optimizeObjMesh("Fish", fishVertices, fishIndices);
 
     // Convert Vertex data to position-only (glm::vec3)
     std::vector<glm::vec3> treePositions;
@@ -676,11 +526,18 @@ void initGame(GLFWwindow* window) {
     fishmesh.vertices = fishPositions;
     fishmesh.indices = fishIndices;
 
+    treeLODs = buildObjLODs("Tree", treeVertices, treeIndices);
+    boatLODs = buildObjLODs("Boat", boatVertices, boatIndices);
+    fishLODs = buildObjLODs("Fish", fishVertices, fishIndices);
 
     // Create VAO for the tree and boat
-    unsigned int treeVAO = createTreeVAO(treeVertices, treeIndices);
-    unsigned int boatVAO = createTreeVAO(boatVertices, boatIndices);
-    unsigned int fishVAO = createTreeVAO(fishVertices, fishIndices);
+    VertexQuantization treeQuantization, boatQuantization, fishQuantization;
+    unsigned int treeVAO = createTreeVAO(treeVertices, treeIndices, treeQuantization);
+    unsigned int boatVAO = createTreeVAO(boatVertices, boatIndices, boatQuantization);
+    unsigned int fishVAO = createTreeVAO(fishVertices, fishIndices, fishQuantization);
+    AABB treeBounds = objMeshBounds(treeVertices);
+    AABB boatBounds = objMeshBounds(boatVertices);
+    AABB fishBounds = objMeshBounds(fishVertices);
 
     //Set up the shader
     shader = new Gloom::Shader();
@@ -702,38 +559,64 @@ void initGame(GLFWwindow* window) {
     waterNode->nodeType = GEOMETRY;
     waterNode->vertexArrayObjectID = waterMesh.VAO;
     waterNode->VAOIndexCount = waterMesh.indexCount;
-    waterNode->position = glm::vec3(0, 15.0, 0); // Adjust water height
+    waterNode->vertexQuantization = waterMesh.quantization;
+    waterNode->setLocalBounds(waterMesh.boundsMin, waterMesh.boundsMax);
+    waterNode->flags = NODE_WATER;
+    waterNode->setPosition(glm::vec3(0, 15.0, 0)); // Adjust water height
 
     tree1Node = createSceneNode();
     tree1Node->nodeType = GEOMETRY;
     tree1Node->vertexArrayObjectID = treeVAO;
     tree1Node->VAOIndexCount = treemesh.indices.size();
-    tree1Node->position = glm::vec3(worldX + 60, 0.0f, worldZ);
+    tree1Node->vertexQuantization = treeQuantization;
+    tree1Node->lodSet = &treeLODs;
+    tree1Node->setLocalBounds(treeBounds.min, treeBounds.max);
+    tree1Node->setPosition(glm::vec3(worldX + 60, 0.0f, worldZ));
     tree1Node->textureID = treeTexture;
-    tree1Node->scale = glm::vec3(4.0f);
+    tree1Node->setScale(glm::vec3(4.0f));
+    tree1Node->flags = NODE_TREE;
+    addSway(tree1Node);
 
     //Boat setup
     boatNode = createSceneNode();
     boatNode->nodeType = GEOMETRY;
     boatNode->vertexArrayObjectID = boatVAO;
     boatNode->VAOIndexCount = boatmesh.indices.size();
-    boatNode->position = glm::vec3(worldX-20, -10.0f, worldZ+20); 
+    boatNode->vertexQuantization = boatQuantization;
+    boatNode->lodSet = &boatLODs;
+    boatNode->setLocalBounds(boatBounds.min, boatBounds.max);
+    boatNode->setPosition(glm::vec3(worldX-20, -10.0f, worldZ+20)); 
     boatNode->textureID = boatTexture;
-    boatNode->scale = glm::vec3(2.5f);
+    boatNode->setScale(glm::vec3(2.5f));
+    boatNode->flags = NODE_BOAT;
+    addBob(boatNode, -2.5f);
 
 
     //Terrain setup
-    TerrainMesh terrainMesh = generateUnevenTerrain(1000, 4, 0.02f);
-    terrainNode = createTerrainNode(terrainMesh);
+    if (options.streamTerrain) {
+        // The tiles come in over the first frames, starting right under the camera. The streamer picks the
+        // tiles to draw itself, so the node gets no bounds and stays out of the BVH.
+        terrainStreamer = new TerrainStreamer({1000, 4, 0.02f});
+        terrainNode = createSceneNode();
+        terrainNode->nodeType = GEOMETRY;
+    } else {
+        terrainMesh = generateUnevenTerrain(1000, 4, 0.02f);
+        terrainNode = createTerrainNode(terrainMesh);
+    }
     terrainNode->textureID = terrainTexture;
+    // The streamed terrain uses the same heights, so the fixed 1000x1000 area occludes in both modes.
+    // The water is blended and hides nothing.
+    if (occlusionCullingEnabled) {
+        terrainOccluders = buildTerrainOccluders({1000, 4, 0.02f});
+    }
 
     // Add the nodes to the scene graph
-    rootNode->children.push_back(waterNode);
-    rootNode->children.push_back(dirLight);
-    rootNode->children.push_back(terrainNode);
-    rootNode->children.push_back(skyboxNode); 
-    rootNode->children.push_back(boatNode);
-    rootNode->children.push_back(tree1Node);
+    addChild(rootNode, waterNode);
+    addChild(rootNode, dirLight);
+    addChild(rootNode, terrainNode);
+    addChild(rootNode, skyboxNode); 
+    addChild(rootNode, boatNode);
+    addChild(rootNode, tree1Node);
 
     //Generate trees and add them to the scene graph
     const int numTrees = 30;
@@ -760,21 +643,26 @@ void initGame(GLFWwindow* window) {
         newFish->nodeType = GEOMETRY;
         newFish->vertexArrayObjectID = fishVAO;
         newFish->VAOIndexCount = fishmesh.indices.size();
+        newFish->vertexQuantization = fishQuantization;
+        newFish->lodSet = &fishLODs;
+        newFish->setLocalBounds(fishBounds.min, fishBounds.max);
         newFish->textureID = fishTexture;
-        newFish->position = glm::vec3(x, -7.0, z);
-        newFish->scale = glm::vec3(0.3f);
-        newFish->rotation.x = glm::radians(-90.0f);
+        newFish->setPosition(glm::vec3(x, -7.0, z));
+        newFish->setScale(glm::vec3(0.3f));
+        newFish->setRotation(glm::vec3(glm::radians(-90.0f), 0.0f, 0.0f));
+        newFish->flags = NODE_FISH;
+        addSwim(newFish);
 
     
 
         fishNodes.push_back(newFish);
-        rootNode->children.push_back(newFish);
+        addChild(rootNode, newFish);
         fishAdded++;
     }
     
 
     for (int i = 0; i < numTrees; i++) {
-        SceneNode* newTree = createTreeNode(treemesh, treeVAO, treeTexture);
+        SceneNode* newTree = createTreeNode(treemesh, treeVAO, treeQuantization, treeBounds, treeTexture);
 
         // Random position within the range -500 to 500 
         float x = (rand() % 1000) - 500;
@@ -784,157 +672,306 @@ void initGame(GLFWwindow* window) {
         // Randomly scaling the trees between 1 and 5
         float scaleFactor = 1.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (5.0f - 1.0f)));
 
-        newTree->position = glm::vec3(x, y, z);
-        newTree->scale = glm::vec3(scaleFactor);
+        newTree->setPosition(glm::vec3(x, y, z));
+        newTree->setScale(glm::vec3(scaleFactor));
+        newTree->flags = NODE_TREE;
+        addSway(newTree);
 
         treeNodes.push_back(newTree);
-        rootNode->children.push_back(newTree);
+        addChild(rootNode, newTree);
     }
+
+    // Everything above bound buffers, textures and VAOs directly
+    glState.invalidate();
 }
 
 void updateFrame(GLFWwindow* window) {
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    updateNodeTransformations(rootNode, glm::mat4(1.0f));
+    beginFrameStats();
+
+    // O writes the occlusion buffer of the last frame to disk, once per key press
+    static bool dumpKeyWasDown = false;
+    bool dumpKeyDown = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (dumpKeyDown && !dumpKeyWasDown && occlusionCullingEnabled) {
+        occlusionBuffer.writeImage("occlusion.pgm");
+    }
+    dumpKeyWasDown = dumpKeyDown;
+
+    glState.resetCounters();
+    updateNodeTransformations();
+
+    // Terrain chunks and their detail levels for this frame, shared by the shadow and main passes
+    if (terrainStreamer) {
+        terrainStreamer->update(cameraPos);
+        const TerrainStreamingStats& streaming = terrainStreamer->stats();
+        frameStats.streaming = true;
+        frameStats.residentTiles = streaming.residentTiles;
+        frameStats.pendingTiles = streaming.pendingTiles;
+        frameStats.readyTiles = streaming.readyTiles;
+        frameStats.residentTileBytes = streaming.residentBytes;
+        frameStats.tileBudgetBytes = terrainStreamer->memoryBudget();
+        frameStats.tileUploads = streaming.uploads;
+        frameStats.tileEvictions = streaming.evictions;
+        frameStats.tileUploadMs = streaming.uploadMs;
+    } else {
+        selectTerrainLOD(terrainMesh.lod, cameraPos);
+    }
 }
 
 
-void updateNodeTransformations(SceneNode* node, glm::mat4 currentModelMatrix) {
+// Combines the transforms that changed with their parents’ transforms, parents first
+void updateWorldMatrices() {
+    auto start = std::chrono::steady_clock::now();
+    frameStats.matricesUpdated += sceneStore.updateWorldMatrices(workerPool());
+    frameStats.transformMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void updateNodeTransformations() {
     static float time = 0.0f;
     time += getTimeDeltaSeconds(); // Time increases with each frame, used for animation
-    if (std::find(fishNodes.begin(), fishNodes.end(), node) != fishNodes.end()) {
-        float swimSpeed = 1.5f;
-        float amplitude = 12.0f;
-    
-        float offset = node->position.x * 0.1f + node->position.z * 0.1f;
-        node->position.x += sin(time * swimSpeed + offset) * 0.02f;
-        node->position.z += cos(time * swimSpeed + offset) * 0.02f;
-        node->rotation.y = sin(time * swimSpeed + offset) * glm::radians(30.0f); 
-    }
-    //Animate Tree Swaying
-    if ((std::find(treeNodes.begin(), treeNodes.end(), node) != treeNodes.end())|| node == tree1Node) {
-        float swayAmount = glm::radians(5.0f);  // Maximum rotation angle (5 degrees)
-        float swaySpeed = 0.7f;                 // Speed of the swaying (wind-like)
-
-        // Create a unique offset based on tree position so each tree moves slightly differently
-        float offset = node->position.x * 0.1f + node->position.z * 0.1f;
+    updateAnimations(time);
+    updateWorldMatrices();
+}
 
-        // Use both sine and cosine for more natural movement in multiple directions
-        node->rotation.x = sin(time * swaySpeed + offset) * swayAmount;  // Forward/backward sway
-        node->rotation.z = cos(time * swaySpeed + offset) * swayAmount;  // Side-to-side sway
-    }
-    if (node == boatNode && !renderingShadowMap) {
-        float waveStrength = 0.6f;
-        float waveSpeed = 2.0f;
-        float waveFrequency = 0.2f;
-    
-        float time = glfwGetTime(); 
-        float x = node->position.x;
-        float z = node->position.z;
-    
-        float wave1 = sin(time * waveSpeed + x * waveFrequency) * waveStrength;
-        float wave2 = cos(time * waveSpeed * 1.2f + z * waveFrequency * 1.5f) * (waveStrength * 0.7f);
-        float wave3 = sin(time * waveSpeed * 0.9f + (x + z) * waveFrequency * 1.1f) * (waveStrength * 0.5f);
-    
-        float waveOffset = wave1 + wave2 + wave3;
-    
-        float baseY = -2.5f;
-        node->position.y = baseY + waveOffset;
-    
-        node->rotation.x = sin(time * 1.5f) * glm::radians(2.0f);
-        node->rotation.z = cos(time * 1.3f) * glm::radians(2.0f);
-    }
 
-    //Compute Transformation Matrix
-    glm::mat4 transformationMatrix =
-              glm::translate(node->position)                 // Position in world space
-            * glm::translate(node->referencePoint)           // Move to reference point
-            * glm::rotate(node->rotation.y, glm::vec3(0,1,0)) // Y-axis rotation
-            * glm::rotate(node->rotation.x, glm::vec3(1,0,0)) // X-axis rotation
-            * glm::rotate(node->rotation.z, glm::vec3(0,0,1)) // Z-axis rotation
-            * glm::scale(node->scale)                         // Scaling
-            * glm::translate(-node->referencePoint);          // Move back from reference point
+// Picks the level of detail from how many pixels one model unit covers at the center of the mesh
+int selectNodeLOD(SceneNode* node, const glm::mat4& mvp, const glm::mat4& projection) {
+    const MeshLODSet& lods = *node->lodSet;
+    glm::vec4 center = mvp * glm::vec4(lods.center, 1.0f);
+    const glm::mat4& model = node->currentModelMatrix();
+    float maxScale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    // w is 1 for the orthographic shadow pass, and the view depth for the perspective camera
+    float depth = std::max(center.w, 1e-3f);
+    float pixelsPerUnit = maxScale * projection[1][1] * 0.5f * viewportHeight / depth;
 
-    // Combine this node’s transform with its parent’s transform
-    node->currentModelMatrix = currentModelMatrix * transformationMatrix;
+    int level = selectMeshLOD(lods, pixelsPerUnit, MAX_LOD_PIXEL_ERROR);
+    countMeshDraw(lods, level);
+    return level;
+}
 
-    for (SceneNode* child : node->children) {
-        updateNodeTransformations(child, node->currentModelMatrix);
-    }
+// Draws the terrain occluders and takes the nodes in the frustum that are hidden behind them out again
+void occludeScene(const glm::mat4& viewProjection) {
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool& pool = workerPool();
+    occlusionBuffer.render(terrainOccluders, viewProjection, pool);
+
+    std::atomic<unsigned int> occluded(0);
+    pool.parallelFor(0, (int)visibleProxies.size(), [&](int begin, int end) {
+        unsigned int hidden = 0;
+        for (int i = begin; i < end; i++) {
+            int proxy = visibleProxies[i];
+            if (!occlusionBuffer.isVisible(sceneStore.bvh.bounds(proxy))) {
+                proxyVisible[proxy] = 0;
+                hidden++;
+            }
+        }
+        occluded += hidden;
+    });
+    frameStats.nodesOccluded += occluded;
+    frameStats.occluderTriangles += occlusionBuffer.trianglesDrawn();
+    frameStats.occlusionMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
+// Marks the nodes whose bounds intersect the frustum of the pass about to be drawn
+void cullScene(RenderPass pass, const glm::mat4& viewProjection) {
+    auto start = std::chrono::steady_clock::now();
+    currentPass = pass;
+    Frustum frustum = frustumFromMatrix(viewProjection);
+    proxyVisible.assign(sceneStore.bvh.proxyLimit(), 0);
+    visibleProxies.clear();
+    sceneStore.bvh.queryFrustum(frustum, visibleProxies);
+    for (int proxy : visibleProxies) {
+        proxyVisible[proxy] = 1;
+    }
 
-void renderNode(SceneNode* node, glm::mat4 viewMatrix, glm::mat4 projection) {
-    glm::mat4 currentMVPMatrix;
-    currentMVPMatrix = projection * viewMatrix * node->currentModelMatrix;
-    
-    // Calculate normal matrix and set matrix uniforms
-    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(node->currentModelMatrix)));
-    glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(node->currentModelMatrix));
-    glUniformMatrix4fv(4, 1, GL_FALSE, glm::value_ptr(currentMVPMatrix));
-    glUniformMatrix3fv(5, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    // The terrain picks its own chunks, with the levels updateFrame() chose from the viewer's camera
+    if (terrainStreamer) {
+        terrainStreamer->selectTiles(frustum);
+    } else {
+        selectTerrainChunks(terrainMesh.lod, cameraPos, frustum);
+    }
+    frameStats.cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-    if (node->nodeType == SKYBOX) {
-        glDepthFunc(GL_LEQUAL);  // Ensure skybox is drawn in the background
-        glDepthMask(GL_FALSE);   // Disable depth writing
-        glUniform1i(glGetUniformLocation(shader->get(), "isSkybox"), 1);
+    // The shadow map sees the terrain from above, where it hides little, so only the main pass is tested
+    if (pass == MAIN_PASS && occlusionCullingEnabled) {
+        occludeScene(viewProjection);
+    }
+}
 
-        glBindVertexArray(node->vertexArrayObjectID);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, node->textureID);
-        glUniform1i(glGetUniformLocation(shader->get(), "skybox"), 3);
+// Nodes without bounds (lights, the skybox, the streamed terrain) are never culled
+bool nodeInView(const SceneNode* node) {
+    int proxy = sceneStore.bvhProxies[node->transformIndex];
+    return proxy < 0 || proxyVisible[proxy];
+}
 
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+// Turns a node in view into a packet for renderQueue
+void collectPacket(SceneNode* node, const glm::mat4& viewMatrix, const glm::mat4& projection) {
+    RenderPacket packet;
+    packet.node = node;
+    packet.modelMatrix = node->currentModelMatrix();
+    // The boat casts its shadow from higher up, the node itself stays where it is
+    if (currentPass == SHADOW_PASS && node == boatNode) {
+        packet.modelMatrix = glm::translate(SHADOW_BOAT_LIFT) * packet.modelMatrix;
+    }
+    packet.textureID = node->textureID;
+    packet.VAO = node->vertexArrayObjectID;
+    packet.flags = node->flags;
+    packet.lodLevel = 0;
+    packet.firstIndex = 0;
+    packet.indexCount = node->VAOIndexCount;
+    const AABB& bounds = node->worldBounds();
+    glm::vec3 center = bounds.empty() ? glm::vec3(packet.modelMatrix[3]) : bounds.center();
+    packet.depth = -(viewMatrix * glm::vec4(center, 1.0f)).z;
 
-        glUniform1i(glGetUniformLocation(shader->get(), "isSkybox"), 0);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
+    if (node->nodeType == SKYBOX) {
+        packet.layer = LAYER_SKY;
+        packet.variant = VARIANT_SKYBOX;
+    } else if (node == terrainNode) {
+        packet.layer = LAYER_OPAQUE;
+        packet.variant = VARIANT_TERRAIN;
+    } else if (node->flags & NODE_WATER) {
+        packet.layer = LAYER_TRANSPARENT;
+        packet.variant = VARIANT_WATER;
+    } else if (node->lodSet && !node->lodSet->levels.empty()) {
+        packet.layer = LAYER_OPAQUE;
+        packet.variant = VARIANT_INSTANCED;
+        packet.lodLevel = selectNodeLOD(node, projection * viewMatrix * packet.modelMatrix, projection);
+        packet.firstIndex = node->lodSet->levels[packet.lodLevel].firstIndex;
+        packet.indexCount = node->lodSet->levels[packet.lodLevel].indexCount;
+    } else {
+        packet.layer = LAYER_OPAQUE;
+        packet.variant = VARIANT_MESH;
+    }
+    if (node->nodeType == GEOMETRY) frameStats.nodesDrawn[currentPass]++;
+    renderQueue.push(packet);
+}
 
+// Walks the scene graph and queues what is in view. Nothing is drawn, and the graph is only read.
+void collectNode(SceneNode* node, const glm::mat4& viewMatrix, const glm::mat4& projection) {
+    // The bounds only cover the node's own mesh, so the children are still visited
+    if (!nodeInView(node)) {
+        frameStats.nodesCulled[currentPass]++;
+    } else if (node->nodeType == GEOMETRY || node->nodeType == SKYBOX) {
+        collectPacket(node, viewMatrix, projection);
+    } else if (node->nodeType == DIRECTIONAL_LIGHT) {
+        // Only uniforms, which are in place before anything of the pass is drawn
+        glState.useProgram(shader->get());
+
+        glState.setUniform("dirLight.direction", node->lightDirection);
+        glState.setUniform("dirLight.ambient", node->lightColor * 0.2f);
+        glState.setUniform("dirLight.diffuse", node->lightColor * 0.2f);
+        glState.setUniform("dirLight.specular", glm::vec3(0.1f));
+        glState.setUniform("dirLight.color", node->lightColor * 0.2f);
     }
 
-    if (node->nodeType == GEOMETRY) {
-
-        glUseProgram(shader->get());
-        glUniform1i(glGetUniformLocation(shader->get(), "isSkybox"), 0);
-        glUniform3fv(glGetUniformLocation(shader->get(), "boatWorldPosition"), 1, glm::value_ptr(boatNode->position));
-        glUniform1i(glGetUniformLocation(shader->get(), "isGeometry"), 1);
-        int isTree = (std::find(treeNodes.begin(), treeNodes.end(), node) != treeNodes.end()) ? 1 : 0;
-        if(node == tree1Node) isTree = 1;
-        glUniform1i(glGetUniformLocation(shader->get(), "isTree"), isTree);
-        int isWater = (node == waterNode) ? 1 : 0;
-        glUniform1i(glGetUniformLocation(shader->get(), "isWater"), isWater);
-        int isBoat = (node == boatNode) ? 1 : 0;
-        glUniform1i(glGetUniformLocation(shader->get(), "isBoat"), isBoat);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, node->textureID);
-        glUniform1i(glGetUniformLocation(shader->get(), "Texture"), 0);
-        
-        glBindVertexArray(node->vertexArrayObjectID);
-        glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, 0);
-        glUniform1i(glGetUniformLocation(shader->get(), "isGeometry"), 0);
-        glUniform1i(glGetUniformLocation(shader->get(), "isTree"), 0);
-        glUniform1i(glGetUniformLocation(shader->get(), "isWater"), 0);
+    for (SceneNode* child : node->children) {
+        collectNode(child, viewMatrix, projection);
     }
+}
 
+void drawSkybox(const RenderPacket& packet, const glm::mat4& viewProjection) {
+    glState.setUniform(4, viewProjection * packet.modelMatrix);
+    glState.setDepthFunc(GL_LEQUAL);  // Ensure skybox is drawn in the background
+    glState.setDepthMask(false);   // Disable depth writing
+    // The sky sets every flag the shaders test before isSkybox itself, nothing is inherited from the runs
+    // drawn before it or from the pass setup. simple.frag tests isWater and isGeometry first.
+    glState.setUniform("isSkybox", 1);
+    glState.setUniform("isGeometry", 0);
+    glState.setUniform("instanced", 0);
+    glState.setUniform("isWater", 0);
+    glState.setUniform("isTree", 0);
+    glState.setUniform("isBoat", 0);
+
+    glState.bindVertexArray(packet.VAO);
+    glState.bindTexture(3, GL_TEXTURE_CUBE_MAP, packet.textureID);
+    glState.setUniform("skybox", 3);
+
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+}
 
-    if (node->nodeType == DIRECTIONAL_LIGHT) {
-        glUseProgram(shader->get());
+// Draws one run of the sorted queue: an instanced mesh with all its instances, or a single node
+void drawGeometry(const RenderQueue::Run& run, const glm::mat4& viewProjection) {
+    const RenderPacket& packet = renderQueue.sorted(run.first);
+    bool instanced = packet.variant == VARIANT_INSTANCED;
+    if (!instanced) {
+        // Calculate normal matrix and set matrix uniforms
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(packet.modelMatrix)));
+        glState.setUniform(3, packet.modelMatrix);
+        glState.setUniform(4, viewProjection * packet.modelMatrix);
+        glState.setUniform(5, normalMatrix);
+    }
 
-        glUniform3fv(glGetUniformLocation(shader->get(), "dirLight.direction"), 1, glm::value_ptr(node->lightDirection));
-        glUniform3fv(glGetUniformLocation(shader->get(), "dirLight.ambient"), 1, glm::value_ptr(node->lightColor * 0.2f));
-        glUniform3fv(glGetUniformLocation(shader->get(), "dirLight.diffuse"), 1, glm::value_ptr(node->lightColor * 0.2f));
-        glUniform3fv(glGetUniformLocation(shader->get(), "dirLight.specular"), 1, glm::value_ptr(glm::vec3(0.1f)));
-        glUniform3fv(glGetUniformLocation(shader->get(), "dirLight.color"), 1, glm::value_ptr(node->lightColor * 0.2f));
+    // Every run sets all the state it depends on, the cache drops what is already in place
+    glState.setDepthFunc(GL_LESS);
+    glState.setDepthMask(true);
+    glState.setUniform("isSkybox", 0);
+    glState.setUniform("isGeometry", 1);
+    glState.setUniform("instanced", instanced ? 1 : 0);
+    glState.setUniform("isTree", (packet.flags & NODE_TREE) ? 1 : 0);
+    glState.setUniform("isWater", (packet.flags & NODE_WATER) ? 1 : 0);
+    glState.setUniform("isBoat", (packet.flags & NODE_BOAT) ? 1 : 0);
+
+    glState.bindTexture(0, GL_TEXTURE_2D, packet.textureID);
+
+    const VertexQuantization& quantization = packet.node->vertexQuantization;
+    glState.setUniform("compactVertices", quantization.compact ? 1 : 0);
+    glState.setUniform("positionOffset", quantization.offset);
+    glState.setUniform("positionScale", quantization.scale);
+
+    glState.bindVertexArray(packet.VAO);
+    if (packet.variant == VARIANT_TERRAIN && terrainStreamer) {
+        countTerrainDraw(currentPass, terrainStreamer->selectedTileCount(), terrainStreamer->selectedTriangles(),
+                         terrainStreamer->selectedFullDetailTriangles());
+        terrainStreamer->draw();
+    } else if (packet.variant == VARIANT_TERRAIN) {
+        const TerrainLOD& lod = terrainMesh.lod;
+        countTerrainDraw(currentPass, (unsigned int)lod.selectedChunks.size(), lod.selectedTriangles,
+                         lod.selectedFullDetailTriangles);
+        drawTerrainLOD(lod);
+    } else if (instanced) {
+        frameStats.drawCalls++;
+        frameStats.instanceBatches++;
+        frameStats.instancedNodes += run.count;
+        drawInstances(packet.firstIndex, packet.indexCount, run.count, run.firstInstance);
+    } else {
+        frameStats.drawCalls++;
+        frameStats.triangles += packet.indexCount / 3;
+        glDrawElements(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, 0);
     }
+}
 
-    for(SceneNode* child : node->children) {
-        renderNode(child, viewMatrix, projection);
+// Sorts what collectNode() queued and draws it
+void drawRenderQueue(const glm::mat4& viewMatrix, const glm::mat4& projection) {
+    renderQueue.sort();
+    uploadInstanceMatrices(renderQueue.instanceMatrices());
+
+    glm::mat4 viewProjection = projection * viewMatrix;
+    glState.setDepthTest(true);
+    glState.setBlend(true);
+    glState.setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState.useProgram(shader->get());
+    glState.setUniform("viewProjection", viewProjection);
+    glState.setUniform("boatWorldPosition", boatNode->position());
+    glState.setUniform("Texture", 0);
+
+    for (const RenderQueue::Run& run : renderQueue.runs()) {
+        const RenderPacket& packet = renderQueue.sorted(run.first);
+        if (packet.variant == VARIANT_SKYBOX) {
+            drawSkybox(packet, viewProjection);
+        } else {
+            drawGeometry(run, viewProjection);
+        }
     }
+
+    // glClear() only clears the depth buffer while depth writes are on, the skybox may have been drawn last
+    glState.setDepthMask(true);
+    glState.setDepthFunc(GL_LESS);
 }
 
 void renderShadowMap() {
     // Set the viewport to the shadow map's resolution
     glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+    viewportHeight = SHADOW_HEIGHT;
 
     // Bind the framebuffer used for rendering the depth map
     glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
@@ -970,40 +1007,27 @@ void renderShadowMap() {
     glm::mat4 lightSpaceMatrix = lightProjection * lightView;
 
     // Send the light-space matrix to the shader
-    shader->activate();
-    glUniformMatrix4fv(
-        glGetUniformLocation(shader->get(), "lightSpaceMatrix"),
-        1, GL_FALSE, glm::value_ptr(lightSpaceMatrix)
-    );
+    glState.useProgram(shader->get());
+    glState.setUniform("lightSpaceMatrix", lightSpaceMatrix);
 
     renderingShadowMap = true;
 
-    // Midlertidig løft båten
-    float originalY = boatNode->position.y;
-    boatNode->position.y
-     += 30.0f;
-    
-    // Oppdater transformasjoner
-    updateNodeTransformations(rootNode, glm::mat4(1.0f));
-    renderNode(tree1Node, lightView, lightProjection);
+    cullScene(SHADOW_PASS, lightSpaceMatrix);
+    renderQueue.begin(SHADOW_PASS, RENDER_FAR_DEPTH);
+    collectNode(tree1Node, lightView, lightProjection);
     for(SceneNode* fish : fishNodes) {
-        renderNode(fish, lightView, lightProjection);
+        collectNode(fish, lightView, lightProjection);
     }
-    // Render alt med opphevet båt
-    renderNode(boatNode, lightView, lightProjection);
+    // The boat is queued with its shadow lift, see SHADOW_BOAT_LIFT
+    collectNode(boatNode, lightView, lightProjection);
 
     for (SceneNode* tree : treeNodes){
-        renderNode(tree, lightView, lightProjection);
+        collectNode(tree, lightView, lightProjection);
     }
-    renderNode(terrainNode, lightView, lightProjection);
-    
-    // Tilbakestill båtens posisjon
-    boatNode->position.y = originalY;
+    collectNode(terrainNode, lightView, lightProjection);
+    drawRenderQueue(lightView, lightProjection);
     renderingShadowMap = false;
     
-    // Oppdater transformasjoner igjen etterpå
-    updateNodeTransformations(rootNode, glm::mat4(1.0f));
-    
     // Unbind the framebuffer
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -1018,16 +1042,17 @@ void renderFrame(GLFWwindow* window) {
     glfwGetWindowSize(window, &windowWidth, &windowHeight);
 
     //Pass elapsed time to shader for animations of water
-    glUniform1f(glGetUniformLocation(shader->get(), "time"), glfwGetTime());
+    glState.useProgram(shader->get());
+    glState.setUniform("time", (float)glfwGetTime());
 
     //first render shadow map. This renders the scene from the light's perspective into a depth texture
     renderShadowMap();
+    viewportHeight = windowHeight;
 
     //Bind the shadow map texture
-    shader->activate();
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glUniform1i(glGetUniformLocation(shader->get(), "shadowMap"), 1);
+    glState.useProgram(shader->get());
+    glState.bindTexture(1, GL_TEXTURE_2D, depthMap);
+    glState.setUniform("shadowMap", 1);
 
     //Create camera projection and view matrix
     glm::mat4 projection = glm::perspective(
@@ -1041,17 +1066,20 @@ void renderFrame(GLFWwindow* window) {
         cameraPos + cameraFront, // Target (what camera is looking at)
         cameraUp             // Up direction
     );
-    //Sort scene nodes to render water last. Needed this to make the water transparent and see the terrain beneath
-    std::sort(rootNode->children.begin(), rootNode->children.end(), 
-        [](SceneNode* a, SceneNode* b) { 
-            return a != waterNode && b == waterNode;
-        }
-    );
+    cullScene(MAIN_PASS, projection * viewMatrix);
 
-    //Render each node in the scene graph
+    //Collect each node in the scene graph, then draw them sorted. The render queue puts the water last.
+    renderQueue.begin(MAIN_PASS, RENDER_FAR_DEPTH);
     for (SceneNode* child : rootNode->children) {
-            renderNode(child, viewMatrix, projection);
-        
+        collectNode(child, viewMatrix, projection);
+    }
+    drawRenderQueue(viewMatrix, projection);
+
+    frameStats.glCallsIssued = glState.callsIssued();
+    frameStats.glCallsSkipped = glState.callsSkipped();
+    if (checkGLState) {
+        frameStats.glStateMismatches = glState.verify();
     }
+    endFrameStats();
 }
 
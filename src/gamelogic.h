@@ -3,8 +3,8 @@
 #include <utilities/window.hpp>
 #include "sceneGraph.hpp"
 
-void updateNodeTransformations(SceneNode* node, glm::mat4 currentModelMatrix);
-void initGame(GLFWwindow* window);
+void updateNodeTransformations();
+void initGame(GLFWwindow* window, CommandLineOptions options);
 void updateFrame(GLFWwindow* window);
 void renderFrame(GLFWwindow* window);
 struct Heightmap {
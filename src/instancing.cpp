@@ -0,0 +1,40 @@
+#include "instancing.hpp"
+#include <glad/glad.h>
+
+namespace {
+
+// Grows but never shrinks, the VAOs keep pointing at the same buffer name
+unsigned int instanceBuffer = 0;
+size_t instanceBufferCapacity = 0;
+
+unsigned int sharedInstanceBuffer() {
+    if (instanceBuffer == 0) glGenBuffers(1, &instanceBuffer);
+    return instanceBuffer;
+}
+
+} // namespace
+
+void setInstanceAttributes() {
+    glBindBuffer(GL_ARRAY_BUFFER, sharedInstanceBuffer());
+    for (unsigned int column = 0; column < 4; column++) {
+        unsigned int location = INSTANCE_MATRIX_LOCATION + column;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+void uploadInstanceMatrices(const std::vector<glm::mat4>& matrices) {
+    if (matrices.empty()) return;
+    size_t bytes = matrices.size() * sizeof(glm::mat4);
+    glBindBuffer(GL_ARRAY_BUFFER, sharedInstanceBuffer());
+    // Orphan last pass's storage, so the driver does not wait for the draws that still read it
+    if (bytes > instanceBufferCapacity) instanceBufferCapacity = bytes;
+    glBufferData(GL_ARRAY_BUFFER, instanceBufferCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, matrices.data());
+}
+
+void drawInstances(unsigned int firstIndex, unsigned int indexCount, unsigned int instanceCount, unsigned int firstInstance) {
+    glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)(firstIndex * sizeof(unsigned int)),
+                                        instanceCount, firstInstance);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// The per-instance model matrix takes the four attribute locations from here, one column each
+// (see res/shaders/simple.vert)
+const unsigned int INSTANCE_MATRIX_LOCATION = 9;
+
+// Points the instance matrix attributes of the bound VAO at the shared instance buffer.
+// Every VAO that is drawn through drawInstances() needs this once.
+void setInstanceAttributes();
+
+// Replaces the contents of the shared instance buffer
+void uploadInstanceMatrices(const std::vector<glm::mat4>& matrices);
+
+// One instanced draw of an index range of the bound VAO, taking the matrices from firstInstance on
+void drawInstances(unsigned int firstIndex, unsigned int indexCount, unsigned int instanceCount, unsigned int firstInstance);
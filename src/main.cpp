@@ -1,12 +1,15 @@
 // Local headers
 #include "utilities/window.hpp"
 #include "program.hpp"
+#include "benchmarks.hpp"
+#include "utilities/threadPool.hpp"
 
 // System headers
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 // Standard headers
+#include <algorithm>
 #include <cstdlib>
 #include <arrrgh.hpp>
 
@@ -70,6 +73,12 @@ int main(int argc, const char* argb[])
     const auto& showHelp       = parser.add<bool>("help", "Show this help message.", 'h', arrrgh::Optional, false);
     const auto& enableMusic    = parser.add<bool>("enable-music", "Play background music while the game is playing", 'm', arrrgh::Optional, false);
     const auto& enableAutoplay = parser.add<bool>("autoplay", "Let the game play itself automatically. Useful for testing.", 'a', arrrgh::Optional, false);
+    const auto& benchmark      = parser.add<std::string>("benchmark", "Run a CPU benchmark by name (or 'all') and exit without opening a window.", 'b', arrrgh::Optional, "");
+    const auto& workerThreads  = parser.add<int>("threads", "Number of worker threads used for terrain generation. 0 uses every core.", 't', arrrgh::Optional, 0);
+    const auto& streamTerrain  = parser.add<bool>("stream-terrain", "Stream endless terrain tiles around the camera instead of the fixed 1000x1000 terrain.", 's', arrrgh::Optional, false);
+    const auto& compactVertices = parser.add<bool>("compact-vertices", "Store mesh vertices in a 16 byte quantized format instead of 32 bytes of floats.", 'c', arrrgh::Optional, false);
+    const auto& noOcclusion    = parser.add<bool>("no-occlusion", "Do not test nodes against the terrain in the CPU occlusion buffer before drawing them.", 'o', arrrgh::Optional, false);
+    const auto& checkGLState   = parser.add<bool>("check-gl-state", "Read the GL state back every frame and report where the state cache is wrong. Slow, meant for testing, e.g. under Mesa's llvmpipe with LIBGL_ALWAYS_SOFTWARE=1.", 'g', arrrgh::Optional, false);
 
     // If you want to add more program arguments, define them here,
     // but do not request their value here (they have not been parsed yet at this point).
@@ -91,11 +100,26 @@ int main(int argc, const char* argb[])
         return 0;
     }
 
+    if(!benchmark.value().empty())
+    {
+        setWorkerThreadCount(std::max(workerThreads.value(), 0));
+        return runBenchmark(benchmark.value());
+    }
+
+    CommandLineOptions options;
+    options.enableMusic    = enableMusic.value();
+    options.enableAutoplay = enableAutoplay.value();
+    options.workerThreads  = workerThreads.value();
+    options.streamTerrain  = streamTerrain.value();
+    options.compactVertices = compactVertices.value();
+    options.occlusionCulling = !noOcclusion.value();
+    options.checkGLState   = checkGLState.value();
+
     // Initialise window using GLFW
     GLFWwindow* window = initialise();
 
     // Run an OpenGL application using this window
-    runProgram(window);
+    runProgram(window, options);
 
     // Terminate GLFW (no need to call glfwDestroyWindow)
     glfwTerminate();
@@ -0,0 +1,280 @@
+#include "occlusionCulling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "utilities/threadPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Corners closer to the camera than this in clip space w are clipped away
+const float NEAR_W = 1e-3f;
+
+// The clip planes a triangle is clipped against, as coefficients of (x, y, z, w). The far plane is left out,
+// occluders behind it end up deeper than the cleared buffer and change nothing.
+const glm::vec4 CLIP_PLANES[5] = {
+    glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),    // near
+    glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),    // left
+    glm::vec4(-1.0f, 0.0f, 0.0f, 1.0f),   // right
+    glm::vec4(0.0f, 1.0f, 0.0f, 1.0f),    // bottom
+    glm::vec4(0.0f, -1.0f, 0.0f, 1.0f),   // top
+};
+
+float planeDistance(const glm::vec4& plane, const glm::vec4& point) {
+    return plane.x * point.x + plane.y * point.y + plane.z * point.z + plane.w * point.w;
+}
+
+} // namespace
+
+OcclusionBuffer::OcclusionBuffer() : depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f), viewProjection(1.0f) {}
+
+void OcclusionBuffer::render(const std::vector<OccluderMesh>& occluders, const glm::mat4& newViewProjection, ThreadPool& pool) {
+    viewProjection = newViewProjection;
+    Frustum frustum = frustumFromMatrix(viewProjection);
+
+    // Each occluder is set up into its own list, so the threads never share one
+    occluderTriangles.resize(occluders.size());
+    pool.parallelFor(0, (int)occluders.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            occluderTriangles[i].clear();
+            setupOccluder(occluders[i], frustum, occluderTriangles[i]);
+        }
+    });
+    drawnTriangles = 0;
+    for (const std::vector<ScreenTriangle>& triangles : occluderTriangles) {
+        drawnTriangles += (unsigned int)triangles.size();
+    }
+
+    int bandCount = (OCCLUSION_HEIGHT + OCCLUSION_BAND_ROWS - 1) / OCCLUSION_BAND_ROWS;
+    pool.parallelFor(0, bandCount, [&](int begin, int end) {
+        for (int band = begin; band < end; band++) {
+            rasterizeBand(band * OCCLUSION_BAND_ROWS, std::min((band + 1) * OCCLUSION_BAND_ROWS, OCCLUSION_HEIGHT));
+        }
+    });
+}
+
+void OcclusionBuffer::setupOccluder(const OccluderMesh& occluder, const Frustum& frustum, std::vector<ScreenTriangle>& out) const {
+    if (!frustumOverlaps(frustum, occluder.bounds)) return;
+    for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3) {
+        glm::vec4 clip[3];
+        for (int corner = 0; corner < 3; corner++) {
+            clip[corner] = viewProjection * glm::vec4(occluder.positions[occluder.indices[i + corner]], 1.0f);
+        }
+        addTriangle(clip, out);
+    }
+}
+
+void OcclusionBuffer::addTriangle(const glm::vec4* clip, std::vector<ScreenTriangle>& out) const {
+    // Triangles completely outside one plane are dropped, the ones that cross a plane are clipped against it
+    unsigned int crossed = 0;
+    for (int plane = 0; plane < 5; plane++) {
+        int outside = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            if (planeDistance(CLIP_PLANES[plane], clip[corner]) < 0.0f) outside++;
+        }
+        if (outside == 3) return;
+        if (outside > 0) crossed |= 1u << plane;
+    }
+
+    // Clipping a triangle against five planes leaves at most eight corners
+    glm::vec4 polygon[8];
+    glm::vec4 clipped[8];
+    int count = 3;
+    std::copy(clip, clip + 3, polygon);
+    for (int plane = 0; plane < 5 && count >= 3; plane++) {
+        if (!(crossed & (1u << plane))) continue;
+        int clippedCount = 0;
+        for (int i = 0; i < count; i++) {
+            const glm::vec4& a = polygon[i];
+            const glm::vec4& b = polygon[(i + 1) % count];
+            float distanceA = planeDistance(CLIP_PLANES[plane], a);
+            float distanceB = planeDistance(CLIP_PLANES[plane], b);
+            if (distanceA >= 0.0f) clipped[clippedCount++] = a;
+            if ((distanceA >= 0.0f) != (distanceB >= 0.0f)) {
+                float t = distanceA / (distanceA - distanceB);
+                clipped[clippedCount++] = a + (b - a) * t;
+            }
+        }
+        count = clippedCount;
+        std::copy(clipped, clipped + count, polygon);
+    }
+    if (count < 3) return;
+
+    // Pixel coordinates, y up, and depth in [0, 1]
+    glm::vec3 screen[8];
+    for (int i = 0; i < count; i++) {
+        float inverseW = 1.0f / std::max(polygon[i].w, NEAR_W);
+        screen[i] = glm::vec3((polygon[i].x * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+                              (polygon[i].y * inverseW * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+                              polygon[i].z * inverseW * 0.5f + 0.5f);
+    }
+
+    // The polygon is convex, so a fan from the first corner covers it
+    for (int i = 1; i + 1 < count; i++) {
+        const glm::vec3* v[3] = {&screen[0], &screen[i], &screen[i + 1]};
+        float area = (v[1]->x - v[0]->x) * (v[2]->y - v[0]->y) - (v[1]->y - v[0]->y) * (v[2]->x - v[0]->x);
+        if (std::fabs(area) < 1e-6f) continue;
+
+        ScreenTriangle triangle;
+        // Edge e runs from corner e + 1 to corner e + 2 and is positive on the side of corner e, whichever
+        // way the triangle winds
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        for (int edge = 0; edge < 3; edge++) {
+            const glm::vec3& from = *v[(edge + 1) % 3];
+            const glm::vec3& to = *v[(edge + 2) % 3];
+            triangle.edgeA[edge] = -(to.y - from.y) * sign;
+            triangle.edgeB[edge] = (to.x - from.x) * sign;
+            triangle.edgeC[edge] = -(triangle.edgeA[edge] * from.x + triangle.edgeB[edge] * from.y);
+        }
+        // The edge functions divided by the area are the barycentric coordinates, which weigh the depths
+        float inverseArea = 1.0f / std::fabs(area);
+        triangle.depthA = triangle.depthB = triangle.depthC = 0.0f;
+        for (int corner = 0; corner < 3; corner++) {
+            float z = v[corner]->z * inverseArea;
+            triangle.depthA += triangle.edgeA[corner] * z;
+            triangle.depthB += triangle.edgeB[corner] * z;
+            triangle.depthC += triangle.edgeC[corner] * z;
+        }
+
+        float minX = std::min(v[0]->x, std::min(v[1]->x, v[2]->x));
+        float maxX = std::max(v[0]->x, std::max(v[1]->x, v[2]->x));
+        float minY = std::min(v[0]->y, std::min(v[1]->y, v[2]->y));
+        float maxY = std::max(v[0]->y, std::max(v[1]->y, v[2]->y));
+        // Pixels whose centers can be inside, rounded out to whole groups of four in x
+        triangle.minX = std::max((int)std::floor(minX - 0.5f), 0) & ~3;
+        triangle.maxX = std::min((int)std::ceil(maxX - 0.5f), OCCLUSION_WIDTH - 1);
+        triangle.minY = std::max((int)std::floor(minY - 0.5f), 0);
+        triangle.maxY = std::min((int)std::ceil(maxY - 0.5f), OCCLUSION_HEIGHT - 1);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) continue;
+        out.push_back(triangle);
+    }
+}
+
+void OcclusionBuffer::rasterizeBand(int rowBegin, int rowEnd) {
+    std::fill(depth.begin() + rowBegin * OCCLUSION_WIDTH, depth.begin() + rowEnd * OCCLUSION_WIDTH, 1.0f);
+
+    for (const std::vector<ScreenTriangle>& triangles : occluderTriangles) {
+        for (const ScreenTriangle& triangle : triangles) {
+            int yBegin = std::max(triangle.minY, rowBegin);
+            int yEnd = std::min(triangle.maxY + 1, rowEnd);
+            for (int y = yBegin; y < yEnd; y++) {
+                float* row = &depth[y * OCCLUSION_WIDTH];
+                float centerY = y + 0.5f;
+#ifdef OCCLUSION_HAS_SSE2
+                __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+                __m128 edgeStep[3], edgeRow[3];
+                for (int edge = 0; edge < 3; edge++) {
+                    edgeStep[edge] = _mm_set1_ps(triangle.edgeA[edge] * 4.0f);
+                    edgeRow[edge] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edgeA[edge]),
+                                                          _mm_add_ps(_mm_set1_ps((float)triangle.minX), offsets)),
+                                               _mm_set1_ps(triangle.edgeB[edge] * centerY + triangle.edgeC[edge]));
+                }
+                __m128 depthStep = _mm_set1_ps(triangle.depthA * 4.0f);
+                __m128 depthRow = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.depthA),
+                                                        _mm_add_ps(_mm_set1_ps((float)triangle.minX), offsets)),
+                                             _mm_set1_ps(triangle.depthB * centerY + triangle.depthC));
+                for (int x = triangle.minX; x <= triangle.maxX; x += 4) {
+                    // A pixel is outside if the sign bit of any of its three edge functions is set
+                    __m128 signs = _mm_or_ps(_mm_or_ps(edgeRow[0], edgeRow[1]), edgeRow[2]);
+                    if (_mm_movemask_ps(signs) != 0xf) {
+                        __m128 outside = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(signs), 31));
+                        __m128 old = _mm_loadu_ps(row + x);
+                        __m128 nearer = _mm_min_ps(old, depthRow);
+                        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(outside, old), _mm_andnot_ps(outside, nearer)));
+                    }
+                    for (int edge = 0; edge < 3; edge++) edgeRow[edge] = _mm_add_ps(edgeRow[edge], edgeStep[edge]);
+                    depthRow = _mm_add_ps(depthRow, depthStep);
+                }
+#else
+                for (int x = triangle.minX; x <= triangle.maxX; x++) {
+                    float centerX = x + 0.5f;
+                    bool inside = true;
+                    for (int edge = 0; edge < 3; edge++) {
+                        inside = inside && triangle.edgeA[edge] * centerX + triangle.edgeB[edge] * centerY + triangle.edgeC[edge] >= 0.0f;
+                    }
+                    if (!inside) continue;
+                    float z = triangle.depthA * centerX + triangle.depthB * centerY + triangle.depthC;
+                    row[x] = std::min(row[x], z);
+                }
+#endif
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::isVisible(const AABB& box) const {
+    // Screen rectangle and nearest depth of the eight corners
+    float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f, nearest = 1e30f;
+    // The corners are the min corner plus any of the three edges, each transformed once
+    glm::vec4 minCorner = viewProjection * glm::vec4(box.min, 1.0f);
+    glm::vec3 size = box.max - box.min;
+    glm::vec4 edgeX = viewProjection[0] * size.x;
+    glm::vec4 edgeY = viewProjection[1] * size.y;
+    glm::vec4 edgeZ = viewProjection[2] * size.z;
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec4 clip = minCorner;
+        if (corner & 1) clip += edgeX;
+        if (corner & 2) clip += edgeY;
+        if (corner & 4) clip += edgeZ;
+        // Reaches behind the near plane, where the buffer knows nothing
+        if (clip.w < NEAR_W || clip.z < -clip.w) return true;
+        float inverseW = 1.0f / clip.w;
+        float x = (clip.x * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+        float y = (clip.y * inverseW * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip.z * inverseW * 0.5f + 0.5f);
+    }
+
+    int x0 = std::max((int)std::floor(minX) - 1, 0);
+    int x1 = std::min((int)std::floor(maxX) + 1, OCCLUSION_WIDTH - 1);
+    int y0 = std::max((int)std::floor(minY) - 1, 0);
+    int y1 = std::min((int)std::floor(maxY) + 1, OCCLUSION_HEIGHT - 1);
+    // Off screen, which is for the frustum test to decide
+    if (x0 > x1 || y0 > y1) return true;
+
+    for (int y = y0; y <= y1; y++) {
+        const float* row = &depth[y * OCCLUSION_WIDTH];
+        int x = x0;
+#ifdef OCCLUSION_HAS_SSE2
+        __m128 boxDepth = _mm_set1_ps(nearest);
+        for (; x + 3 <= x1; x += 4) {
+            if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(row + x), boxDepth))) return true;
+        }
+#endif
+        for (; x <= x1; x++) {
+            if (row[x] > nearest) return true;
+        }
+    }
+    return false;
+}
+
+bool OcclusionBuffer::writeImage(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Could not write the occlusion buffer to %s\n", path.c_str());
+        return false;
+    }
+    // Most of the depth range sits close to 1, so stretch what was drawn over the whole gray scale
+    float nearest = *std::min_element(depth.begin(), depth.end());
+    float range = std::max(1.0f - nearest, 1e-6f);
+    std::vector<unsigned char> pixels(depth.size());
+    for (int y = 0; y < OCCLUSION_HEIGHT; y++) {
+        // Image rows go from the top down
+        const float* row = &depth[(OCCLUSION_HEIGHT - 1 - y) * OCCLUSION_WIDTH];
+        for (int x = 0; x < OCCLUSION_WIDTH; x++) {
+            pixels[y * OCCLUSION_WIDTH + x] = (unsigned char)std::lround((row[x] - nearest) / range * 255.0f);
+        }
+    }
+    fprintf(file, "P5\n%d %d\n255\n", OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    bool written = fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+    fclose(file);
+    printf("Occlusion buffer written to %s\n", path.c_str());
+    return written;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "utilities/bounds.hpp"
+
+class ThreadPool;
+
+// Resolution of the occlusion buffer. The width must be a multiple of 4, one SSE register of pixels.
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+// Rows rasterized by one task
+const int OCCLUSION_BAND_ROWS = 8;
+
+// Triangles that hide whatever is behind them. They must never reach outside the real geometry they stand
+// for, or they would hide things that are visible.
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;   // world space
+    std::vector<unsigned int> indices;
+    AABB bounds;
+};
+
+// A small depth buffer that a few large occluders are drawn into on the CPU every frame, so the bounds of other
+// nodes can be tested against it before they are sent to the GPU. Occluders outside the frustum are skipped, the
+// rest are clipped and set up in parallel, and the rows are split into bands that are rasterized four pixels at a
+// time in parallel.
+//
+// The buffer stores depth in [0, 1] like the GL depth buffer, cleared to 1. A box is hidden if its nearest
+// point lies behind the buffer at every pixel of its screen rectangle, grown by one pixel so occluder edges
+// that only cover part of a pixel cannot hide anything.
+class OcclusionBuffer {
+public:
+    OcclusionBuffer();
+
+    // Clears the buffer and draws the occluders as seen through viewProjection
+    void render(const std::vector<OccluderMesh>& occluders, const glm::mat4& viewProjection, ThreadPool& pool);
+
+    // False if the box is certainly hidden behind the occluders of the last render(). Safe to call from
+    // several threads at once.
+    bool isVisible(const AABB& box) const;
+
+    // Writes the buffer as an 8 bit PGM image, near occluders dark and empty pixels white
+    bool writeImage(const std::string& path) const;
+
+    const float* depths() const { return depth.data(); }
+    unsigned int trianglesDrawn() const { return drawnTriangles; }
+
+    // Triangle set up for rasterizing: edge functions and depth as planes over the pixel centers
+    struct ScreenTriangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, maxX, minY, maxY;
+    };
+
+private:
+    void setupOccluder(const OccluderMesh& occluder, const Frustum& frustum, std::vector<ScreenTriangle>& out) const;
+    void addTriangle(const glm::vec4* clip, std::vector<ScreenTriangle>& out) const;
+    void rasterizeBand(int rowBegin, int rowEnd);
+
+    std::vector<float> depth;   // rows from the bottom of the screen up, like NDC
+    glm::mat4 viewProjection;
+    std::vector<std::vector<ScreenTriangle>> occluderTriangles;
+    unsigned int drawnTriangles = 0;
+};
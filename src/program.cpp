@@ -15,7 +15,7 @@
 #include <utilities/timeutils.h>
 
 
-void runProgram(GLFWwindow* window)
+void runProgram(GLFWwindow* window, CommandLineOptions options)
 {
     // Enable depth (Z) buffer (accept "closest" fragment)
     glEnable(GL_DEPTH_TEST);
@@ -34,7 +34,7 @@ void runProgram(GLFWwindow* window)
     // Set default colour after clearing the colour buffer
     glClearColor(0.3f, 0.5f, 0.8f, 1.0f);
 
-	initGame(window);
+	initGame(window, options);
 
     // Rendering Loop
     while (!glfwWindowShouldClose(window))
@@ -11,7 +11,7 @@
 
 
 // Main OpenGL program
-void runProgram(GLFWwindow* window);
+void runProgram(GLFWwindow* window, CommandLineOptions options);
 
 
 // Function for handling keypresses
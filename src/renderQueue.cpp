@@ -0,0 +1,100 @@
+#include "renderQueue.hpp"
+#include <algorithm>
+
+namespace {
+
+const int DEPTH_BITS = 24;
+const uint64_t DEPTH_MAX = (1ull << DEPTH_BITS) - 1;
+
+uint64_t quantizeDepth(float depth, float farDepth) {
+    float normalized = std::min(std::max(depth / farDepth, 0.0f), 1.0f);
+    return (uint64_t)(normalized * DEPTH_MAX);
+}
+
+// variant (3) | texture (10) | VAO (10) | material (4) | LOD (3), 30 bits
+uint64_t stateBits(const RenderPacket& packet) {
+    return ((uint64_t)(packet.variant & 0x7) << 27) | ((uint64_t)(packet.textureID & 0x3ff) << 17) |
+           ((uint64_t)(packet.VAO & 0x3ff) << 7) | ((uint64_t)(packet.flags & 0xf) << 3) | (uint64_t)(packet.lodLevel & 0x7);
+}
+
+bool sameInstancedMesh(const RenderPacket& a, const RenderPacket& b) {
+    return a.variant == VARIANT_INSTANCED && b.variant == VARIANT_INSTANCED && a.VAO == b.VAO &&
+           a.textureID == b.textureID && a.flags == b.flags && a.firstIndex == b.firstIndex && a.indexCount == b.indexCount;
+}
+
+} // namespace
+
+uint64_t renderSortKey(RenderPass pass, const RenderPacket& packet, float farDepth) {
+    uint64_t key = ((uint64_t)pass << 63) | ((uint64_t)packet.layer << 61);
+    uint64_t depth = quantizeDepth(packet.depth, farDepth);
+    if (packet.layer == LAYER_TRANSPARENT) {
+        return key | ((DEPTH_MAX - depth) << 37) | (stateBits(packet) << 7);
+    }
+    return key | (stateBits(packet) << 31) | depth;
+}
+
+void radixSortByKey(std::vector<SortItem>& items, std::vector<SortItem>& scratch) {
+    size_t count = items.size();
+    if (count < 2) return;
+    scratch.resize(count);
+
+    // Bytes that are the same in every key do not change the order
+    uint64_t first = items[0].key;
+    uint64_t differing = 0;
+    for (const SortItem& item : items) {
+        differing |= item.key ^ first;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differing >> shift) & 0xff) == 0) continue;
+        size_t offsets[256] = {};
+        for (const SortItem& item : items) {
+            offsets[(item.key >> shift) & 0xff]++;
+        }
+        size_t sum = 0;
+        for (size_t& offset : offsets) {
+            size_t bucket = offset;
+            offset = sum;
+            sum += bucket;
+        }
+        for (const SortItem& item : items) {
+            scratch[offsets[(item.key >> shift) & 0xff]++] = item;
+        }
+        items.swap(scratch);
+    }
+}
+
+void RenderQueue::begin(RenderPass newPass, float newFarDepth) {
+    pass = newPass;
+    farDepth = newFarDepth;
+    packets.clear();
+    order.clear();
+    runList.clear();
+    instances.clear();
+}
+
+void RenderQueue::push(const RenderPacket& packet) {
+    SortItem item;
+    item.key = renderSortKey(pass, packet, farDepth);
+    item.index = (unsigned int)packets.size();
+    order.push_back(item);
+    packets.push_back(packet);
+}
+
+void RenderQueue::sort() {
+    radixSortByKey(order, scratch);
+
+    for (unsigned int position = 0; position < order.size(); position++) {
+        const RenderPacket& packet = sorted(position);
+        if (!runList.empty() && sameInstancedMesh(sorted(runList.back().first), packet)) {
+            runList.back().count++;
+        } else {
+            Run run;
+            run.first = position;
+            run.count = 1;
+            run.firstInstance = (unsigned int)instances.size();
+            runList.push_back(run);
+        }
+        if (packet.variant == VARIANT_INSTANCED) instances.push_back(packet.modelMatrix);
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "frameStats.hpp"
+
+struct SceneNode;
+
+// Opaque packets are drawn first, front to back, then the sky behind them, then the blended ones back to front
+enum RenderLayer { LAYER_OPAQUE, LAYER_SKY, LAYER_TRANSPARENT };
+
+// Which path through the shaders a packet takes, and how it is drawn. Within the opaque layer the terrain comes
+// first, it covers most of the screen and lets the depth test throw away what is behind its hills.
+enum ShaderVariant { VARIANT_TERRAIN, VARIANT_INSTANCED, VARIANT_MESH, VARIANT_WATER, VARIANT_SKYBOX };
+
+// One thing to draw, collected from the scene graph before anything is drawn
+struct RenderPacket {
+    RenderLayer layer;
+    ShaderVariant variant;
+    unsigned int textureID;
+    unsigned int VAO;
+    unsigned int flags;         // NODE_TREE etc., the material
+    int lodLevel;               // 0 without levels of detail
+    unsigned int firstIndex;    // index range of the level of detail
+    unsigned int indexCount;
+    float depth;                // view distance of the center of the node's bounds
+    const SceneNode* node;
+    glm::mat4 modelMatrix;
+};
+
+// Packs a packet into a key that sorts it into drawing order:
+//
+//   opaque and sky:  pass (1) | layer (2) | variant (3) | texture (10) | VAO (10) | material (4) | LOD (3) | ... | depth (24)
+//   transparent:     pass (1) | layer (2) | far to near depth (24) | variant (3) | texture (10) | VAO (10) | material (4) | LOD (3)
+//
+// So opaque packets are grouped by state first and go front to back within a group, and transparent packets go
+// strictly back to front. Texture and VAO names are cut to their low 10 bits, which only costs some grouping if
+// two of them collide. Depth is quantized over [0, farDepth].
+uint64_t renderSortKey(RenderPass pass, const RenderPacket& packet, float farDepth);
+
+struct SortItem {
+    uint64_t key;
+    unsigned int index;
+};
+
+// Sorts items by key with an LSD radix sort, 8 bits at a time, skipping the bytes that are the same in every
+// key. Stable, so items with the same key keep their order. scratch is resized as needed.
+void radixSortByKey(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+
+// The packets of one pass. sort() orders them by their keys and merges neighbouring instanced packets with the
+// same mesh, level of detail, texture and material into runs drawn with one call, writing their model matrices
+// one run after the other for the instance buffer (see instancing.hpp).
+class RenderQueue {
+public:
+    // Consecutive packets in sorted order that are drawn together. Only instanced packets share a run.
+    struct Run {
+        unsigned int first;         // position in the sorted order
+        unsigned int count;
+        unsigned int firstInstance; // of the run's matrices in instanceMatrices()
+    };
+
+    void begin(RenderPass pass, float farDepth);
+    void push(const RenderPacket& packet);
+    void sort();
+
+    const std::vector<Run>& runs() const { return runList; }
+    const RenderPacket& sorted(unsigned int position) const { return packets[order[position].index]; }
+    const std::vector<glm::mat4>& instanceMatrices() const { return instances; }
+    size_t size() const { return packets.size(); }
+
+private:
+    RenderPass pass = MAIN_PASS;
+    float farDepth = 1.0f;
+    std::vector<RenderPacket> packets;
+    std::vector<SortItem> order;
+    std::vector<SortItem> scratch;
+    std::vector<Run> runList;
+    std::vector<glm::mat4> instances;
+};
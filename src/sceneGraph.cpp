@@ -1,14 +1,59 @@
 #include "sceneGraph.hpp"
+#include <algorithm>
 #include <iostream>
 
+SlabPool<SceneNode> sceneNodePool;
+
 SceneNode* createSceneNode() {
-	return new SceneNode();
+	SceneNodeHandle handle = sceneNodePool.create();
+	SceneNode* node = sceneNodePool.get(handle);
+	node->handle = handle;
+	node->transformIndex = sceneStore.add(node);
+	return node;
+}
+
+SceneNode* getSceneNode(SceneNodeHandle handle) {
+	return sceneNodePool.get(handle);
+}
+
+// Takes the node out of its parent's list of children
+static void detachFromParent(SceneNode* node) {
+	if (!node->parent) return;
+	std::vector<SceneNode*>& siblings = node->parent->children;
+	siblings.erase(std::find(siblings.begin(), siblings.end(), node));
+	node->parent = nullptr;
+}
+
+static void destroySubtree(SceneNode* node) {
+	for (SceneNode* child : node->children) {
+		destroySubtree(child);
+	}
+	sceneStore.remove(node->transformIndex);
+	sceneNodePool.destroy(node->handle);
+}
+
+void destroySceneNode(SceneNode* node) {
+	detachFromParent(node);
+	destroySubtree(node);
 }
 
 // Add a child node to its parent's list of children
 void addChild(SceneNode* parent, SceneNode* child) {
 	parent->children.push_back(child);
 	child->parent = parent;
+	sceneStore.setParent(child->transformIndex, parent->transformIndex);
+}
+
+bool reparentSceneNode(SceneNode* node, SceneNode* newParent) {
+	for (SceneNode* ancestor = newParent; ancestor; ancestor = ancestor->parent) {
+		if (ancestor == node) {
+			fprintf(stderr, "Cannot move a scene node below itself\n");
+			return false;
+		}
+	}
+	detachFromParent(node);
+	addChild(newParent, node);
+	return true;
 }
 
 int totalChildren(SceneNode* parent) {
@@ -30,9 +75,9 @@ void printNode(SceneNode* node) {
 		"    VAO ID: %i\n"
 		"}\n",
 		int(node->children.size()),
-		node->rotation.x, node->rotation.y, node->rotation.z,
-		node->position.x, node->position.y, node->position.z,
-		node->referencePoint.x, node->referencePoint.y, node->referencePoint.z, 
+		node->rotation().x, node->rotation().y, node->rotation().z,
+		node->position().x, node->position().y, node->position().z,
+		node->referencePoint().x, node->referencePoint().y, node->referencePoint().z, 
 		node->vertexArrayObjectID);
 }
 
@@ -13,21 +13,30 @@
 #include <chrono>
 #include <fstream>
 
+#include "utilities/compactVertex.hpp"
+#include "utilities/meshSimplifier.hpp"
+#include "sceneStore.hpp"
+#include "utilities/slabPool.hpp"
+
 enum SceneNodeType {
 	GEOMETRY, POINT_LIGHT, SPOT_LIGHT, GEOMETRY_2D, NORMAL_MAPPED, DISCOBALL, SKYBOX, DIRECTIONAL_LIGHT, WATER, GRASS, BOAT
 };
 
+// What a node is, for the shader and the passes that treat some kinds differently
+enum SceneNodeFlag {
+	NODE_TREE = 1 << 0, NODE_FISH = 1 << 1, NODE_BOAT = 1 << 2, NODE_WATER = 1 << 3
+};
+
 struct SceneNode {
 	SceneNode* parent;
 	SceneNode() {
 		parent = nullptr;
-		position = glm::vec3(0, 0, 0);
-		rotation = glm::vec3(0, 0, 0);
-		scale = glm::vec3(1, 1, 1);
+		transformIndex = 0;
 
-        referencePoint = glm::vec3(0, 0, 0);
         vertexArrayObjectID = -1;
         VAOIndexCount = 0;
+        lodSet = nullptr;
+        flags = 0;
 
         nodeType = GEOMETRY;
 
@@ -37,28 +46,47 @@ struct SceneNode {
 	// For instance, in case of the scene graph of a human body shown in the assignment text, the "Upper Torso" node would contain the "Left Arm", "Right Arm", "Head" and "Lower Torso" nodes in its list of children.
 	std::vector<SceneNode*> children;
 	
-	// The node's position and rotation relative to its parent
-	glm::vec3 position;
-	glm::vec3 rotation;
-	glm::vec3 scale;
-
-	// A transformation matrix representing the transformation of the node's location relative to its parent. This matrix is updated every frame.
-	//lm::mat4 currentTransformationMatrix;
-	glm::mat4 currentModelMatrix;
-	//glm::mat4 currentMVPMatrix;
+	// Nodes live in sceneNodePool and are made by createSceneNode(), which also registers them in the scene store
+	SceneNode(const SceneNode&) = delete;
+	SceneNode& operator=(const SceneNode&) = delete;
+
+	// Refers to this node in sceneNodePool, and stops doing so once the node is destroyed
+	PoolHandle handle;
+	// Slot of this node in sceneStore, see SceneStore
+	unsigned int transformIndex;
+
+	// The node's position and rotation relative to its parent. The setters mark the node for a matrix update.
+	const glm::vec3& position() const { return sceneStore.positions[transformIndex]; }
+	const glm::vec3& rotation() const { return sceneStore.rotations[transformIndex]; }
+	const glm::vec3& scale() const { return sceneStore.scales[transformIndex]; }
+	void setPosition(const glm::vec3& position) { sceneStore.setPosition(transformIndex, position); }
+	void setRotation(const glm::vec3& rotation) { sceneStore.setRotation(transformIndex, rotation); }
+	void setScale(const glm::vec3& scale) { sceneStore.setScale(transformIndex, scale); }
 
-	
+	// The location of the node's reference point
+	const glm::vec3& referencePoint() const { return sceneStore.referencePoints[transformIndex]; }
+	void setReferencePoint(const glm::vec3& point) { sceneStore.setReferencePoint(transformIndex, point); }
 
+	// The transformation of the node relative to the world, updated by sceneStore.updateWorldMatrices()
+	const glm::mat4& currentModelMatrix() const { return sceneStore.worldMatrices[transformIndex]; }
 
-	// The location of the node's reference point
-	glm::vec3 referencePoint;
+	// Box around the node's own mesh in its local space, left empty for nodes without one. Children are not included.
+	void setLocalBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) { sceneStore.setLocalBounds(transformIndex, AABB(boundsMin, boundsMax)); }
+	// The local bounds in world space, updated with the model matrix
+	const AABB& worldBounds() const { return sceneStore.worldBounds[transformIndex]; }
 
 	// The ID of the VAO containing the "appearance" of this SceneNode.
 	int vertexArrayObjectID;
 	unsigned int VAOIndexCount;
+	// How the positions in the VAO are stored, for meshes built with compact vertices
+	VertexQuantization vertexQuantization;
+	// Coarser versions of the mesh in the same index buffer, if it has any. VAOIndexCount is the full detail level.
+	const MeshLODSet* lodSet;
 
 	// Node type is used to determine how to handle the contents of a node
 	SceneNodeType nodeType;
+	// SceneNodeFlag bits
+	unsigned int flags;
 	//definer lyskilder
 	int lightID;
 	glm::vec3 lightColor;
@@ -75,8 +103,19 @@ struct SceneNode {
 	
 };
 
+typedef PoolHandle SceneNodeHandle;
+extern SlabPool<SceneNode> sceneNodePool;
+
+// A root node with an identity transform. Its address stays valid until it is destroyed.
 SceneNode* createSceneNode();
+// The node, or nullptr if it has been destroyed since the handle was taken
+SceneNode* getSceneNode(SceneNodeHandle handle);
+// Destroys the node and everything below it, and detaches it from its parent. Their slots are reused.
+void destroySceneNode(SceneNode* node);
 void addChild(SceneNode* parent, SceneNode* child);
+// Moves the node and everything below it to another parent, keeping its local transform. Fails if newParent
+// is the node itself or below it.
+bool reparentSceneNode(SceneNode* node, SceneNode* newParent);
 void printNode(SceneNode* node);
 int totalChildren(SceneNode* parent);
 
@@ -0,0 +1,210 @@
+#include "sceneStore.hpp"
+#include "sceneGraph.hpp"
+#include <algorithm>
+#include <atomic>
+#include "utilities/threadPool.hpp"
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/transform.hpp>
+
+SceneStore sceneStore;
+
+unsigned int SceneStore::add(SceneNode* node) {
+    positions.push_back(glm::vec3(0, 0, 0));
+    rotations.push_back(glm::vec3(0, 0, 0));
+    scales.push_back(glm::vec3(1, 1, 1));
+    referencePoints.push_back(glm::vec3(0, 0, 0));
+    localMatrices.push_back(glm::mat4(1.0f));
+    worldMatrices.push_back(glm::mat4(1.0f));
+    dirty.push_back(1);
+    parents.push_back(-1);
+    depths.push_back(0);
+    nodes.push_back(node);
+    localBounds.push_back(AABB());
+    worldBounds.push_back(AABB());
+    bvhProxies.push_back(-1);
+    hierarchyChanged = true;
+    return (unsigned int)(nodes.size() - 1);
+}
+
+void SceneStore::remove(unsigned int slot) {
+    if (bvhProxies[slot] >= 0) {
+        bvh.destroyProxy(bvhProxies[slot]);
+        bvhProxies[slot] = -1;
+    }
+    nodes[slot] = nullptr;
+    parents[slot] = -1;
+    hierarchyChanged = true;
+}
+
+void SceneStore::setParent(unsigned int slot, int parentSlot) {
+    parents[slot] = parentSlot;
+    dirty[slot] = 1;
+    hierarchyChanged = true;
+}
+
+glm::mat4 SceneStore::localMatrix(unsigned int slot) const {
+    const glm::vec3& position = positions[slot];
+    const glm::vec3& rotation = rotations[slot];
+    const glm::vec3& referencePoint = referencePoints[slot];
+    return glm::translate(position)                     // Position in world space
+         * glm::translate(referencePoint)               // Move to reference point
+         * glm::rotate(rotation.y, glm::vec3(0,1,0))    // Y-axis rotation
+         * glm::rotate(rotation.x, glm::vec3(1,0,0))    // X-axis rotation
+         * glm::rotate(rotation.z, glm::vec3(0,0,1))    // Z-axis rotation
+         * glm::scale(scales[slot])                     // Scaling
+         * glm::translate(-referencePoint);             // Move back from reference point
+}
+
+unsigned int SceneStore::updateRange(unsigned int begin, unsigned int end) {
+    unsigned int updated = 0;
+    for (unsigned int slot = begin; slot < end; slot++) {
+        int parent = parents[slot];
+        bool parentChanged = parent >= 0 && worldChanged[parent];
+        worldChanged[slot] = dirty[slot] || parentChanged;
+        if (!worldChanged[slot]) continue;
+
+        if (dirty[slot]) {
+            localMatrices[slot] = localMatrix(slot);
+            dirty[slot] = 0;
+        }
+        worldMatrices[slot] = parent < 0 ? localMatrices[slot] : worldMatrices[parent] * localMatrices[slot];
+        worldBounds[slot] = transformAABB(localBounds[slot], worldMatrices[slot]);
+        updated++;
+    }
+    return updated;
+}
+
+unsigned int SceneStore::updateWorldMatrices() {
+    if (hierarchyChanged) {
+        sortByDepth();
+    }
+    worldChanged.resize(size());
+    unsigned int updated = updateRange(0, (unsigned int)size());
+    updateBVH();
+    return updated;
+}
+
+unsigned int SceneStore::updateWorldMatrices(ThreadPool& pool) {
+    if (hierarchyChanged) {
+        sortByDepth();
+    }
+    worldChanged.resize(size());
+    unsigned int updated = 0;
+    for (size_t depth = 0; depth + 1 < depthBegin.size(); depth++) {
+        unsigned int begin = depthBegin[depth];
+        unsigned int end = depthBegin[depth + 1];
+        if (end - begin < PARALLEL_TRANSFORM_MIN_NODES || pool.size() == 1) {
+            updated += updateRange(begin, end);
+            continue;
+        }
+        std::atomic<unsigned int> levelUpdated(0);
+        pool.parallelFor((int)begin, (int)end, [&](int bandBegin, int bandEnd) {
+            levelUpdated += updateRange((unsigned int)bandBegin, (unsigned int)bandEnd);
+        });
+        updated += levelUpdated;
+    }
+    // The tree is shared, so it is refit on this thread once all the bounds are known
+    updateBVH();
+    return updated;
+}
+
+void SceneStore::updateBVH() {
+    for (unsigned int slot = 0; slot < size(); slot++) {
+        if (!worldChanged[slot]) continue;
+        int& proxy = bvhProxies[slot];
+        if (worldBounds[slot].empty()) {
+            if (proxy >= 0) bvh.destroyProxy(proxy);
+            proxy = -1;
+        } else if (proxy < 0) {
+            proxy = bvh.createProxy(worldBounds[slot], nodes[slot]);
+        } else {
+            bvh.moveProxy(proxy, worldBounds[slot]);
+        }
+    }
+}
+
+namespace {
+
+// Moves every value to newSlot[its slot] by following the cycles of the permutation, without a second array
+template <typename T>
+void permute(std::vector<T>& values, const std::vector<unsigned int>& newSlot, std::vector<unsigned char>& placed) {
+    placed.assign(values.size(), 0);
+    for (size_t start = 0; start < values.size(); start++) {
+        if (placed[start]) continue;
+        T carried = values[start];
+        size_t slot = start;
+        do {
+            slot = newSlot[slot];
+            std::swap(carried, values[slot]);
+            placed[slot] = 1;
+        } while (slot != start);
+    }
+}
+
+} // namespace
+
+void SceneStore::sortByDepth() {
+    // Parents may sit after their children until now, so walk up the chain for the depths
+    int maxDepth = 0;
+    for (unsigned int slot = 0; slot < size(); slot++) {
+        if (!nodes[slot]) continue;
+        int depth = 0;
+        for (int parent = parents[slot]; parent >= 0; parent = parents[parent]) {
+            depth++;
+        }
+        depths[slot] = depth;
+        maxDepth = std::max(maxDepth, depth);
+    }
+
+    // Counting sort keeps the nodes of one depth in the order they were added. Removed slots go last and are cut off.
+    int removedDepth = maxDepth + 1;
+    depthStart.assign(removedDepth + 2, 0);
+    for (unsigned int slot = 0; slot < size(); slot++) {
+        depthStart[(nodes[slot] ? depths[slot] : removedDepth) + 1]++;
+    }
+    for (int depth = 0; depth <= removedDepth; depth++) depthStart[depth + 1] += depthStart[depth];
+    unsigned int liveCount = depthStart[removedDepth];
+    depthBegin.assign(depthStart.begin(), depthStart.begin() + removedDepth + 1);
+    newSlot.resize(size());
+    for (unsigned int slot = 0; slot < size(); slot++) {
+        newSlot[slot] = depthStart[nodes[slot] ? depths[slot] : removedDepth]++;
+    }
+    for (unsigned int slot = 0; slot < size(); slot++) {
+        if (nodes[slot] && parents[slot] >= 0) parents[slot] = (int)newSlot[parents[slot]];
+    }
+
+    permute(positions, newSlot, placed);
+    permute(rotations, newSlot, placed);
+    permute(scales, newSlot, placed);
+    permute(referencePoints, newSlot, placed);
+    permute(localMatrices, newSlot, placed);
+    permute(worldMatrices, newSlot, placed);
+    permute(dirty, newSlot, placed);
+    permute(parents, newSlot, placed);
+    permute(depths, newSlot, placed);
+    permute(nodes, newSlot, placed);
+    permute(localBounds, newSlot, placed);
+    permute(worldBounds, newSlot, placed);
+    permute(bvhProxies, newSlot, placed);
+    resize(liveCount);
+    for (unsigned int slot = 0; slot < liveCount; slot++) {
+        nodes[slot]->transformIndex = slot;
+    }
+    hierarchyChanged = false;
+}
+
+void SceneStore::resize(size_t count) {
+    positions.resize(count);
+    rotations.resize(count);
+    scales.resize(count);
+    referencePoints.resize(count);
+    localMatrices.resize(count);
+    worldMatrices.resize(count);
+    dirty.resize(count);
+    parents.resize(count);
+    depths.resize(count);
+    nodes.resize(count);
+    localBounds.resize(count);
+    worldBounds.resize(count);
+    bvhProxies.resize(count);
+}
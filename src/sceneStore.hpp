@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "bvh.hpp"
+#include "utilities/bounds.hpp"
+
+struct SceneNode;
+class ThreadPool;
+
+// Depth levels with fewer nodes than this are updated on the calling thread
+const unsigned int PARALLEL_TRANSFORM_MIN_NODES = 4096;
+
+// The transforms of every scene node, as one array per field. The slots are kept sorted by their depth in the
+// hierarchy, so a parent always comes before its children and updating the world matrices is a single pass
+// from front to back over contiguous memory.
+//
+// A node's slot changes when the hierarchy changes. SceneNode::transformIndex always holds the current one.
+//
+// Only nodes whose local transform was written through the setters since the last update, and their
+// descendants, get their matrices recomputed. A static scene costs one flag check per node.
+//
+// The nodes of one depth only read the matrices of the depth above, so each depth can be split across threads.
+// Every matrix is computed the same way whichever thread does it, so the results do not depend on the pool.
+//
+// Nodes with local bounds get world bounds along with their world matrix, and a leaf in bvh that follows them.
+struct SceneStore {
+    // Local transform relative to the parent
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> rotations;       // radians, applied Y, then X, then Z
+    std::vector<glm::vec3> scales;
+    std::vector<glm::vec3> referencePoints; // rotation and scaling happen around this point
+
+    std::vector<glm::mat4> localMatrices;
+    std::vector<glm::mat4> worldMatrices;   // parent world matrix * local transform
+    std::vector<unsigned char> dirty;       // local transform changed since the last update
+    std::vector<int> parents;               // slot of the parent, or -1 for roots
+    std::vector<int> depths;                // 0 for roots
+    std::vector<SceneNode*> nodes;          // nullptr for removed nodes until the next update
+
+    std::vector<AABB> localBounds;          // around the node's mesh, empty for nodes without one
+    std::vector<AABB> worldBounds;          // localBounds moved by the world matrix
+    std::vector<int> bvhProxies;            // leaf in bvh, or -1 while the bounds are empty
+
+    // Every node with bounds, as of the last update
+    DynamicBVH bvh;
+
+    // Adds a root with an identity transform and returns its slot
+    unsigned int add(SceneNode* node);
+    // The slot is reused by the next update. Children must have been removed or moved to another parent first.
+    void remove(unsigned int slot);
+    // parentSlot -1 makes the node a root
+    void setParent(unsigned int slot, int parentSlot);
+
+    void setPosition(unsigned int slot, const glm::vec3& position) { positions[slot] = position; dirty[slot] = 1; }
+    void setRotation(unsigned int slot, const glm::vec3& rotation) { rotations[slot] = rotation; dirty[slot] = 1; }
+    void setScale(unsigned int slot, const glm::vec3& scale) { scales[slot] = scale; dirty[slot] = 1; }
+    void setReferencePoint(unsigned int slot, const glm::vec3& point) { referencePoints[slot] = point; dirty[slot] = 1; }
+    void setLocalBounds(unsigned int slot, const AABB& bounds) { localBounds[slot] = bounds; dirty[slot] = 1; }
+
+    // Sorts the slots again if the hierarchy changed, then recomputes the matrices of the dirty nodes and
+    // everything below them, and moves their leaves in bvh. Returns how many world matrices were recomputed.
+    unsigned int updateWorldMatrices();
+    // The same, with each large enough depth level split across the pool
+    unsigned int updateWorldMatrices(ThreadPool& pool);
+
+    glm::mat4 localMatrix(unsigned int slot) const;
+    size_t size() const { return nodes.size(); }
+
+private:
+    void sortByDepth();
+    void resize(size_t count);
+    unsigned int updateRange(unsigned int begin, unsigned int end);
+    void updateBVH();
+    bool hierarchyChanged = false;
+
+    // Scratch space kept between updates, so adding and removing nodes does not allocate once it has grown
+    std::vector<unsigned char> worldChanged;
+    std::vector<unsigned int> depthBegin;     // first slot of every depth, and size() at the end
+    std::vector<unsigned int> depthStart;
+    std::vector<unsigned int> newSlot;
+    std::vector<unsigned char> placed;
+};
+
+extern SceneStore sceneStore;
@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "terrain.hpp"
+#include "utilities/compactVertex.hpp"
+#include "utilities/meshCache.hpp"
+#include "utilities/perlinNoise.hpp"
+#include "utilities/threadPool.hpp"
+
+namespace {
+
+const FloatVertexLayout TERRAIN_FLOAT_LAYOUT = {TERRAIN_VERTEX_FLOATS, 0, 3, 6};
+
+struct TerrainShape {
+    int size;
+    float heightScale;
+    float uvScale;
+    float noiseScale;
+    glm::vec2 lakeCenter;
+    float lakeRadius;
+};
+
+TerrainShape terrainShape(int size, float heightScale, float uvScale) {
+    TerrainShape shape;
+    shape.size = size;
+    shape.heightScale = heightScale;
+    shape.uvScale = uvScale;
+    shape.noiseScale = 0.1f;
+    shape.lakeCenter = glm::vec2(size * 0.7f, size * 0.4f); //Move the lake to the side
+    shape.lakeRadius = size * 0.08f; // Lake size
+    return shape;
+}
+
+// A rectangle of the vertex grid. Vertex (x, z) sits at world position (x - size / 2, height, z - size / 2),
+// and the noise and the lake are defined everywhere, so regions may reach past the size x size terrain.
+struct TerrainRegion {
+    int x0, z0;             // grid coordinates of the first vertex
+    int width, height;      // in vertices
+    int chunkQuads;         // quads per chunk column when collecting height ranges
+    bool flatBorder;        // the outermost ring keeps a zero normal instead of looking at the grid around it
+};
+
+// Heights of count vertices of grid row z starting at column xBegin, with the lake carved out.
+// distortion is scratch space of the same length.
+void terrainHeightRow(const TerrainShape& shape, int z, int xBegin, int count, float* heights, float* distortion) {
+    perlinNoise3Row(xBegin, 0.2f, z * 0.2f, 0.0f, distortion, count);
+    perlinNoise3Row(xBegin, shape.noiseScale, z * shape.noiseScale, 0.0f, heights, count);
+
+    for (int i = 0; i < count; ++i) {
+        int x = xBegin + i;
+        float noiseFactor = distortion[i] * 8.0f;
+
+        float ellipseFactorX = 1.3f;  // Stretch in x-direction
+        float ellipseFactorZ = 0.8f;  // Compress in z-direction
+        float baseDistance = glm::distance(glm::vec2((x - shape.lakeCenter.x) * ellipseFactorX,
+                                                     (z - shape.lakeCenter.y) * ellipseFactorZ), glm::vec2(0.0f));
+
+        float distortedDistance = baseDistance + noiseFactor;
+
+        float height = heights[i] * shape.heightScale;
+
+        if (distortedDistance < shape.lakeRadius) {
+            float blend = glm::smoothstep(shape.lakeRadius - 10.0f, shape.lakeRadius, distortedDistance);
+            height = glm::mix(-20.0f, height, blend);
+        }
+        heights[i] = height;
+    }
+}
+
+// Writes rows [rowBegin, rowEnd) of the region as interleaved vertices, out points at the first vertex of
+// row rowBegin. Only three rows of heights are alive at any time: the normal of a row needs the rows above and
+// below it, and each row carries one extra height on either side for the normals of its first and last vertex.
+// rowHeightRange receives the lowest and highest vertex of each row within every chunk column.
+void buildTerrainRows(const TerrainShape& shape, const TerrainRegion& region, int rowBegin, int rowEnd,
+                      float* out, glm::vec2* rowHeightRange) {
+    int size = shape.size;
+    int width = region.width;
+    int samples = width + 2;
+    int chunksPerSide = terrainChunksPerSide(width, region.chunkQuads);
+    std::vector<float> window(samples * 3);
+    std::vector<float> distortion(samples);
+    float* previous = &window[0];
+    float* current = &window[samples];
+    float* next = &window[samples * 2];
+
+    auto heightRow = [&](int row, float* heights) {
+        terrainHeightRow(shape, region.z0 + row, region.x0 - 1, samples, heights, distortion.data());
+    };
+    heightRow(rowBegin - 1, previous);
+    heightRow(rowBegin, current);
+
+    for (int row = rowBegin; row < rowEnd; ++row) {
+        heightRow(row + 1, next);
+
+        int z = region.z0 + row;
+        bool borderRow = region.flatBorder && (row == 0 || row == region.height - 1);
+
+        for (int i = 0; i < width; ++i) {
+            int x = region.x0 + i;
+            int sample = i + 1;
+            glm::vec3 normal(0.0f);
+            if (!borderRow && !(region.flatBorder && (i == 0 || i == width - 1))) {
+                float hL = current[sample - 1];
+                float hR = current[sample + 1];
+                float hD = previous[sample];
+                float hU = next[sample];
+
+                normal = glm::normalize(glm::vec3(hL - hR, 2.0f, hD - hU));
+
+                if (glm::distance(glm::vec2(x, z), shape.lakeCenter) < shape.lakeRadius) {
+                    normal = glm::vec3(0.0f, 1.0f, 0.0f);
+                }
+            }
+
+            float* vertex = out + ((size_t)(row - rowBegin) * width + i) * TERRAIN_VERTEX_FLOATS;
+            vertex[0] = (float)x - size * 0.5f; // X
+            vertex[1] = current[sample];        // Y
+            vertex[2] = (float)z - size * 0.5f; // Z
+            vertex[3] = normal.x;
+            vertex[4] = normal.y;
+            vertex[5] = normal.z;
+            vertex[6] = (float)x / (size * shape.uvScale);
+            vertex[7] = (float)z / (size * shape.uvScale);
+        }
+
+        // Neighbouring chunk columns share their border vertex
+        for (int column = 0; column < chunksPerSide; ++column) {
+            int iBegin = column * region.chunkQuads;
+            int iEnd = std::min(iBegin + region.chunkQuads, width - 1);
+            glm::vec2 range(current[iBegin + 1]);
+            for (int i = iBegin + 1; i <= iEnd; ++i) {
+                range.x = std::min(range.x, current[i + 1]);
+                range.y = std::max(range.y, current[i + 1]);
+            }
+            rowHeightRange[row * chunksPerSide + column] = range;
+        }
+
+        // Slide the window down one row
+        float* recycled = previous;
+        previous = current;
+        current = next;
+        next = recycled;
+    }
+}
+
+// Allocates the bound buffer and lets fill() write its contents straight into mapped GPU memory.
+// Falls back to a temporary copy in system memory if the driver refuses to map the buffer.
+template <class T, class Fill>
+void fillBuffer(GLenum target, size_t count, Fill fill) {
+    size_t bytes = count * sizeof(T);
+    glBufferData(target, bytes, nullptr, GL_STATIC_DRAW);
+
+    T* mapped = (T*)glMapBufferRange(target, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped != nullptr) {
+        fill(mapped);
+        // GL_FALSE means the contents got lost while mapped (e.g. a mode switch), so we have to write them again
+        if (glUnmapBuffer(target) == GL_TRUE) return;
+    }
+
+    std::vector<T> staging(count);
+    fill(staging.data());
+    glBufferSubData(target, 0, bytes, staging.data());
+}
+
+} // namespace
+
+void setTerrainVertexAttributes() {
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, TERRAIN_VERTEX_FLOATS * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, TERRAIN_VERTEX_FLOATS * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, TERRAIN_VERTEX_FLOATS * sizeof(float), (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+}
+
+glm::vec2 buildTerrainTile(const TerrainParameters& parameters, int x0, int z0, int tileQuads, float* vertices) {
+    TerrainShape shape = terrainShape(parameters.size, parameters.heightScale, parameters.uvScale);
+    TerrainRegion region = {x0, z0, tileQuads + 1, tileQuads + 1, tileQuads, false};
+
+    std::vector<glm::vec2> rowHeightRange(region.height);
+    buildTerrainRows(shape, region, 0, region.height, vertices, rowHeightRange.data());
+
+    glm::vec2 heightRange = rowHeightRange[0];
+    for (glm::vec2 range : rowHeightRange) {
+        heightRange.x = std::min(heightRange.x, range.x);
+        heightRange.y = std::max(heightRange.y, range.y);
+    }
+    return heightRange;
+}
+
+TerrainMesh generateUnevenTerrain(int size, float heightScale, float uvScale) {
+    auto startTime = std::chrono::steady_clock::now();
+    ThreadPool& pool = workerPool();
+    TerrainShape shape = terrainShape(size, heightScale, uvScale);
+    TerrainRegion region = {0, 0, size, size, TERRAIN_CHUNK_QUADS, true};
+
+    TerrainMesh terrain;
+    int chunksPerSide = terrainChunksPerSide(size, TERRAIN_CHUNK_QUADS);
+    int chunkCount = chunksPerSide * chunksPerSide;
+    int templateSlots = 4 * TERRAIN_LOD_COUNT * 16;
+    size_t vertexCount = (size_t)size * size;
+    bool compact = compactVerticesEnabled();
+    size_t vertexStride = compact ? sizeof(CompactVertex) : TERRAIN_VERTEX_FLOATS * sizeof(float);
+    size_t vertexBytes = vertexCount * vertexStride;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // Everything the vertices and templates depend on. Bump the version when the generator itself changes.
+    CacheHash key;
+    key.add("terrain v2");
+    key.add(size);
+    key.add(heightScale);
+    key.add(uvScale);
+    key.add(shape.noiseScale);
+    key.add(shape.lakeCenter.x);
+    key.add(shape.lakeCenter.y);
+    key.add(shape.lakeRadius);
+    key.add(TERRAIN_CHUNK_QUADS);
+    key.add(TERRAIN_LOD_COUNT);
+    CacheHash layout;
+    layout.add(compact ? "compact position 3s, normal 2s octahedral, uv 2h" : "position 3f, normal 3f, uv 2f");
+    std::string cachePath = std::string(MESH_CACHE_DIRECTORY) + (compact ? "terrain-compact.bin" : "terrain.bin");
+
+    // The extra blob holds the chunk height ranges followed by the first index and index count of each template
+    size_t extraBytes = chunkCount * sizeof(glm::vec2) + 2 * templateSlots * sizeof(unsigned int);
+    std::vector<glm::vec2> chunkHeightRange(chunkCount, glm::vec2(1e30f, -1e30f));
+
+    glGenVertexArrays(1, &terrain.VAO);
+    glGenBuffers(1, &terrain.VBO);
+    glGenBuffers(1, &terrain.EBO);
+
+    glBindVertexArray(terrain.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, terrain.VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain.EBO);
+
+    MappedFile cacheFile;
+    MeshCacheData cached;
+    bool cacheHit = loadMeshCache(cachePath, key.value, layout.value, vertexStride, sizeof(unsigned int), cacheFile, cached) &&
+                    cached.vertexCount == vertexCount && cached.extraBytes == extraBytes;
+    if (cacheHit) {
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, cached.vertices, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, cached.indexCount * sizeof(unsigned int), cached.indices, GL_STATIC_DRAW);
+
+        const glm::vec2* ranges = (const glm::vec2*)cached.extra;
+        const unsigned int* templateFirst = (const unsigned int*)(ranges + chunkCount);
+        const unsigned int* templateCount = templateFirst + templateSlots;
+        chunkHeightRange.assign(ranges, ranges + chunkCount);
+        terrain.lod = createTerrainChunks(size, TERRAIN_CHUNK_QUADS, TERRAIN_LOD_COUNT, -size * 0.5f, chunkHeightRange);
+        terrain.lod.templateFirst.assign(templateFirst, templateFirst + templateSlots);
+        terrain.lod.templateCount.assign(templateCount, templateCount + templateSlots);
+        terrain.indexCount = (int)cached.indexCount;
+        boundsMin = cached.boundsMin;
+        boundsMax = cached.boundsMax;
+        if (compact) terrain.quantization = vertexQuantization(boundsMin, boundsMax);
+        cacheFile.close();
+    } else {
+        std::vector<unsigned int> templateIndices;
+        std::vector<unsigned int> templateFirst;
+        std::vector<unsigned int> templateCount;
+        buildTerrainTemplates(size, TERRAIN_CHUNK_QUADS, terrainLastChunkQuads(size, TERRAIN_CHUNK_QUADS), TERRAIN_LOD_COUNT,
+                              templateIndices, templateFirst, templateCount);
+
+        // Every row is written by exactly one band, and each band recomputes the one row of heights above and
+        // below it that it needs for its normals, so the output does not depend on how the rows are split.
+        // The vertices are written once, in their final interleaved layout, into the cache file, or directly
+        // into the buffer if there is no cache file.
+        std::vector<glm::vec2> rowHeightRange(size * chunksPerSide);
+        auto buildVertices = [&](float* vertices) {
+            pool.parallelFor(0, size, [&](int zBegin, int zEnd) {
+                buildTerrainRows(shape, region, zBegin, zEnd, vertices + (size_t)zBegin * size * TERRAIN_VERTEX_FLOATS,
+                                 rowHeightRange.data());
+            });
+        };
+        auto reduceHeightRanges = [&]() {
+            // Chunk rows share their border row of vertices too
+            for (int z = 0; z < size; ++z) {
+                for (int row = std::max(z - 1, 0) / TERRAIN_CHUNK_QUADS; row <= std::min(z / TERRAIN_CHUNK_QUADS, chunksPerSide - 1); ++row) {
+                    for (int column = 0; column < chunksPerSide; ++column) {
+                        glm::vec2& range = chunkHeightRange[row * chunksPerSide + column];
+                        range.x = std::min(range.x, rowHeightRange[z * chunksPerSide + column].x);
+                        range.y = std::max(range.y, rowHeightRange[z * chunksPerSide + column].y);
+                    }
+                }
+            }
+            glm::vec2 heightRange(1e30f, -1e30f);
+            for (glm::vec2 range : chunkHeightRange) {
+                heightRange.x = std::min(heightRange.x, range.x);
+                heightRange.y = std::max(heightRange.y, range.y);
+            }
+            boundsMin = glm::vec3(-size * 0.5f, heightRange.x, -size * 0.5f);
+            boundsMax = glm::vec3(size * 0.5f - 1.0f, heightRange.y, size * 0.5f - 1.0f);
+        };
+
+        MeshCacheWriter cacheWriter;
+        bool caching = cacheWriter.create(cachePath, key.value, layout.value, vertexStride, vertexCount,
+                                          sizeof(unsigned int), templateIndices.size(), extraBytes);
+        if (!compact) {
+            if (caching) {
+                buildVertices((float*)cacheWriter.data.vertices);
+                glBufferData(GL_ARRAY_BUFFER, vertexBytes, cacheWriter.data.vertices, GL_STATIC_DRAW);
+            } else {
+                fillBuffer<float>(GL_ARRAY_BUFFER, vertexCount * TERRAIN_VERTEX_FLOATS, buildVertices);
+            }
+            reduceHeightRanges();
+        } else {
+            // Quantizing needs the bounds of the whole terrain, so the float vertices are built first
+            std::vector<float> vertices(vertexCount * TERRAIN_VERTEX_FLOATS);
+            buildVertices(vertices.data());
+            reduceHeightRanges();
+            terrain.quantization = vertexQuantization(boundsMin, boundsMax);
+
+            CompactVertexReport report;
+            std::mutex reportMutex;
+            auto compactAll = [&](CompactVertex* out) {
+                report = CompactVertexReport();
+                pool.parallelFor(0, size, [&](int zBegin, int zEnd) {
+                    size_t first = (size_t)zBegin * size;
+                    CompactVertexReport band = compactVertices(vertices.data() + first * TERRAIN_VERTEX_FLOATS,
+                                                               (size_t)(zEnd - zBegin) * size, TERRAIN_FLOAT_LAYOUT,
+                                                               terrain.quantization, out + first);
+                    std::lock_guard<std::mutex> lock(reportMutex);
+                    report.merge(band);
+                });
+            };
+            if (caching) {
+                compactAll((CompactVertex*)cacheWriter.data.vertices);
+                glBufferData(GL_ARRAY_BUFFER, vertexBytes, cacheWriter.data.vertices, GL_STATIC_DRAW);
+            } else {
+                fillBuffer<CompactVertex>(GL_ARRAY_BUFFER, vertexCount, compactAll);
+            }
+            printCompactVertexReport("Terrain", report);
+        }
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, templateIndices.size() * sizeof(unsigned int), templateIndices.data(), GL_STATIC_DRAW);
+
+        terrain.lod = createTerrainChunks(size, TERRAIN_CHUNK_QUADS, TERRAIN_LOD_COUNT, -size * 0.5f, chunkHeightRange);
+        terrain.lod.templateFirst = templateFirst;
+        terrain.lod.templateCount = templateCount;
+        terrain.indexCount = (int)templateIndices.size();
+
+        if (cacheWriter.isOpen()) {
+            std::copy(templateIndices.begin(), templateIndices.end(), (unsigned int*)cacheWriter.data.indices);
+            glm::vec2* ranges = (glm::vec2*)cacheWriter.data.extra;
+            std::copy(chunkHeightRange.begin(), chunkHeightRange.end(), ranges);
+            std::copy(templateFirst.begin(), templateFirst.end(), (unsigned int*)(ranges + chunkCount));
+            std::copy(templateCount.begin(), templateCount.end(), (unsigned int*)(ranges + chunkCount) + templateSlots);
+            cacheWriter.commit(boundsMin, boundsMax);
+        }
+
+        printf("Terrain LOD: %i chunks of %i quads, %i levels, %.1fM template indices (full detail mesh: %.1fM)\n",
+               chunkCount, TERRAIN_CHUNK_QUADS, TERRAIN_LOD_COUNT, templateIndices.size() / 1e6,
+               (double)(size - 1) * (size - 1) * 6 / 1e6);
+    }
+    terrain.boundsMin = boundsMin;
+    terrain.boundsMax = boundsMax;
+
+    if (compact) {
+        setCompactVertexAttributes();
+    } else {
+        setTerrainVertexAttributes();
+    }
+
+    glBindVertexArray(0);
+
+    double generationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    if (cacheHit) {
+        printf("Terrain %ix%i loaded in %.1f ms (cache hit: %s, %.1f MB vertex buffer)\n",
+               size, size, generationMs, cachePath.c_str(), vertexBytes / (1024.0 * 1024.0));
+    } else {
+        printf("Terrain %ix%i generated in %.1f ms using %u threads (cache miss, %s noise, %.1f MB vertex buffer)\n",
+               size, size, generationMs, pool.size(), noiseISAName(bestNoiseISA()), vertexBytes / (1024.0 * 1024.0));
+    }
+    return terrain;
+}
+
+std::vector<OccluderMesh> buildTerrainOccluders(const TerrainParameters& parameters) {
+    auto startTime = std::chrono::steady_clock::now();
+    ThreadPool& pool = workerPool();
+    TerrainShape shape = terrainShape(parameters.size, parameters.heightScale, parameters.uvScale);
+    int size = parameters.size;
+    int cellsPerSide = (size - 2) / TERRAIN_OCCLUDER_CELL_QUADS + 1;
+
+    // Lowest vertex of every cell. Neighbouring cells share their border vertices, so the border rows are
+    // computed by both cell rows that touch them.
+    std::vector<float> cellLowest(cellsPerSide * cellsPerSide, 1e30f);
+    pool.parallelFor(0, cellsPerSide, [&](int cellRowBegin, int cellRowEnd) {
+        std::vector<float> heights(size);
+        std::vector<float> distortion(size);
+        for (int cellRow = cellRowBegin; cellRow < cellRowEnd; ++cellRow) {
+            int zBegin = cellRow * TERRAIN_OCCLUDER_CELL_QUADS;
+            int zEnd = std::min(zBegin + TERRAIN_OCCLUDER_CELL_QUADS, size - 1);
+            for (int z = zBegin; z <= zEnd; ++z) {
+                terrainHeightRow(shape, z, 0, size, heights.data(), distortion.data());
+                for (int column = 0; column < cellsPerSide; ++column) {
+                    int xBegin = column * TERRAIN_OCCLUDER_CELL_QUADS;
+                    int xEnd = std::min(xBegin + TERRAIN_OCCLUDER_CELL_QUADS, size - 1);
+                    float& lowest = cellLowest[cellRow * cellsPerSide + column];
+                    for (int x = xBegin; x <= xEnd; ++x) {
+                        lowest = std::min(lowest, heights[x]);
+                    }
+                }
+            }
+        }
+    });
+
+    // Coarse vertex (i, j) sits on grid vertex (i, j) * cell quads, clamped to the last one
+    auto coarsePosition = [&](int i, int j) {
+        float lowest = 1e30f;
+        for (int row = std::max(j - 1, 0); row <= std::min(j, cellsPerSide - 1); ++row) {
+            for (int column = std::max(i - 1, 0); column <= std::min(i, cellsPerSide - 1); ++column) {
+                lowest = std::min(lowest, cellLowest[row * cellsPerSide + column]);
+            }
+        }
+        int x = std::min(i * TERRAIN_OCCLUDER_CELL_QUADS, size - 1);
+        int z = std::min(j * TERRAIN_OCCLUDER_CELL_QUADS, size - 1);
+        return glm::vec3((float)x - size * 0.5f, lowest, (float)z - size * 0.5f);
+    };
+
+    int blocksPerSide = (cellsPerSide + TERRAIN_OCCLUDER_BLOCK_CELLS - 1) / TERRAIN_OCCLUDER_BLOCK_CELLS;
+    std::vector<OccluderMesh> occluders(blocksPerSide * blocksPerSide);
+    size_t triangleCount = 0;
+    for (int blockRow = 0; blockRow < blocksPerSide; ++blockRow) {
+        for (int blockColumn = 0; blockColumn < blocksPerSide; ++blockColumn) {
+            OccluderMesh& occluder = occluders[blockRow * blocksPerSide + blockColumn];
+            int i0 = blockColumn * TERRAIN_OCCLUDER_BLOCK_CELLS;
+            int j0 = blockRow * TERRAIN_OCCLUDER_BLOCK_CELLS;
+            int width = std::min(TERRAIN_OCCLUDER_BLOCK_CELLS, cellsPerSide - i0) + 1;
+            int height = std::min(TERRAIN_OCCLUDER_BLOCK_CELLS, cellsPerSide - j0) + 1;
+            for (int j = 0; j < height; ++j) {
+                for (int i = 0; i < width; ++i) {
+                    glm::vec3 position = coarsePosition(i0 + i, j0 + j);
+                    occluder.positions.push_back(position);
+                    occluder.bounds.expand(AABB(position, position));
+                }
+            }
+            for (int j = 0; j + 1 < height; ++j) {
+                for (int i = 0; i + 1 < width; ++i) {
+                    unsigned int corner = j * width + i;
+                    unsigned int quad[6] = {corner, corner + width, corner + 1, corner + 1, corner + width, corner + width + 1};
+                    occluder.indices.insert(occluder.indices.end(), quad, quad + 6);
+                }
+            }
+            triangleCount += occluder.indices.size() / 3;
+        }
+    }
+
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    printf("Terrain occluders: %zu meshes, %zu triangles (%ix%i cells of %i quads) built in %.1f ms\n",
+           occluders.size(), triangleCount, cellsPerSide, cellsPerSide, TERRAIN_OCCLUDER_CELL_QUADS, buildMs);
+    return occluders;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "occlusionCulling.hpp"
+#include "terrainLOD.hpp"
+#include "utilities/compactVertex.hpp"
+
+// Interleaved terrain vertex: position (3), normal (3), UV (2)
+const int TERRAIN_VERTEX_FLOATS = 8;
+
+// Quads per side of a terrain chunk, and the number of detail levels each chunk has (see terrainLOD.hpp)
+const int TERRAIN_CHUNK_QUADS = 64;
+const int TERRAIN_LOD_COUNT = 5;
+
+// Quads per side of an occluder cell, and cells per side of an occluder mesh (see buildTerrainOccluders())
+const int TERRAIN_OCCLUDER_CELL_QUADS = 16;
+const int TERRAIN_OCCLUDER_BLOCK_CELLS = 8;
+
+// What generateUnevenTerrain() was called with. The lake and the UVs are laid out for a size x size grid.
+struct TerrainParameters {
+    int size;
+    float heightScale;
+    float uvScale;
+};
+
+struct TerrainMesh {
+    unsigned int VAO, VBO, EBO;
+    int indexCount;     // size of the LOD index templates in EBO
+    TerrainLOD lod;
+    VertexQuantization quantization;
+    glm::vec3 boundsMin;    // around every vertex, in the terrain's own space
+    glm::vec3 boundsMax;
+};
+
+// Generates a size x size grid of Perlin noise hills with a lake carved out of it, and uploads it to the GPU.
+// The work is split into row bands on the shared worker pool (see utilities/threadPool.hpp).
+// The result does not depend on the number of threads. The vertices and index templates are cached on disk
+// (see utilities/meshCache.hpp), later runs with the same parameters upload them straight from the cache file.
+// The mesh is drawn in chunks through terrain.lod, there is no index buffer for the full detail grid.
+// With compactVerticesEnabled() the vertices are stored as CompactVertex, quantized to the terrain bounds.
+TerrainMesh generateUnevenTerrain(int size, float heightScale, float uvScale);
+
+// Fills vertices with the (tileQuads + 1)^2 grid vertices starting at grid vertex (x0, z0), which may lie
+// outside the size x size terrain. Tiles share their border vertices, and the normals look past the edge of
+// the tile, so neighbouring tiles line up without seams. Returns the lowest and highest vertex.
+// Runs on the calling thread only and touches no GL state, so it is safe to call from worker threads.
+glm::vec2 buildTerrainTile(const TerrainParameters& parameters, int x0, int z0, int tileQuads, float* vertices);
+
+// A coarse copy of the size x size terrain for the occlusion buffer, one mesh per block of cells. Each coarse
+// vertex takes the lowest height of the cells around it, so the coarse surface stays below the real one and
+// cannot hide anything standing on the terrain. Runs on the shared worker pool and touches no GL state.
+std::vector<OccluderMesh> buildTerrainOccluders(const TerrainParameters& parameters);
+
+// Sets up the interleaved terrain vertex layout for the bound VAO and GL_ARRAY_BUFFER
+void setTerrainVertexAttributes();
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cstdio>
+#include <glad/glad.h>
+#include "terrainLOD.hpp"
+#include "utilities/meshOptimizer.hpp"
+#include "utilities/threadPool.hpp"
+
+namespace {
+
+// Grid lines of a chunk edge that is `length` quads long at the given step. The far edge is always included,
+// so chunks whose size is not a multiple of the step get a narrower last cell.
+std::vector<int> gridLines(int length, int step) {
+    std::vector<int> lines;
+    for (int position = 0; position < length; position += step) {
+        lines.push_back(position);
+    }
+    lines.push_back(length);
+    return lines;
+}
+
+// The closest grid line at or before position
+int snapDown(const std::vector<int>& lines, int position) {
+    return *(std::upper_bound(lines.begin(), lines.end(), position) - 1);
+}
+
+void buildTemplate(int width, int height, int step, int edgeMask, int stride, std::vector<unsigned int>& out) {
+    std::vector<int> columns = gridLines(width, step);
+    std::vector<int> rows = gridLines(height, step);
+    std::vector<int> coarseColumns = gridLines(width, step * 2);
+    std::vector<int> coarseRows = gridLines(height, step * 2);
+
+    auto vertex = [&](int x, int z) {
+        int snappedX = x;
+        int snappedZ = z;
+        if ((z == 0 && (edgeMask & EDGE_LOW_Z)) || (z == height && (edgeMask & EDGE_HIGH_Z))) {
+            snappedX = snapDown(coarseColumns, x);
+        }
+        if ((x == 0 && (edgeMask & EDGE_LOW_X)) || (x == width && (edgeMask & EDGE_HIGH_X))) {
+            snappedZ = snapDown(coarseRows, z);
+        }
+        return (unsigned int)(snappedZ * stride + snappedX);
+    };
+    auto triangle = [&](unsigned int a, unsigned int b, unsigned int c) {
+        // Snapping collapses some of the edge triangles, there is no point in sending those
+        if (a == b || b == c || a == c) return;
+        out.push_back(a);
+        out.push_back(b);
+        out.push_back(c);
+    };
+
+    for (size_t j = 0; j + 1 < rows.size(); j++) {
+        for (size_t i = 0; i + 1 < columns.size(); i++) {
+            unsigned int topLeft = vertex(columns[i], rows[j]);
+            unsigned int topRight = vertex(columns[i + 1], rows[j]);
+            unsigned int bottomLeft = vertex(columns[i], rows[j + 1]);
+            unsigned int bottomRight = vertex(columns[i + 1], rows[j + 1]);
+
+            triangle(topLeft, bottomLeft, topRight);
+            triangle(topRight, bottomLeft, bottomRight);
+        }
+    }
+}
+
+// Template for a chunk at its selected level, stitched to its coarser neighbours
+int chunkTemplateSlot(const TerrainLOD& terrain, int chunkIndex) {
+    int side = terrain.chunksPerSide;
+    const TerrainChunk& chunk = terrain.chunks[chunkIndex];
+
+    int edgeMask = 0;
+    if (chunk.row > 0           && terrain.chunks[chunkIndex - side].lod > chunk.lod) edgeMask |= EDGE_LOW_Z;
+    if (chunk.row < side - 1    && terrain.chunks[chunkIndex + side].lod > chunk.lod) edgeMask |= EDGE_HIGH_Z;
+    if (chunk.column > 0        && terrain.chunks[chunkIndex - 1].lod > chunk.lod)    edgeMask |= EDGE_LOW_X;
+    if (chunk.column < side - 1 && terrain.chunks[chunkIndex + 1].lod > chunk.lod)    edgeMask |= EDGE_HIGH_X;
+
+    return terrainTemplateSlot(terrain.lodCount, chunk.shape, chunk.lod, edgeMask);
+}
+
+float distanceToBox(glm::vec3 point, glm::vec3 boxMin, glm::vec3 boxMax) {
+    glm::vec3 outside = glm::max(glm::max(boxMin - point, point - boxMax), glm::vec3(0.0f));
+    return glm::length(outside);
+}
+
+void buildQuadtreeNode(TerrainLOD& terrain, int nodeIndex, int column0, int row0, int column1, int row1) {
+    if (column1 - column0 == 1 && row1 - row0 == 1) {
+        int chunk = row0 * terrain.chunksPerSide + column0;
+        TerrainQuadtreeNode& leaf = terrain.nodes[nodeIndex];
+        leaf.boundsMin = terrain.chunks[chunk].boundsMin;
+        leaf.boundsMax = terrain.chunks[chunk].boundsMax;
+        leaf.firstChild = -1;
+        leaf.childCount = 0;
+        leaf.chunk = chunk;
+        return;
+    }
+
+    int columnSplit = column1 - column0 > 1 ? (column0 + column1) / 2 : column1;
+    int rowSplit = row1 - row0 > 1 ? (row0 + row1) / 2 : row1;
+    int ranges[4][4] = {
+        {column0, row0, columnSplit, rowSplit},
+        {columnSplit, row0, column1, rowSplit},
+        {column0, rowSplit, columnSplit, row1},
+        {columnSplit, rowSplit, column1, row1},
+    };
+
+    int firstChild = (int)terrain.nodes.size();
+    int childCount = 0;
+    for (auto& range : ranges) {
+        if (range[0] < range[2] && range[1] < range[3]) childCount++;
+    }
+    terrain.nodes.resize(firstChild + childCount);
+
+    int child = firstChild;
+    glm::vec3 boundsMin(1e30f);
+    glm::vec3 boundsMax(-1e30f);
+    for (auto& range : ranges) {
+        if (range[0] >= range[2] || range[1] >= range[3]) continue;
+        buildQuadtreeNode(terrain, child, range[0], range[1], range[2], range[3]);
+        boundsMin = glm::min(boundsMin, terrain.nodes[child].boundsMin);
+        boundsMax = glm::max(boundsMax, terrain.nodes[child].boundsMax);
+        child++;
+    }
+
+    TerrainQuadtreeNode& node = terrain.nodes[nodeIndex];
+    node.boundsMin = boundsMin;
+    node.boundsMax = boundsMax;
+    node.firstChild = firstChild;
+    node.childCount = childCount;
+    node.chunk = -1;
+}
+
+} // namespace
+
+int terrainChunksPerSide(int gridSize, int chunkQuads) {
+    return (gridSize - 1 + chunkQuads - 1) / chunkQuads;
+}
+
+int terrainLastChunkQuads(int gridSize, int chunkQuads) {
+    return (gridSize - 1) - (terrainChunksPerSide(gridSize, chunkQuads) - 1) * chunkQuads;
+}
+
+int terrainTemplateSlot(int lodCount, int shape, int lod, int edgeMask) {
+    return (shape * lodCount + lod) * 16 + edgeMask;
+}
+
+int terrainLODForDistance(float distance, float lodDistance, int lodCount) {
+    int lod = 0;
+    float limit = lodDistance;
+    while (distance >= limit && lod < lodCount - 1) {
+        lod++;
+        limit *= 2.0f;
+    }
+    return lod;
+}
+
+void buildTerrainTemplates(int stride, int chunkQuads, int lastChunkQuads, int lodCount, std::vector<unsigned int>& indices,
+                           std::vector<unsigned int>& first, std::vector<unsigned int>& count) {
+    int slotCount = 4 * lodCount * 16;
+    first.resize(slotCount);
+    count.resize(slotCount);
+    std::vector<bool> aliased(slotCount, false);
+    for (int shape = 0; shape < 4; shape++) {
+        int width = (shape & 1) ? lastChunkQuads : chunkQuads;
+        int height = (shape & 2) ? lastChunkQuads : chunkQuads;
+        // When the grid divides evenly every shape is a full chunk, so they all share the templates of shape 0
+        bool sameAsFull = width == chunkQuads && height == chunkQuads;
+        for (int lod = 0; lod < lodCount; lod++) {
+            for (int edgeMask = 0; edgeMask < 16; edgeMask++) {
+                int slot = terrainTemplateSlot(lodCount, shape, lod, edgeMask);
+                if (shape > 0 && sameAsFull) {
+                    int fullSlot = terrainTemplateSlot(lodCount, 0, lod, edgeMask);
+                    first[slot] = first[fullSlot];
+                    count[slot] = count[fullSlot];
+                    aliased[slot] = true;
+                    continue;
+                }
+                first[slot] = indices.size();
+                buildTemplate(width, height, 1 << lod, edgeMask, stride, indices);
+                count[slot] = indices.size() - first[slot];
+            }
+        }
+    }
+
+    // Reorder the triangles of every template for the vertex cache. The vertices are shared by all chunks and
+    // addressed through the base vertex, so only the index order can change. The optimizer wants dense vertex
+    // numbers, so each template is renumbered to its own (width + 1) wide grid while it is being optimized.
+    std::vector<VertexCacheStats> before(slotCount);
+    std::vector<VertexCacheStats> after(slotCount);
+    workerPool().parallelFor(0, slotCount, [&](int slotBegin, int slotEnd) {
+        std::vector<unsigned int> local;
+        for (int slot = slotBegin; slot < slotEnd; slot++) {
+            if (aliased[slot]) continue;
+            int shape = slot / (lodCount * 16);
+            int width = (shape & 1) ? lastChunkQuads : chunkQuads;
+            int height = (shape & 2) ? lastChunkQuads : chunkQuads;
+
+            unsigned int* templateIndices = indices.data() + first[slot];
+            local.resize(count[slot]);
+            for (unsigned int i = 0; i < count[slot]; i++) {
+                local[i] = templateIndices[i] / stride * (width + 1) + templateIndices[i] % stride;
+            }
+            size_t localVertices = (size_t)(width + 1) * (height + 1);
+            before[slot] = analyzeVertexCache(local.data(), local.size(), localVertices);
+            optimizeVertexCache(local.data(), local.size(), localVertices);
+            after[slot] = analyzeVertexCache(local.data(), local.size(), localVertices);
+            for (unsigned int i = 0; i < count[slot]; i++) {
+                templateIndices[i] = local[i] / (width + 1) * stride + local[i] % (width + 1);
+            }
+        }
+    });
+
+    MeshOptimizationReport report;
+    for (int slot = 0; slot < slotCount; slot++) {
+        report.before.triangleCount += before[slot].triangleCount;
+        report.before.vertexCount += before[slot].vertexCount;
+        report.before.transformedCount += before[slot].transformedCount;
+        report.after.transformedCount += after[slot].transformedCount;
+    }
+    report.after.triangleCount = report.before.triangleCount;
+    report.after.vertexCount = report.vertexCount = report.before.vertexCount;
+    for (VertexCacheStats* stats : {&report.before, &report.after}) {
+        stats->acmr = stats->triangleCount > 0 ? stats->transformedCount / (float)stats->triangleCount : 0.0f;
+        stats->atvr = stats->vertexCount > 0 ? stats->transformedCount / (float)stats->vertexCount : 0.0f;
+    }
+    printMeshOptimizationReport("Terrain LOD templates", report);
+}
+
+TerrainLOD createTerrainChunks(int gridSize, int chunkQuads, int lodCount, float gridOffset,
+                               const std::vector<glm::vec2>& chunkHeightRange) {
+    TerrainLOD terrain;
+    terrain.gridSize = gridSize;
+    terrain.chunkQuads = chunkQuads;
+    terrain.chunksPerSide = terrainChunksPerSide(gridSize, chunkQuads);
+    terrain.lodCount = lodCount;
+
+    int lastChunkQuads = terrainLastChunkQuads(gridSize, chunkQuads);
+    for (int row = 0; row < terrain.chunksPerSide; row++) {
+        for (int column = 0; column < terrain.chunksPerSide; column++) {
+            bool lastColumn = column == terrain.chunksPerSide - 1;
+            bool lastRow = row == terrain.chunksPerSide - 1;
+            int x0 = column * chunkQuads;
+            int z0 = row * chunkQuads;
+            glm::vec2 heightRange = chunkHeightRange[row * terrain.chunksPerSide + column];
+
+            TerrainChunk chunk;
+            chunk.column = column;
+            chunk.row = row;
+            chunk.firstVertex = z0 * gridSize + x0;
+            chunk.shape = (lastColumn ? 1 : 0) | (lastRow ? 2 : 0);
+            chunk.boundsMin = glm::vec3(x0 + gridOffset, heightRange.x, z0 + gridOffset);
+            chunk.boundsMax = glm::vec3(x0 + (lastColumn ? lastChunkQuads : chunkQuads) + gridOffset, heightRange.y,
+                                        z0 + (lastRow ? lastChunkQuads : chunkQuads) + gridOffset);
+            chunk.lod = 0;
+            terrain.chunks.push_back(chunk);
+        }
+    }
+
+    terrain.nodes.resize(1);
+    buildQuadtreeNode(terrain, 0, 0, 0, terrain.chunksPerSide, terrain.chunksPerSide);
+    return terrain;
+}
+
+void selectTerrainLOD(TerrainLOD& terrain, glm::vec3 cameraPosition) {
+    // Level from distance for every chunk. This is cheap next to drawing, and the neighbours of drawn chunks
+    // need a level for stitching whether they are drawn or not.
+    for (TerrainChunk& chunk : terrain.chunks) {
+        float distance = distanceToBox(cameraPosition, chunk.boundsMin, chunk.boundsMax);
+        chunk.lod = terrainLODForDistance(distance, terrain.lodDistance, terrain.lodCount);
+    }
+
+    // Neighbours may differ by at most one level. Only ever refine, so a chunk never gets coarser than its
+    // distance asks for. Converges after one pass unless chunks are larger than lodDistance.
+    int side = terrain.chunksPerSide;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int row = 0; row < side; row++) {
+            for (int column = 0; column < side; column++) {
+                int& lod = terrain.chunks[row * side + column].lod;
+                int limit = lod;
+                if (column > 0)        limit = std::min(limit, terrain.chunks[row * side + column - 1].lod + 1);
+                if (column < side - 1) limit = std::min(limit, terrain.chunks[row * side + column + 1].lod + 1);
+                if (row > 0)           limit = std::min(limit, terrain.chunks[(row - 1) * side + column].lod + 1);
+                if (row < side - 1)    limit = std::min(limit, terrain.chunks[(row + 1) * side + column].lod + 1);
+                if (limit < lod) {
+                    lod = limit;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+}
+
+void selectTerrainChunks(TerrainLOD& terrain, glm::vec3 cameraPosition, const Frustum& frustum) {
+    // Walk the quadtree, skipping every subtree that is out of range or outside the frustum as a whole. Each
+    // entry carries the planes its parent was not completely inside, as in DynamicBVH::queryFrustum().
+    terrain.selectedChunks.clear();
+    terrain.selectedTriangles = 0;
+    terrain.selectedFullDetailTriangles = 0;
+    std::vector<std::pair<int, unsigned int>> stack;
+    stack.push_back(std::make_pair(0, ALL_FRUSTUM_PLANES));
+    while (!stack.empty()) {
+        const TerrainQuadtreeNode& node = terrain.nodes[stack.back().first];
+        unsigned int planeMask = stack.back().second;
+        stack.pop_back();
+        if (distanceToBox(cameraPosition, node.boundsMin, node.boundsMax) > terrain.maxDistance) continue;
+        if (planeMask && classifyAABB(frustum, AABB(node.boundsMin, node.boundsMax), planeMask) == FRUSTUM_OUTSIDE) continue;
+
+        if (node.chunk >= 0) {
+            terrain.selectedChunks.push_back(node.chunk);
+            continue;
+        }
+        for (int child = node.firstChild; child < node.firstChild + node.childCount; child++) {
+            stack.push_back(std::make_pair(child, planeMask));
+        }
+    }
+
+    for (int chunkIndex : terrain.selectedChunks) {
+        const TerrainChunk& chunk = terrain.chunks[chunkIndex];
+        terrain.selectedTriangles += terrain.templateCount[chunkTemplateSlot(terrain, chunkIndex)] / 3;
+        terrain.selectedFullDetailTriangles += terrain.templateCount[terrainTemplateSlot(terrain.lodCount, chunk.shape, 0, 0)] / 3;
+    }
+}
+
+void drawTerrainLOD(const TerrainLOD& terrain) {
+    for (int chunkIndex : terrain.selectedChunks) {
+        const TerrainChunk& chunk = terrain.chunks[chunkIndex];
+        int slot = chunkTemplateSlot(terrain, chunkIndex);
+        glDrawElementsBaseVertex(GL_TRIANGLES, terrain.templateCount[slot], GL_UNSIGNED_INT,
+                                 (void*)(terrain.templateFirst[slot] * sizeof(unsigned int)), chunk.firstVertex);
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "utilities/bounds.hpp"
+
+// Chunked level of detail for a square heightfield grid (geomipmapping).
+//
+// The grid is cut into chunks of chunkQuads x chunkQuads quads, the leaves of a quadtree. All chunks index
+// into the one shared vertex buffer, and level l draws every 2^l-th vertex. Neighbouring chunks are kept
+// within one level of each other, and the edges of a chunk that face a coarser neighbour have their vertices
+// snapped onto the neighbour's vertices, so there are no cracks between levels.
+//
+// The index buffer holds one template per (chunk shape, level, coarser-edge mask). Templates are relative to
+// the top left vertex of a chunk, and are drawn with glDrawElementsBaseVertex.
+
+// Which edges of a chunk face a coarser neighbour
+enum TerrainEdge {
+    EDGE_LOW_Z = 1, EDGE_HIGH_Z = 2, EDGE_LOW_X = 4, EDGE_HIGH_X = 8
+};
+
+struct TerrainChunk {
+    int column, row;
+    int firstVertex;        // grid index of the top left vertex, used as base vertex
+    int shape;              // 1 if narrower than chunkQuads along x, | 2 along z (the last column/row)
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    int lod;                // level selected for the current frame
+};
+
+struct TerrainQuadtreeNode {
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    int firstChild;         // children are stored next to each other, -1 for leaves
+    int childCount;
+    int chunk;              // the chunk of a leaf, -1 otherwise
+};
+
+struct TerrainLOD {
+    int gridSize = 0;       // vertices per side
+    int chunkQuads = 0;
+    int chunksPerSide = 0;
+    int lodCount = 0;
+
+    // Chunks closer than lodDistance are drawn at full detail, and each doubling of the distance drops one
+    // level. Chunks farther away than maxDistance (the far plane) are not drawn at all.
+    float lodDistance = 100.0f;
+    float maxDistance = 1000.0f;
+
+    std::vector<TerrainChunk> chunks;
+    std::vector<TerrainQuadtreeNode> nodes;     // nodes[0] is the root
+
+    std::vector<unsigned int> templateFirst;    // first index of each template in the element buffer
+    std::vector<unsigned int> templateCount;
+
+    std::vector<int> selectedChunks;            // chunks to draw in the current pass, filled by selectTerrainChunks()
+    unsigned int selectedTriangles = 0;
+    unsigned int selectedFullDetailTriangles = 0;   // what the same chunks would cost at level 0
+};
+
+// Number of chunks along one side of a grid with gridSize vertices per side
+int terrainChunksPerSide(int gridSize, int chunkQuads);
+
+// Quads along the last chunk column/row, which may be narrower than the others
+int terrainLastChunkQuads(int gridSize, int chunkQuads);
+
+// Index of the template for a chunk shape, level and coarser-edge mask in templateFirst/templateCount
+int terrainTemplateSlot(int lodCount, int shape, int lod, int edgeMask);
+
+// Level for a chunk whose closest point is distance away from the camera
+int terrainLODForDistance(float distance, float lodDistance, int lodCount);
+
+// Appends every template to indices. Chunks are chunkQuads quads wide, except for the last column/row which is
+// lastChunkQuads wide, and the grid they index into has stride vertices per row.
+void buildTerrainTemplates(int stride, int chunkQuads, int lastChunkQuads, int lodCount, std::vector<unsigned int>& indices,
+                           std::vector<unsigned int>& first, std::vector<unsigned int>& count);
+
+// Builds the chunks and the quadtree. The templates are built separately with buildTerrainTemplates().
+// chunkHeightRange holds the lowest and highest vertex of every chunk, row by row. Vertex (x, z) of the grid
+// is expected at world position (x + gridOffset, height, z + gridOffset).
+TerrainLOD createTerrainChunks(int gridSize, int chunkQuads, int lodCount, float gridOffset,
+                               const std::vector<glm::vec2>& chunkHeightRange);
+
+// Picks the level of every chunk for a camera at cameraPosition, once per frame
+void selectTerrainLOD(TerrainLOD& terrain, glm::vec3 cameraPosition);
+
+// Picks the chunks one pass draws: those within maxDistance of the camera that overlap the pass's frustum.
+// Called once per pass after selectTerrainLOD(), so the shadow pass draws the same levels as the main pass,
+// only for the chunks the light sees.
+void selectTerrainChunks(TerrainLOD& terrain, glm::vec3 cameraPosition, const Frustum& frustum);
+
+// Draws the selected chunks. The terrain VAO must be bound.
+void drawTerrainLOD(const TerrainLOD& terrain);
@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <glad/glad.h>
+#include "terrainStreaming.hpp"
+#include "utilities/glStateCache.hpp"
+#include "utilities/threadPool.hpp"
+
+TerrainStreamer::TerrainStreamer(const TerrainParameters& parameters, const TerrainStreamingSettings& settings)
+    : parameters(parameters), settings(settings) {
+    int tileVertices = (settings.tileQuads + 1) * (settings.tileQuads + 1);
+    tileBytes = (size_t)tileVertices * TERRAIN_VERTEX_FLOATS * sizeof(float);
+
+    // Keep every worker busy, but do not queue more than they can finish in a couple of frames. Without
+    // workers the jobs run inside update(), so only allow one per frame.
+    unsigned int workers = workerPool().size() - 1;
+    maxPendingTiles = std::max(2 * (int)workers, 1);
+    finished = std::make_shared<FinishedTiles>();
+
+    std::vector<unsigned int> indices;
+    buildTerrainTemplates(settings.tileQuads + 1, settings.tileQuads, settings.tileQuads, settings.lodCount,
+                          indices, templateFirst, templateCount);
+
+    // Uploaded through GL_ARRAY_BUFFER so no VAO has to be bound. Each tile VAO binds it as its element buffer.
+    glGenBuffers(1, &templateBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, templateBuffer);
+    if (tileVertices <= 65536) {
+        std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        templateIndexType = GL_UNSIGNED_SHORT;
+        templateIndexSize = sizeof(uint16_t);
+        glBufferData(GL_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+    } else {
+        templateIndexType = GL_UNSIGNED_INT;
+        templateIndexSize = sizeof(unsigned int);
+        glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    printf("Terrain streaming: %ix%i quad tiles of %.2f MB, %.0f MB budget (%i tiles), %i generation jobs in flight\n",
+           settings.tileQuads, settings.tileQuads, tileBytes / (1024.0 * 1024.0), settings.memoryBudget / (1024.0 * 1024.0),
+           (int)(settings.memoryBudget / tileBytes), maxPendingTiles);
+}
+
+TerrainStreamer::~TerrainStreamer() {
+    // Jobs still running drop their tile into `finished`, which they keep alive themselves
+    for (auto& tile : tiles) {
+        spareBuffers.push_back(tile.second);
+    }
+    for (Tile& tile : spareBuffers) {
+        glDeleteVertexArrays(1, &tile.VAO);
+        glDeleteBuffers(1, &tile.VBO);
+    }
+    glDeleteBuffers(1, &templateBuffer);
+}
+
+void TerrainStreamer::requestTile(TileKey key) {
+    pending.insert(key);
+
+    std::shared_ptr<FinishedTiles> destination = finished;
+    TerrainParameters terrain = parameters;
+    int tileQuads = settings.tileQuads;
+    size_t floatCount = tileBytes / sizeof(float);
+    workerPool().submit([destination, terrain, tileQuads, floatCount, key]() {
+        TileData data;
+        data.key = key;
+        data.vertices.resize(floatCount);
+        data.heightRange = buildTerrainTile(terrain, key.first * tileQuads, key.second * tileQuads, tileQuads,
+                                            data.vertices.data());
+
+        std::lock_guard<std::mutex> lock(destination->mutex);
+        destination->tiles.push_back(std::move(data));
+    });
+}
+
+void TerrainStreamer::uploadTile(TileData& data) {
+    Tile tile;
+    if (!spareBuffers.empty()) {
+        // Same size as before, so the buffer storage can stay where it is
+        tile = spareBuffers.back();
+        spareBuffers.pop_back();
+        glBindBuffer(GL_ARRAY_BUFFER, tile.VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, tileBytes, data.vertices.data());
+    } else {
+        glGenVertexArrays(1, &tile.VAO);
+        glGenBuffers(1, &tile.VBO);
+        glState.bindVertexArray(tile.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, tile.VBO);
+        glBufferData(GL_ARRAY_BUFFER, tileBytes, data.vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, templateBuffer);
+        setTerrainVertexAttributes();
+        glState.bindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    tile.heightRange = data.heightRange;
+    tile.lastUsedFrame = frame;
+    tiles[data.key] = tile;
+}
+
+bool TerrainStreamer::evictLeastRecentlyUsed() {
+    auto oldest = tiles.end();
+    for (auto tile = tiles.begin(); tile != tiles.end(); ++tile) {
+        // Tiles around the camera have been used this frame and are never evicted
+        if (tile->second.lastUsedFrame >= frame) continue;
+        if (oldest == tiles.end() || tile->second.lastUsedFrame < oldest->second.lastUsedFrame) oldest = tile;
+    }
+    if (oldest == tiles.end()) return false;
+
+    spareBuffers.push_back(oldest->second);
+    tiles.erase(oldest);
+    streamingStats.evictions++;
+    return true;
+}
+
+void TerrainStreamer::update(glm::vec3 cameraPosition) {
+    frame++;
+    streamingStats.uploads = 0;
+    streamingStats.evictions = 0;
+    streamingStats.uploadMs = 0.0;
+
+    // Tiles within view distance, nearest first. Distances are measured in grid units, where tile (x, z)
+    // covers [x, x + 1) * tileQuads along both axes.
+    float tileSize = (float)settings.tileQuads;
+    float gridOffset = -parameters.size * 0.5f;
+    glm::vec3 camera = cameraPosition - glm::vec3(gridOffset, 0.0f, gridOffset);
+    int centerX = (int)std::floor(camera.x / tileSize);
+    int centerZ = (int)std::floor(camera.z / tileSize);
+    int radius = (int)std::ceil(settings.viewDistance / tileSize);
+
+    wanted.clear();
+    wantedLOD.clear();
+    for (int z = centerZ - radius; z <= centerZ + radius; z++) {
+        for (int x = centerX - radius; x <= centerX + radius; x++) {
+            TileKey key(x, z);
+            glm::vec2 heightRange(0.0f);
+            auto resident = tiles.find(key);
+            if (resident != tiles.end()) heightRange = resident->second.heightRange;
+
+            glm::vec3 boundsMin(x * tileSize, heightRange.x, z * tileSize);
+            glm::vec3 boundsMax((x + 1) * tileSize, heightRange.y, (z + 1) * tileSize);
+            glm::vec3 outside = glm::max(glm::max(boundsMin - camera, camera - boundsMax), glm::vec3(0.0f));
+            if (glm::length(glm::vec2(outside.x, outside.z)) > settings.viewDistance) continue;
+
+            WantedTile tile;
+            tile.distance = glm::length(outside);
+            tile.key = key;
+            wanted.push_back(tile);
+            wantedLOD[key] = terrainLODForDistance(tile.distance, settings.lodDistance, settings.lodCount);
+            if (resident != tiles.end()) resident->second.lastUsedFrame = frame;
+        }
+    }
+    std::sort(wanted.begin(), wanted.end());
+
+    // Take over what the workers finished since the last frame, and forget tiles the camera moved away from
+    {
+        std::lock_guard<std::mutex> lock(finished->mutex);
+        for (TileData& data : finished->tiles) {
+            pending.erase(data.key);
+            ready[data.key] = std::move(data);
+        }
+        finished->tiles.clear();
+    }
+    for (auto data = ready.begin(); data != ready.end();) {
+        if (wantedLOD.count(data->first)) {
+            ++data;
+        } else {
+            data = ready.erase(data);
+        }
+    }
+
+    // Upload the nearest finished tiles, only a few per frame, so a burst of finished tiles is spread over
+    // several frames instead of causing a hitch. Over budget, far tiles make room for near ones.
+    auto uploadStart = std::chrono::steady_clock::now();
+    for (const WantedTile& tile : wanted) {
+        if (streamingStats.uploads >= settings.maxUploadsPerFrame || streamingStats.uploadMs >= settings.uploadBudgetMs) break;
+
+        auto data = ready.find(tile.key);
+        if (data == ready.end()) continue;
+        if ((tiles.size() + 1) * tileBytes > settings.memoryBudget && !evictLeastRecentlyUsed()) break;
+
+        uploadTile(data->second);
+        ready.erase(data);
+        streamingStats.uploads++;
+        streamingStats.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+    }
+
+    // Queue missing tiles, nearest first. Stop at the number of tiles that can be resident at the same time,
+    // counting the ones that would have to be evicted for them.
+    size_t budgetTiles = settings.memoryBudget / tileBytes;
+    size_t evictable = 0;
+    for (const auto& tile : tiles) {
+        if (tile.second.lastUsedFrame < frame) evictable++;
+    }
+    for (const WantedTile& tile : wanted) {
+        if ((int)pending.size() >= maxPendingTiles) break;
+        if (tiles.count(tile.key) || pending.count(tile.key) || ready.count(tile.key)) continue;
+        if (tiles.size() + pending.size() + ready.size() >= budgetTiles + evictable) break;
+        requestTile(tile.key);
+    }
+
+    // Neighbouring tiles may differ by at most one level, as in selectTerrainLOD()
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& tile : wantedLOD) {
+            const TileKey& key = tile.first;
+            int limit = tile.second;
+            const TileKey neighbours[4] = {
+                TileKey(key.first - 1, key.second), TileKey(key.first + 1, key.second),
+                TileKey(key.first, key.second - 1), TileKey(key.first, key.second + 1),
+            };
+            for (const TileKey& neighbour : neighbours) {
+                auto lod = wantedLOD.find(neighbour);
+                if (lod != wantedLOD.end()) limit = std::min(limit, lod->second + 1);
+            }
+            if (limit < tile.second) {
+                tile.second = limit;
+                changed = true;
+            }
+        }
+    }
+
+    residentDraws.clear();
+    for (const WantedTile& wantedTile : wanted) {
+        auto resident = tiles.find(wantedTile.key);
+        if (resident == tiles.end()) continue;
+
+        const TileKey& key = wantedTile.key;
+        int lod = wantedLOD[key];
+        auto coarser = [&](int x, int z) {
+            auto neighbour = wantedLOD.find(TileKey(x, z));
+            return neighbour != wantedLOD.end() && neighbour->second > lod;
+        };
+        int edgeMask = 0;
+        if (coarser(key.first, key.second - 1)) edgeMask |= EDGE_LOW_Z;
+        if (coarser(key.first, key.second + 1)) edgeMask |= EDGE_HIGH_Z;
+        if (coarser(key.first - 1, key.second)) edgeMask |= EDGE_LOW_X;
+        if (coarser(key.first + 1, key.second)) edgeMask |= EDGE_HIGH_X;
+
+        int slot = terrainTemplateSlot(settings.lodCount, 0, lod, edgeMask);
+        TileDraw draw;
+        draw.VAO = resident->second.VAO;
+        draw.first = templateFirst[slot];
+        draw.count = templateCount[slot];
+        glm::vec2 heightRange = resident->second.heightRange;
+        draw.bounds = AABB(glm::vec3(key.first * tileSize + gridOffset, heightRange.x, key.second * tileSize + gridOffset),
+                           glm::vec3((key.first + 1) * tileSize + gridOffset, heightRange.y, (key.second + 1) * tileSize + gridOffset));
+        residentDraws.push_back(draw);
+    }
+
+    streamingStats.residentTiles = (int)tiles.size();
+    streamingStats.pendingTiles = (int)pending.size();
+    streamingStats.readyTiles = (int)ready.size();
+    streamingStats.residentBytes = tiles.size() * tileBytes;
+}
+
+void TerrainStreamer::selectTiles(const Frustum& frustum) {
+    drawList.clear();
+    drawTriangles = 0;
+    drawFullDetailTriangles = 0;
+    unsigned int fullDetailCount = templateCount[terrainTemplateSlot(settings.lodCount, 0, 0, 0)];
+    for (const TileDraw& draw : residentDraws) {
+        if (!frustumOverlaps(frustum, draw.bounds)) continue;
+        drawList.push_back(draw);
+        drawTriangles += draw.count / 3;
+        drawFullDetailTriangles += fullDetailCount / 3;
+    }
+}
+
+void TerrainStreamer::draw() const {
+    for (const TileDraw& draw : drawList) {
+        glState.bindVertexArray(draw.VAO);
+        glDrawElements(GL_TRIANGLES, draw.count, templateIndexType, (void*)(draw.first * templateIndexSize));
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "terrain.hpp"
+#include "utilities/bounds.hpp"
+
+// Endless terrain, streamed in square tiles around the camera.
+//
+// Tiles are cut from the same heightfield as generateUnevenTerrain() (same noise, same lake), just without
+// the edges of the size x size area. They are generated on the worker pool, nearest first, and handed to the
+// GL thread, which uploads a few of them per frame. Resident tiles stay on the GPU until the memory budget
+// runs out, then the least recently used ones (the ones the camera left behind) make room for new tiles.
+//
+// Every tile is one chunk for terrainLOD: it picks a level from its distance, and all tiles share one set of
+// index templates that stitch the edges facing a coarser neighbour.
+
+struct TerrainStreamingSettings {
+    int tileQuads = 128;                    // quads per tile side, a multiple of 2^(lodCount - 1)
+    int lodCount = 6;
+    float lodDistance = 100.0f;             // see TerrainLOD
+    float viewDistance = 1000.0f;           // tiles closer than this are loaded and drawn (the far plane)
+    size_t memoryBudget = 192 << 20;        // bytes of vertex data that may be resident on the GPU
+    int maxUploadsPerFrame = 2;
+    double uploadBudgetMs = 1.0;            // no further uploads in a frame once this much time went into them
+};
+
+struct TerrainStreamingStats {
+    int residentTiles = 0;
+    int pendingTiles = 0;                   // queued or being generated on the workers
+    int readyTiles = 0;                     // generated, waiting for their upload
+    size_t residentBytes = 0;
+    int uploads = 0;                        // in the last update()
+    int evictions = 0;
+    double uploadMs = 0.0;
+};
+
+class TerrainStreamer {
+public:
+    TerrainStreamer(const TerrainParameters& parameters, const TerrainStreamingSettings& settings = TerrainStreamingSettings());
+    ~TerrainStreamer();
+
+    TerrainStreamer(const TerrainStreamer&) = delete;
+    TerrainStreamer& operator=(const TerrainStreamer&) = delete;
+
+    // Once per frame on the GL thread: queues missing tiles around the camera, uploads finished ones within the
+    // per frame limits, and picks the levels of the resident tiles in view distance.
+    void update(glm::vec3 cameraPosition);
+
+    // Picks the tiles one pass draws: those from the last update() that overlap the pass's frustum
+    void selectTiles(const Frustum& frustum);
+
+    // Draws the tiles picked by the last selectTiles(). Binds the VAO of every tile.
+    void draw() const;
+
+    unsigned int selectedTileCount() const { return (unsigned int)drawList.size(); }
+    unsigned int selectedTriangles() const { return drawTriangles; }
+    unsigned int selectedFullDetailTriangles() const { return drawFullDetailTriangles; }
+
+    const TerrainStreamingStats& stats() const { return streamingStats; }
+    size_t memoryBudget() const { return settings.memoryBudget; }
+
+private:
+    typedef std::pair<int, int> TileKey;    // tile column and row
+
+    struct Tile {
+        unsigned int VAO, VBO;
+        glm::vec2 heightRange;
+        unsigned long long lastUsedFrame;
+    };
+
+    struct TileData {
+        TileKey key;
+        std::vector<float> vertices;
+        glm::vec2 heightRange;
+    };
+
+    // Filled by the workers, emptied by update(). Shared with the jobs so they can finish after we are gone.
+    struct FinishedTiles {
+        std::mutex mutex;
+        std::vector<TileData> tiles;
+    };
+
+    struct WantedTile {
+        float distance;
+        TileKey key;
+        bool operator<(const WantedTile& other) const { return distance < other.distance; }
+    };
+
+    struct TileDraw {
+        unsigned int VAO;
+        unsigned int first, count;
+        AABB bounds;                        // in world space
+    };
+
+    void requestTile(TileKey key);
+    void uploadTile(TileData& data);
+    bool evictLeastRecentlyUsed();
+
+    TerrainParameters parameters;
+    TerrainStreamingSettings settings;
+    size_t tileBytes;
+    int maxPendingTiles;
+
+    unsigned int templateBuffer;
+    unsigned int templateIndexType;         // 16 bit indices whenever a tile has few enough vertices
+    size_t templateIndexSize;
+    std::vector<unsigned int> templateFirst;
+    std::vector<unsigned int> templateCount;
+
+    std::map<TileKey, Tile> tiles;
+    std::set<TileKey> pending;
+    std::map<TileKey, TileData> ready;
+    std::shared_ptr<FinishedTiles> finished;
+    std::vector<Tile> spareBuffers;         // buffers of evicted tiles, reused by the next upload
+
+    std::vector<WantedTile> wanted;
+    std::map<TileKey, int> wantedLOD;
+    std::vector<TileDraw> residentDraws;    // resident tiles in view distance, from update()
+    std::vector<TileDraw> drawList;         // the ones in the frustum of the current pass
+    unsigned int drawTriangles = 0;
+    unsigned int drawFullDetailTriangles = 0;
+
+    unsigned long long frame = 0;
+    TerrainStreamingStats streamingStats;
+};
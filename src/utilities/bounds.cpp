@@ -0,0 +1,83 @@
+#include "bounds.hpp"
+#include <algorithm>
+#include <cmath>
+
+AABB transformAABB(const AABB& box, const glm::mat4& matrix) {
+    if (box.empty()) return box;
+    glm::vec3 center = box.center();
+    glm::vec3 halfSize = box.halfSize();
+    glm::vec3 newCenter(matrix[3]);
+    glm::vec3 newHalfSize(0.0f);
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            newCenter[row] += matrix[column][row] * center[column];
+            newHalfSize[row] += std::fabs(matrix[column][row]) * halfSize[column];
+        }
+    }
+    return AABB(newCenter - newHalfSize, newCenter + newHalfSize);
+}
+
+Frustum frustumFromMatrix(const glm::mat4& viewProjection) {
+    // Rows of the matrix, glm stores columns
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; row++) {
+        rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+    }
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];     // left
+    frustum.planes[1] = rows[3] - rows[0];     // right
+    frustum.planes[2] = rows[3] + rows[1];     // bottom
+    frustum.planes[3] = rows[3] - rows[1];     // top
+    frustum.planes[4] = rows[3] + rows[2];     // near
+    frustum.planes[5] = rows[3] - rows[2];     // far
+    for (glm::vec4& plane : frustum.planes) {
+        plane = plane / glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool frustumOverlaps(const Frustum& frustum, const AABB& box) {
+    glm::vec3 center = box.center();
+    glm::vec3 halfSize = box.halfSize();
+    for (const glm::vec4& plane : frustum.planes) {
+        // Distance of the center, and how far the box reaches towards the plane
+        float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        float reach = std::fabs(plane.x) * halfSize.x + std::fabs(plane.y) * halfSize.y + std::fabs(plane.z) * halfSize.z;
+        if (distance + reach < 0.0f) return false;
+    }
+    return true;
+}
+
+FrustumOverlap classifyAABB(const Frustum& frustum, const AABB& box, unsigned int& planeMask) {
+    glm::vec3 center = box.center();
+    glm::vec3 halfSize = box.halfSize();
+    for (int i = 0; i < 6; i++) {
+        if (!(planeMask & (1u << i))) continue;
+        const glm::vec4& plane = frustum.planes[i];
+        float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        float reach = std::fabs(plane.x) * halfSize.x + std::fabs(plane.y) * halfSize.y + std::fabs(plane.z) * halfSize.z;
+        if (distance + reach < 0.0f) return FRUSTUM_OUTSIDE;
+        if (distance - reach >= 0.0f) planeMask &= ~(1u << i);
+    }
+    return planeMask ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+}
+
+bool rayIntersectsAABB(glm::vec3 origin, glm::vec3 inverseDirection, const AABB& box, float maxDistance, float& distance) {
+    float enter = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; axis++) {
+        float t1 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+        float t2 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+        // NaN from 0 * infinity (a ray in the plane of a face) leaves the interval as it is
+        enter = std::max(enter, std::min(t1, t2));
+        exit = std::min(exit, std::max(t1, t2));
+    }
+    distance = enter;
+    return enter <= exit;
+}
+
+bool sphereOverlapsAABB(glm::vec3 center, float radius, const AABB& box) {
+    glm::vec3 closest = glm::clamp(center, box.min, box.max);
+    glm::vec3 offset = center - closest;
+    return glm::dot(offset, offset) <= radius * radius;
+}
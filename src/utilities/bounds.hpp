@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box. The default box is empty (min above max) and grows with expand().
+struct AABB {
+    glm::vec3 min = glm::vec3(1e30f);
+    glm::vec3 max = glm::vec3(-1e30f);
+
+    AABB() = default;
+    AABB(glm::vec3 boundsMin, glm::vec3 boundsMax) : min(boundsMin), max(boundsMax) {}
+
+    bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 halfSize() const { return (max - min) * 0.5f; }
+
+    // Half the surface area, which is all the BVH cost heuristic needs
+    float halfArea() const {
+        glm::vec3 size = max - min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    void expand(const AABB& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool contains(const AABB& other) const {
+        return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+               max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+    }
+
+    bool overlaps(const AABB& other) const {
+        return min.x <= other.max.x && min.y <= other.max.y && min.z <= other.max.z &&
+               max.x >= other.min.x && max.y >= other.min.y && max.z >= other.min.z;
+    }
+};
+
+inline AABB merge(const AABB& a, const AABB& b) {
+    return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+// The box around the transformed box, without transforming its eight corners one by one (Arvo's method)
+AABB transformAABB(const AABB& box, const glm::mat4& matrix);
+
+// The six clip planes of a view projection matrix (Gribb and Hartmann), as (normal, distance) with the
+// normals pointing inwards. Works for perspective and orthographic projections.
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+Frustum frustumFromMatrix(const glm::mat4& viewProjection);
+
+// False only if the box lies completely outside one of the planes, so a few boxes near the corners of the
+// frustum pass even though they are outside
+bool frustumOverlaps(const Frustum& frustum, const AABB& box);
+
+enum FrustumOverlap { FRUSTUM_OUTSIDE, FRUSTUM_INTERSECTS, FRUSTUM_INSIDE };
+const unsigned int ALL_FRUSTUM_PLANES = 0x3f;
+
+// Like frustumOverlaps, but also tells boxes that are inside every plane apart. Only the planes in planeMask
+// are tested, and the ones the box is completely inside are cleared from it, so a box inside its parent's
+// box can start from the parent's mask.
+FrustumOverlap classifyAABB(const Frustum& frustum, const AABB& box, unsigned int& planeMask);
+
+// Distance along the ray to where it enters the box, or to the origin if it starts inside. direction does not
+// need to be normalized, the distance is then in multiples of it.
+bool rayIntersectsAABB(glm::vec3 origin, glm::vec3 inverseDirection, const AABB& box, float maxDistance, float& distance);
+
+bool sphereOverlapsAABB(glm::vec3 center, float radius, const AABB& box);
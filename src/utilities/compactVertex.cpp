@@ -0,0 +1,141 @@
+#include "compactVertex.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <glad/glad.h>
+#include <glm/gtc/packing.hpp>
+
+static bool _compactVertices = false;
+
+namespace {
+
+// Same conversion as GL does for normalized signed shorts: max(value / 32767, -1)
+int16_t toSnorm16(float value) {
+    return (int16_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+float fromSnorm16(int16_t value) {
+    return std::max(value / 32767.0f, -1.0f);
+}
+
+float signNotZero(float value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Projects the unit sphere onto an octahedron and unfolds it into the [-1, 1] square
+glm::vec2 octahedralEncode(glm::vec3 normal) {
+    float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if (length == 0.0f) return glm::vec2(0.0f, 1.0f);
+
+    glm::vec2 encoded(normal.x / length, normal.y / length);
+    if (normal.z < 0.0f) {
+        encoded = glm::vec2((1.0f - std::fabs(encoded.y)) * signNotZero(encoded.x),
+                            (1.0f - std::fabs(encoded.x)) * signNotZero(encoded.y));
+    }
+    return encoded;
+}
+
+// Must match octahedralDecode() in simple.vert
+glm::vec3 octahedralDecode(glm::vec2 encoded) {
+    glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+    if (normal.z < 0.0f) {
+        float x = normal.x;
+        normal.x = (1.0f - std::fabs(normal.y)) * signNotZero(x);
+        normal.y = (1.0f - std::fabs(x)) * signNotZero(normal.y);
+    }
+    return glm::normalize(normal);
+}
+
+} // namespace
+
+void CompactVertexReport::merge(const CompactVertexReport& other) {
+    vertexCount += other.vertexCount;
+    maxPositionError = std::max(maxPositionError, other.maxPositionError);
+    maxNormalErrorDegrees = std::max(maxNormalErrorDegrees, other.maxNormalErrorDegrees);
+    maxTexCoordError = std::max(maxTexCoordError, other.maxTexCoordError);
+}
+
+void setCompactVertices(bool enabled) {
+    _compactVertices = enabled;
+}
+
+bool compactVerticesEnabled() {
+    return _compactVertices;
+}
+
+VertexQuantization vertexQuantization(glm::vec3 boundsMin, glm::vec3 boundsMax) {
+    VertexQuantization quantization;
+    quantization.compact = true;
+    quantization.offset = (boundsMin + boundsMax) * 0.5f;
+    // Flat meshes (the water) still need a scale we can divide by
+    quantization.scale = glm::max((boundsMax - boundsMin) * 0.5f, glm::vec3(1e-6f));
+    return quantization;
+}
+
+void floatVertexBounds(const float* vertices, size_t count, FloatVertexLayout layout, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+    boundsMin = glm::vec3(1e30f);
+    boundsMax = glm::vec3(-1e30f);
+    for (size_t i = 0; i < count; i++) {
+        const float* position = vertices + i * layout.stride + layout.position;
+        glm::vec3 point(position[0], position[1], position[2]);
+        boundsMin = glm::min(boundsMin, point);
+        boundsMax = glm::max(boundsMax, point);
+    }
+}
+
+CompactVertexReport compactVertices(const float* vertices, size_t count, FloatVertexLayout layout,
+                                    const VertexQuantization& quantization, CompactVertex* out) {
+    CompactVertexReport report;
+    report.vertexCount = count;
+    for (size_t i = 0; i < count; i++) {
+        const float* vertex = vertices + i * layout.stride;
+        glm::vec3 position(vertex[layout.position], vertex[layout.position + 1], vertex[layout.position + 2]);
+        glm::vec3 normal(vertex[layout.normal], vertex[layout.normal + 1], vertex[layout.normal + 2]);
+        glm::vec2 texCoord(vertex[layout.texCoord], vertex[layout.texCoord + 1]);
+
+        CompactVertex& compact = out[i];
+        glm::vec3 relative = (position - quantization.offset) / quantization.scale;
+        for (int axis = 0; axis < 3; axis++) {
+            compact.position[axis] = toSnorm16(relative[axis]);
+            float decoded = quantization.offset[axis] + quantization.scale[axis] * fromSnorm16(compact.position[axis]);
+            report.maxPositionError = std::max(report.maxPositionError, std::fabs(decoded - position[axis]));
+        }
+        compact.position[3] = 0;
+
+        glm::vec2 encoded = octahedralEncode(normal);
+        compact.normal[0] = toSnorm16(encoded.x);
+        compact.normal[1] = toSnorm16(encoded.y);
+        if (glm::length(normal) > 0.0f) {
+            glm::vec3 decoded = octahedralDecode(glm::vec2(fromSnorm16(compact.normal[0]), fromSnorm16(compact.normal[1])));
+            float cosine = std::min(std::max(glm::dot(decoded, glm::normalize(normal)), -1.0f), 1.0f);
+            report.maxNormalErrorDegrees = std::max(report.maxNormalErrorDegrees, glm::degrees(std::acos(cosine)));
+        }
+
+        for (int axis = 0; axis < 2; axis++) {
+            compact.texCoord[axis] = glm::packHalf1x16(texCoord[axis]);
+            float decoded = glm::unpackHalf1x16(compact.texCoord[axis]);
+            report.maxTexCoordError = std::max(report.maxTexCoordError, std::fabs(decoded - texCoord[axis]));
+        }
+    }
+    return report;
+}
+
+void setCompactVertexAttributes() {
+    glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoord));
+    glEnableVertexAttribArray(2);
+}
+
+void printCompactVertexReport(const char* meshName, const CompactVertexReport& report) {
+    double floatMB = report.vertexCount * 8 * sizeof(float) / (1024.0 * 1024.0);
+    double compactMB = report.vertexCount * sizeof(CompactVertex) / (1024.0 * 1024.0);
+    printf("%s: %zu compact vertices, %.2f MB instead of %.2f MB (saved %.2f MB). "
+           "Max error: position %.4f, normal %.3f degrees, UV %.5f\n",
+           meshName, report.vertexCount, compactMB, floatMB, floatMB - compactMB,
+           report.maxPositionError, report.maxNormalErrorDegrees, report.maxTexCoordError);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Opt-in 16 byte vertex format, half the size of the 8 float vertices used everywhere else.
+//
+//  - position: three signed normalized 16 bit integers relative to the bounds of the mesh, so
+//    position = offset + scale * snorm. The fourth one is padding to keep the normal aligned.
+//  - normal: octahedral encoding in two signed normalized 16 bit integers
+//  - UV: two half floats
+//
+// Attribute locations are the same as for float vertices (0 position, 1 normal, 2 UV), simple.vert decodes
+// positions and normals when the compactVertices uniform is set.
+
+struct CompactVertex {
+    int16_t position[4];
+    int16_t normal[2];
+    uint16_t texCoord[2];
+};
+
+// How the positions of a mesh were quantized. Float meshes have compact == false.
+struct VertexQuantization {
+    bool compact = false;
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// Where the attributes are within an interleaved float vertex, in floats
+struct FloatVertexLayout {
+    int stride;
+    int position;
+    int normal;
+    int texCoord;
+};
+
+// Largest difference between the original and the decoded attributes
+struct CompactVertexReport {
+    size_t vertexCount = 0;
+    float maxPositionError = 0.0f;
+    float maxNormalErrorDegrees = 0.0f;
+    float maxTexCoordError = 0.0f;
+
+    void merge(const CompactVertexReport& other);
+};
+
+// Whether meshes should be built with compact vertices. Off by default, see --compact-vertices.
+void setCompactVertices(bool enabled);
+bool compactVerticesEnabled();
+
+VertexQuantization vertexQuantization(glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+// Bounds of the positions of count interleaved float vertices
+void floatVertexBounds(const float* vertices, size_t count, FloatVertexLayout layout, glm::vec3& boundsMin, glm::vec3& boundsMax);
+
+// Converts count interleaved float vertices. Zero normals are stored as pointing up.
+CompactVertexReport compactVertices(const float* vertices, size_t count, FloatVertexLayout layout,
+                                    const VertexQuantization& quantization, CompactVertex* out);
+
+// Sets up the compact layout for the bound VAO and GL_ARRAY_BUFFER
+void setCompactVertexAttributes();
+
+// Prints the memory saved by the compact vertices of a mesh and how much precision they lost
+void printCompactVertexReport(const char* meshName, const CompactVertexReport& report);
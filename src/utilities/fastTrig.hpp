@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// sin and cos of the same angle at once, with Cephes' single precision range reduction and polynomials. The
+// SSE2 version does the same operations on four angles, so both give the same results.
+//
+// For |x| <= FAST_SINCOS_RANGE the absolute error stays within FAST_SINCOS_TOLERANCE of std::sin/std::cos.
+// Beyond that the range reduction loses precision, so callers should keep their phases bounded.
+
+const float FAST_SINCOS_RANGE = 8192.0f;
+const float FAST_SINCOS_TOLERANCE = 2e-7f;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FAST_TRIG_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace fastTrig {
+
+const float FOUR_OVER_PI = 1.27323954473516f;
+// pi/4 split in three parts, so subtracting multiples of it stays exact for a while
+const float PI_4_A = 0.78515625f;
+const float PI_4_B = 2.4187564849853515625e-4f;
+const float PI_4_C = 3.77489497744594108e-8f;
+
+const float SIN_1 = -1.9515295891e-4f;
+const float SIN_2 = 8.3321608736e-3f;
+const float SIN_3 = -1.6666654611e-1f;
+const float COS_1 = 2.443315711809948e-5f;
+const float COS_2 = -1.388731625493765e-3f;
+const float COS_3 = 4.166664568298827e-2f;
+
+} // namespace fastTrig
+
+inline void fastSinCos(float x, float& sine, float& cosine) {
+    using namespace fastTrig;
+    float sign = x < 0.0f ? -1.0f : 1.0f;
+    x = std::fabs(x);
+
+    // Octant of x, rounded up to an even one so the remainder falls in [-pi/4, pi/4]
+    int32_t octant = (int32_t)(x * FOUR_OVER_PI);
+    octant = (octant + 1) & ~1;
+    float y = (float)octant;
+    x = ((x - y * PI_4_A) - y * PI_4_B) - y * PI_4_C;
+
+    float z = x * x;
+    float sinPoly = ((SIN_1 * z + SIN_2) * z + SIN_3) * z * x + x;
+    float cosPoly = ((COS_1 * z + COS_2) * z + COS_3) * z * z - 0.5f * z + 1.0f;
+
+    // Octants 2 and 6 swap the polynomials, 4 and 6 flip the sine, 2 and 4 flip the cosine
+    bool swap = (octant & 2) != 0;
+    float s = swap ? cosPoly : sinPoly;
+    float c = swap ? sinPoly : cosPoly;
+    sine = (octant & 4) ? -s * sign : s * sign;
+    cosine = ((octant + 2) & 4) ? -c : c;
+}
+
+#ifdef FAST_TRIG_HAS_SSE2
+
+inline void fastSinCos(__m128 x, __m128& sine, __m128& cosine) {
+    using namespace fastTrig;
+    const __m128 signBit = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000u));
+    __m128 sign = _mm_and_ps(x, signBit);
+    x = _mm_andnot_ps(signBit, x);
+
+    __m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOUR_OVER_PI)));
+    octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(octant);
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_4_A)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_4_B)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_4_C)));
+
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_1), z), _mm_set1_ps(SIN_2));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(SIN_3));
+    sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+    __m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_1), z), _mm_set1_ps(COS_2));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(COS_3));
+    cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+    cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+    __m128 s = _mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly));
+    __m128 c = _mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly));
+
+    // Bit 2 of the octant moved to the sign bit
+    __m128 sinFlip = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29));
+    __m128 cosFlip = _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+    sine = _mm_xor_ps(s, _mm_xor_ps(sinFlip, sign));
+    cosine = _mm_xor_ps(c, cosFlip);
+}
+
+#endif
@@ -0,0 +1,214 @@
+#include "glStateCache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
+
+GLStateCache glState;
+
+bool GLStateCache::changed(bool known, bool same) {
+    if (known && same) {
+        skipped++;
+        return false;
+    }
+    issued++;
+    return true;
+}
+
+void GLStateCache::useProgram(GLuint newProgram) {
+    if (!changed(program != UNKNOWN, program == newProgram)) return;
+    glUseProgram(newProgram);
+    program = newProgram;
+    currentUniforms = &programs[newProgram];
+}
+
+void GLStateCache::bindVertexArray(GLuint newVertexArray) {
+    if (!changed(vertexArray != UNKNOWN, vertexArray == newVertexArray)) return;
+    glBindVertexArray(newVertexArray);
+    vertexArray = newVertexArray;
+}
+
+void GLStateCache::bindTexture(unsigned int unit, GLenum target, GLuint texture) {
+    GLuint* bound = nullptr;
+    if (unit < GL_STATE_TEXTURE_UNITS && target == GL_TEXTURE_2D) bound = &textures2D[unit];
+    if (unit < GL_STATE_TEXTURE_UNITS && target == GL_TEXTURE_CUBE_MAP) bound = &texturesCube[unit];
+    if (bound && !changed(*bound != UNKNOWN, *bound == texture)) return;
+
+    if (changed(activeUnit != UNKNOWN, activeUnit == unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    if (!bound) issued++;
+    glBindTexture(target, texture);
+    if (bound) *bound = texture;
+}
+
+void GLStateCache::setDepthTest(bool enabled) {
+    if (!changed(depthTest >= 0, depthTest == (int)enabled)) return;
+    if (enabled) {
+        glEnable(GL_DEPTH_TEST);
+    } else {
+        glDisable(GL_DEPTH_TEST);
+    }
+    depthTest = enabled;
+}
+
+void GLStateCache::setDepthFunc(GLenum function) {
+    if (!changed(depthFunc != UNKNOWN, depthFunc == function)) return;
+    glDepthFunc(function);
+    depthFunc = function;
+}
+
+void GLStateCache::setDepthMask(bool enabled) {
+    if (!changed(depthMask >= 0, depthMask == (int)enabled)) return;
+    glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    depthMask = enabled;
+}
+
+void GLStateCache::setBlend(bool enabled) {
+    if (!changed(blend >= 0, blend == (int)enabled)) return;
+    if (enabled) {
+        glEnable(GL_BLEND);
+    } else {
+        glDisable(GL_BLEND);
+    }
+    blend = enabled;
+}
+
+void GLStateCache::setBlendFunc(GLenum source, GLenum destination) {
+    if (!changed(blendSource != UNKNOWN, blendSource == source && blendDestination == destination)) return;
+    glBlendFunc(source, destination);
+    blendSource = source;
+    blendDestination = destination;
+}
+
+GLint GLStateCache::uniformLocation(const char* name) {
+    // Without a known program there is nothing to cache the location for
+    if (!currentUniforms) {
+        issued++;
+        GLint current = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        return glGetUniformLocation((GLuint)current, name);
+    }
+    auto found = currentUniforms->locations.find(name);
+    if (found != currentUniforms->locations.end()) {
+        skipped++;
+        return found->second;
+    }
+    issued++;
+    GLint location = glGetUniformLocation(program, name);
+    currentUniforms->locations[name] = location;
+    return location;
+}
+
+bool GLStateCache::uniformUnchanged(GLint location, UniformType type, const void* words, int size) {
+    // GL ignores location -1, so there is nothing to send
+    if (location < 0) {
+        skipped++;
+        return true;
+    }
+    if (!currentUniforms) {
+        issued++;
+        return false;
+    }
+    std::vector<UniformValue>& values = currentUniforms->values;
+    if ((size_t)location >= values.size()) values.resize(location + 1);
+    UniformValue& value = values[location];
+    bool same = value.type == type && value.size == size && memcmp(value.words, words, size * sizeof(float)) == 0;
+    if (!changed(value.type != UNIFORM_UNKNOWN, same)) return true;
+    value.type = type;
+    value.size = size;
+    memcpy(value.words, words, size * sizeof(float));
+    return false;
+}
+
+void GLStateCache::setUniform(GLint location, int value) {
+    if (!uniformUnchanged(location, UNIFORM_INT, &value, 1)) glUniform1i(location, value);
+}
+
+void GLStateCache::setUniform(GLint location, float value) {
+    if (!uniformUnchanged(location, UNIFORM_FLOAT, &value, 1)) glUniform1f(location, value);
+}
+
+void GLStateCache::setUniform(GLint location, const glm::vec3& value) {
+    if (!uniformUnchanged(location, UNIFORM_FLOAT, glm::value_ptr(value), 3)) glUniform3fv(location, 1, glm::value_ptr(value));
+}
+
+void GLStateCache::setUniform(GLint location, const glm::mat3& value) {
+    if (!uniformUnchanged(location, UNIFORM_FLOAT, glm::value_ptr(value), 9)) glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void GLStateCache::setUniform(GLint location, const glm::mat4& value) {
+    if (!uniformUnchanged(location, UNIFORM_FLOAT, glm::value_ptr(value), 16)) glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void GLStateCache::invalidate() {
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+        textures2D[unit] = UNKNOWN;
+        texturesCube[unit] = UNKNOWN;
+    }
+    depthTest = -1;
+    depthMask = -1;
+    blend = -1;
+    depthFunc = UNKNOWN;
+    blendSource = UNKNOWN;
+    blendDestination = UNKNOWN;
+    for (auto& entry : programs) {
+        entry.second.values.clear();
+    }
+    currentUniforms = nullptr;
+}
+
+int GLStateCache::verify() const {
+    int differences = 0;
+    auto check = [&](const char* what, bool known, GLint cached, GLint actual) {
+        if (!known || cached == actual) return;
+        fprintf(stderr, "GL state cache: %s is %d, the cache thinks %d\n", what, actual, cached);
+        differences++;
+    };
+    auto integer = [](GLenum name) {
+        GLint value = 0;
+        glGetIntegerv(name, &value);
+        return value;
+    };
+
+    check("program", program != UNKNOWN, (GLint)program, integer(GL_CURRENT_PROGRAM));
+    check("vertex array", vertexArray != UNKNOWN, (GLint)vertexArray, integer(GL_VERTEX_ARRAY_BINDING));
+    GLint actualUnit = integer(GL_ACTIVE_TEXTURE);
+    check("active texture unit", activeUnit != UNKNOWN, (GLint)activeUnit, actualUnit - GL_TEXTURE0);
+    for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+        if (textures2D[unit] == UNKNOWN && texturesCube[unit] == UNKNOWN) continue;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        check("2D texture", textures2D[unit] != UNKNOWN, (GLint)textures2D[unit], integer(GL_TEXTURE_BINDING_2D));
+        check("cube map texture", texturesCube[unit] != UNKNOWN, (GLint)texturesCube[unit], integer(GL_TEXTURE_BINDING_CUBE_MAP));
+    }
+    glActiveTexture(actualUnit);
+    check("depth test", depthTest >= 0, depthTest, glIsEnabled(GL_DEPTH_TEST) ? 1 : 0);
+    check("depth function", depthFunc != UNKNOWN, (GLint)depthFunc, integer(GL_DEPTH_FUNC));
+    check("depth mask", depthMask >= 0, depthMask, integer(GL_DEPTH_WRITEMASK) ? 1 : 0);
+    check("blending", blend >= 0, blend, glIsEnabled(GL_BLEND) ? 1 : 0);
+    check("blend source", blendSource != UNKNOWN, (GLint)blendSource, integer(GL_BLEND_SRC_RGB));
+    check("blend destination", blendDestination != UNKNOWN, (GLint)blendDestination, integer(GL_BLEND_DST_RGB));
+
+    // The uniforms of every program the cache knows values for
+    for (const auto& entry : programs) {
+        const std::vector<UniformValue>& values = entry.second.values;
+        for (size_t location = 0; location < values.size(); location++) {
+            const UniformValue& value = values[location];
+            if (value.type == UNIFORM_UNKNOWN) continue;
+            float actual[16];
+            if (value.type == UNIFORM_INT) {
+                glGetUniformiv(entry.first, (GLint)location, (GLint*)actual);
+            } else {
+                glGetUniformfv(entry.first, (GLint)location, actual);
+            }
+            if (memcmp(actual, value.words, value.size * sizeof(float)) != 0) {
+                fprintf(stderr, "GL state cache: uniform %zu of program %u differs from the cache\n", location, entry.first);
+                differences++;
+            }
+        }
+    }
+    return differences;
+}
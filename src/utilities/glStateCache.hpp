@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Texture units and capabilities the cache keeps track of. Binds to other units go straight to GL.
+const unsigned int GL_STATE_TEXTURE_UNITS = 8;
+
+// Remembers the GL state that the renderer sets over and over (program, VAO, texture units, depth and blend
+// state, and the uniforms of each program) and skips calls that would set what is already set. Everything
+// starts out unknown, so the first call always goes through. Code that changes this state behind the cache's
+// back has to call invalidate() afterwards.
+//
+// The counters say how many calls went to GL and how many were skipped since resetCounters(). Cached uniform
+// location lookups count as skipped calls too.
+class GLStateCache {
+public:
+    GLStateCache() { invalidate(); }
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    // GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP on one of the first GL_STATE_TEXTURE_UNITS units
+    void bindTexture(unsigned int unit, GLenum target, GLuint texture);
+    void setDepthTest(bool enabled);
+    void setDepthFunc(GLenum function);
+    void setDepthMask(bool enabled);
+    void setBlend(bool enabled);
+    void setBlendFunc(GLenum source, GLenum destination);
+
+    // Uniforms of the program in use. Locations are looked up once per program and name.
+    GLint uniformLocation(const char* name);
+    void setUniform(GLint location, int value);
+    void setUniform(GLint location, float value);
+    void setUniform(GLint location, const glm::vec3& value);
+    void setUniform(GLint location, const glm::mat3& value);
+    void setUniform(GLint location, const glm::mat4& value);
+    template <class T>
+    void setUniform(const char* name, const T& value) { setUniform(uniformLocation(name), value); }
+
+    // Forgets every value, the next call of each kind goes through. The uniform locations stay known.
+    void invalidate();
+
+    // Reads the state back from GL and prints where it differs from the cache. Slow, for testing only.
+    // Returns the number of differences.
+    int verify() const;
+
+    unsigned int callsIssued() const { return issued; }
+    unsigned int callsSkipped() const { return skipped; }
+    void resetCounters() { issued = 0; skipped = 0; }
+
+private:
+    enum UniformType { UNIFORM_UNKNOWN, UNIFORM_INT, UNIFORM_FLOAT };
+    struct UniformValue {
+        UniformType type = UNIFORM_UNKNOWN;
+        int size = 0;           // in 4 byte words
+        float words[16];        // ints are stored bit for bit
+    };
+    struct ProgramUniforms {
+        std::unordered_map<std::string, GLint> locations;
+        std::vector<UniformValue> values;   // by location
+    };
+
+    // True if the uniform at location already holds the words, otherwise remembers them
+    bool uniformUnchanged(GLint location, UniformType type, const void* words, int size);
+    bool changed(bool known, bool same);
+
+    static const GLuint UNKNOWN = ~0u;
+    GLuint program = UNKNOWN;
+    GLuint vertexArray = UNKNOWN;
+    GLuint activeUnit = UNKNOWN;
+    GLuint textures2D[GL_STATE_TEXTURE_UNITS];
+    GLuint texturesCube[GL_STATE_TEXTURE_UNITS];
+    int depthTest = -1;         // -1 unknown, otherwise 0 or 1
+    int depthMask = -1;
+    int blend = -1;
+    GLenum depthFunc = UNKNOWN;
+    GLenum blendSource = UNKNOWN;
+    GLenum blendDestination = UNKNOWN;
+    std::unordered_map<GLuint, ProgramUniforms> programs;
+    ProgramUniforms* currentUniforms = nullptr;
+
+    unsigned int issued = 0;
+    unsigned int skipped = 0;
+};
+
+// The cache for the one GL context of the program
+extern GLStateCache glState;
@@ -0,0 +1,180 @@
+#include "mappedFile.hpp"
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::openRead(const std::string& path) {
+    close();
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle != nullptr) {
+        bytes = (unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (bytes == nullptr) {
+        close();
+        return false;
+    }
+    length = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+bool MappedFile::create(const std::string& path, size_t size) {
+    close();
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        return false;
+    }
+    // Creating the mapping with a size grows the file to that size
+    unsigned long long fullSize = size;
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READWRITE, (DWORD)(fullSize >> 32), (DWORD)fullSize, nullptr);
+    if (mappingHandle != nullptr) {
+        bytes = (unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_WRITE, 0, 0, size);
+    }
+    if (bytes == nullptr) {
+        close();
+        return false;
+    }
+    length = size;
+    return true;
+}
+
+bool MappedFile::flush() {
+    if (bytes == nullptr) return false;
+    return FlushViewOfFile(bytes, 0) != 0 && FlushFileBuffers(fileHandle) != 0;
+}
+
+void MappedFile::close() {
+    if (bytes != nullptr) UnmapViewOfFile(bytes);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != nullptr) CloseHandle(fileHandle);
+    bytes = nullptr;
+    length = 0;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+}
+
+bool createDirectories(const std::string& path) {
+    for (size_t slash = path.find_first_of("/\\", 1); ; slash = path.find_first_of("/\\", slash + 1)) {
+        std::string parent = path.substr(0, slash);
+        DWORD attributes = GetFileAttributesA(parent.c_str());
+        if (attributes == INVALID_FILE_ATTRIBUTES && _mkdir(parent.c_str()) != 0) return false;
+        if (slash == std::string::npos) return true;
+    }
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool fileSizeAndTime(const std::string& path, uint64_t& size, int64_t& modifiedTime) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes)) return false;
+    size = (uint64_t)attributes.nFileSizeHigh << 32 | attributes.nFileSizeLow;
+    // 100 ns ticks
+    modifiedTime = (int64_t)((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32 | attributes.ftLastWriteTime.dwLowDateTime);
+    return true;
+}
+
+#else
+
+bool MappedFile::openRead(const std::string& path) {
+    close();
+    descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        close();
+        return false;
+    }
+    void* mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    bytes = (unsigned char*)mapping;
+    length = (size_t)status.st_size;
+    return true;
+}
+
+bool MappedFile::create(const std::string& path, size_t size) {
+    close();
+    descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (descriptor < 0) return false;
+
+    if (ftruncate(descriptor, (off_t)size) != 0) {
+        close();
+        return false;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    bytes = (unsigned char*)mapping;
+    length = size;
+    return true;
+}
+
+bool MappedFile::flush() {
+    if (bytes == nullptr) return false;
+    return msync(bytes, length, MS_SYNC) == 0 && fsync(descriptor) == 0;
+}
+
+void MappedFile::close() {
+    if (bytes != nullptr) munmap(bytes, length);
+    if (descriptor >= 0) ::close(descriptor);
+    bytes = nullptr;
+    length = 0;
+    descriptor = -1;
+}
+
+bool createDirectories(const std::string& path) {
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string parent = path.substr(0, slash);
+        if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        if (slash == std::string::npos) return true;
+    }
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+    return rename(from.c_str(), to.c_str()) == 0;
+}
+
+bool fileSizeAndTime(const std::string& path, uint64_t& size, int64_t& modifiedTime) {
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) return false;
+    size = (uint64_t)status.st_size;
+    // Whole seconds, st_mtim is not available everywhere
+    modifiedTime = (int64_t)status.st_mtime;
+    return true;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped into memory. Uses mmap on POSIX systems and file mappings on Windows.
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps an existing file read only. Fails for missing and empty files.
+    bool openRead(const std::string& path);
+
+    // Creates the file (replacing an existing one) with the given size and maps it for writing
+    bool create(const std::string& path, size_t size);
+
+    // Writes the mapped pages of a created file to disk and waits until they are there
+    bool flush();
+
+    // Unmaps the file. Writes to a created file are flushed to it by the OS.
+    void close();
+
+    bool isOpen() const { return bytes != nullptr; }
+    unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
+
+// Creates a directory and all of its missing parents
+bool createDirectories(const std::string& path);
+
+// Moves from over to, replacing to if it exists
+bool replaceFile(const std::string& from, const std::string& to);
+
+// Size and last modification time of a file. The time is only meant to be compared with other results of this
+// function, its unit depends on the platform.
+bool fileSizeAndTime(const std::string& path, uint64_t& size, int64_t& modifiedTime);
@@ -0,0 +1,138 @@
+#include "meshCache.hpp"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char MESH_CACHE_MAGIC[8] = {'G', 'V', 'M', 'E', 'S', 'H', 0, 0};
+
+// Blobs start on 64 byte boundaries, so the mapped data is aligned for anything we store in it
+uint64_t alignBlob(uint64_t offset) {
+    return (offset + 63) & ~(uint64_t)63;
+}
+
+// True if count elements starting at offset end by end. Divides instead of multiplying, so a corrupt count
+// cannot wrap around.
+bool blobFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t end) {
+    return offset <= end && count <= (end - offset) / elementSize;
+}
+
+} // namespace
+
+void CacheHash::add(const void* data, size_t bytes) {
+    const unsigned char* byte = (const unsigned char*)data;
+    for (size_t i = 0; i < bytes; i++) {
+        value ^= byte[i];
+        value *= 1099511628211ull;
+    }
+}
+
+void CacheHash::add(const char* text) {
+    add(text, strlen(text) + 1);
+}
+
+bool loadMeshCache(const std::string& path, uint64_t parameterHash, uint64_t layoutHash, uint32_t vertexStride,
+                   uint32_t indexSize, MappedFile& file, MeshCacheData& data) {
+    if (!file.openRead(path)) return false;
+
+    const char* problem = nullptr;
+    MeshCacheHeader header;
+    if (file.size() < sizeof(MeshCacheHeader)) {
+        problem = "truncated header";
+    } else {
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0) problem = "not a mesh cache";
+        else if (header.version != MESH_CACHE_VERSION || header.headerSize != sizeof(MeshCacheHeader)) problem = "old file format";
+        else if (header.parameterHash != parameterHash) problem = "generator parameters changed";
+        else if (header.layoutHash != layoutHash || header.vertexStride != vertexStride || header.indexSize != indexSize) problem = "vertex layout changed";
+        else if (header.vertexOffset < sizeof(header) || header.extraOffset > file.size() ||
+                 !blobFits(header.vertexOffset, header.vertexCount, vertexStride, header.indexOffset) ||
+                 !blobFits(header.indexOffset, header.indexCount, indexSize, header.extraOffset) ||
+                 header.extraBytes != file.size() - header.extraOffset) problem = "size does not match its header";
+    }
+    if (problem != nullptr) {
+        printf("Mesh cache %s is stale (%s), rebuilding it\n", path.c_str(), problem);
+        file.close();
+        return false;
+    }
+
+    data.vertices = file.data() + header.vertexOffset;
+    data.indices = file.data() + header.indexOffset;
+    data.extra = file.data() + header.extraOffset;
+    data.vertexCount = header.vertexCount;
+    data.indexCount = header.indexCount;
+    data.extraBytes = header.extraBytes;
+    data.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    data.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    return true;
+}
+
+MeshCacheWriter::~MeshCacheWriter() {
+    // Abandoned without commit()
+    if (file.isOpen()) {
+        file.close();
+        remove(temporaryPath.c_str());
+    }
+}
+
+bool MeshCacheWriter::create(const std::string& path, uint64_t parameterHash, uint64_t layoutHash, uint32_t vertexStride,
+                             uint64_t vertexCount, uint32_t indexSize, uint64_t indexCount, uint64_t extraBytes) {
+    size_t slash = path.find_last_of("/\\");
+    if (slash != std::string::npos) createDirectories(path.substr(0, slash));
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.headerSize = sizeof(MeshCacheHeader);
+    header.parameterHash = parameterHash;
+    header.layoutHash = layoutHash;
+    header.vertexStride = vertexStride;
+    header.indexSize = indexSize;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.extraBytes = extraBytes;
+    header.vertexOffset = alignBlob(sizeof(MeshCacheHeader));
+    header.indexOffset = alignBlob(header.vertexOffset + vertexCount * vertexStride);
+    header.extraOffset = alignBlob(header.indexOffset + indexCount * indexSize);
+
+    finalPath = path;
+    temporaryPath = path + ".tmp";
+    if (!file.create(temporaryPath, header.extraOffset + extraBytes)) {
+        printf("Could not create mesh cache %s, continuing without it\n", temporaryPath.c_str());
+        return false;
+    }
+
+    data.vertices = file.data() + header.vertexOffset;
+    data.indices = file.data() + header.indexOffset;
+    data.extra = file.data() + header.extraOffset;
+    data.vertexCount = vertexCount;
+    data.indexCount = indexCount;
+    data.extraBytes = extraBytes;
+    return true;
+}
+
+bool MeshCacheWriter::commit(glm::vec3 boundsMin, glm::vec3 boundsMax) {
+    if (!file.isOpen()) return false;
+
+    for (int axis = 0; axis < 3; axis++) {
+        header.boundsMin[axis] = boundsMin[axis];
+        header.boundsMax[axis] = boundsMax[axis];
+    }
+    memcpy(file.data(), &header, sizeof(header));
+    // The blobs have to be on disk before the file takes the final name, or a crash could leave a valid
+    // header in front of missing data
+    bool flushed = file.flush();
+    file.close();
+
+    if (!flushed) {
+        printf("Could not write mesh cache %s\n", temporaryPath.c_str());
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    if (!replaceFile(temporaryPath, finalPath)) {
+        printf("Could not move mesh cache into place at %s\n", finalPath.c_str());
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+#include "mappedFile.hpp"
+
+// Binary cache files for generated meshes, so the generators only run when their parameters change.
+//
+// A cache file is a MeshCacheHeader followed by three blobs: interleaved vertices, indices, and generator
+// specific extra data. The file is mapped into memory and the blobs are uploaded to the GPU straight from the
+// mapping. A file is only used if its format version, parameter hash, vertex layout and size all match, any
+// other file is stale and gets rebuilt.
+
+const char MESH_CACHE_DIRECTORY[] = "../res/cache/";
+
+// Bump when the file format changes
+const uint32_t MESH_CACHE_VERSION = 1;
+
+struct MeshCacheHeader {
+    char magic[8];              // "GVMESH" padded with zeroes
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t parameterHash;     // hash of everything the generator output depends on
+    uint64_t layoutHash;        // hash of the vertex layout description
+    uint32_t vertexStride;      // bytes
+    uint32_t indexSize;         // bytes
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t extraBytes;
+    uint64_t vertexOffset;      // blob offsets from the start of the file
+    uint64_t indexOffset;
+    uint64_t extraOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// FNV-1a, for building cache keys out of generator parameters
+struct CacheHash {
+    uint64_t value = 14695981039346656037ull;
+
+    void add(const void* data, size_t bytes);
+    void add(const char* text);
+    template <class T> void add(const T& scalar) { add(&scalar, sizeof(T)); }
+};
+
+// Pointers into a mapped cache file, or into a file that is being written
+struct MeshCacheData {
+    void* vertices = nullptr;
+    void* indices = nullptr;
+    void* extra = nullptr;
+    uint64_t vertexCount = 0;
+    uint64_t indexCount = 0;
+    uint64_t extraBytes = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// Maps the cache file at path and checks it against the expected key and layout. Prints why a file that
+// exists is not used. The returned pointers stay valid while file is open.
+bool loadMeshCache(const std::string& path, uint64_t parameterHash, uint64_t layoutHash, uint32_t vertexStride,
+                   uint32_t indexSize, MappedFile& file, MeshCacheData& data);
+
+// Writes a cache file in place: create() maps a temporary file of the final size so the generator can write
+// its output straight into data.vertices etc., and commit() adds the header and moves it over the old file.
+// A half written cache is never picked up, as the header is the last thing that is written.
+class MeshCacheWriter {
+public:
+    ~MeshCacheWriter();
+
+    bool create(const std::string& path, uint64_t parameterHash, uint64_t layoutHash, uint32_t vertexStride,
+                uint64_t vertexCount, uint32_t indexSize, uint64_t indexCount, uint64_t extraBytes);
+    bool commit(glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+    bool isOpen() const { return file.isOpen(); }
+    MeshCacheData data;
+
+private:
+    MappedFile file;
+    MeshCacheHeader header;
+    std::string finalPath;
+    std::string temporaryPath;
+};
@@ -0,0 +1,281 @@
+#include "meshOptimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <glm/glm.hpp>
+
+namespace {
+
+// Cache that optimizeVertexCache() optimizes for. Larger than the FIFO in the reports on purpose, Forsyth's
+// scoring works best with an LRU cache somewhat larger than the real one.
+const int FORSYTH_CACHE_SIZE = 32;
+const int FORSYTH_VALENCE_TABLE_SIZE = 32;
+
+// Score of a vertex for being at cachePosition (-1 if not cached) with `remaining` triangles left to draw.
+// Vertices of the last triangle get a fixed score so the next triangle does not simply reuse all three.
+float forsythVertexScore(int cachePosition, unsigned int remaining) {
+    if (remaining == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            score = 0.75f;
+        } else {
+            score = std::pow(1.0f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+        }
+    }
+    // Prefer vertices with few triangles left, so they are finished and do not have to be transformed again
+    score += 2.0f / std::sqrt((float)remaining);
+    return score;
+}
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount) {
+    VertexCacheStats stats;
+    stats.triangleCount = indexCount / 3;
+
+    // A vertex is in the FIFO if fewer than VERTEX_CACHE_FIFO_SIZE misses happened since it was loaded
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    std::vector<bool> seen(vertexCount, false);
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int vertex = indices[i];
+        if (!seen[vertex]) {
+            seen[vertex] = true;
+            stats.vertexCount++;
+        } else if (misses - loadedAt[vertex] < VERTEX_CACHE_FIFO_SIZE) {
+            continue;
+        }
+        loadedAt[vertex] = misses++;
+    }
+    stats.transformedCount = misses;
+    stats.acmr = stats.triangleCount > 0 ? misses / (float)stats.triangleCount : 0.0f;
+    stats.atvr = stats.vertexCount > 0 ? misses / (float)stats.vertexCount : 0.0f;
+    return stats;
+}
+
+void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) return;
+
+    float cacheScores[FORSYTH_CACHE_SIZE];
+    for (int position = 0; position < FORSYTH_CACHE_SIZE; position++) {
+        cacheScores[position] = forsythVertexScore(position, 1) - forsythVertexScore(-1, 1);
+    }
+    float valenceScores[FORSYTH_VALENCE_TABLE_SIZE];
+    for (int remaining = 0; remaining < FORSYTH_VALENCE_TABLE_SIZE; remaining++) {
+        valenceScores[remaining] = forsythVertexScore(-1, remaining);
+    }
+    auto vertexScore = [&](int cachePosition, unsigned int remaining) {
+        if (remaining == 0) return -1.0f;
+        float score = remaining < FORSYTH_VALENCE_TABLE_SIZE ? valenceScores[remaining] : forsythVertexScore(-1, remaining);
+        return cachePosition >= 0 ? score + cacheScores[cachePosition] : score;
+    };
+
+    // Triangles of every vertex, as ranges into one array. The first `remaining` of a range are not drawn yet.
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; i++) {
+        remaining[indices[i]]++;
+    }
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        adjacencyOffset[vertex + 1] = adjacencyOffset[vertex] + remaining[vertex];
+    }
+    std::vector<unsigned int> adjacency(indexCount);
+    std::vector<unsigned int> filled(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t i = 0; i < indexCount; i++) {
+        adjacency[filled[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        score[vertex] = vertexScore(-1, remaining[vertex]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        triangleScore[triangle] = score[indices[triangle * 3]] + score[indices[triangle * 3 + 1]] + score[indices[triangle * 3 + 2]];
+    }
+
+    std::vector<unsigned int> output(indexCount);
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    size_t bestTriangle = std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin();
+    size_t scanCursor = 0;
+    for (size_t drawn = 0; drawn < triangleCount; drawn++) {
+        if (bestTriangle == triangleCount) {
+            // Nothing in the cache has triangles left, continue with the first triangle not drawn yet
+            while (emitted[scanCursor]) scanCursor++;
+            bestTriangle = scanCursor;
+        }
+
+        const unsigned int* corners = indices + bestTriangle * 3;
+        emitted[bestTriangle] = true;
+        std::copy(corners, corners + 3, output.begin() + drawn * 3);
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int vertex = corners[corner];
+            unsigned int* first = &adjacency[adjacencyOffset[vertex]];
+            unsigned int* last = first + remaining[vertex] - 1;
+            *std::find(first, last + 1, (unsigned int)bestTriangle) = *last;
+            remaining[vertex]--;
+        }
+
+        // The triangle goes to the front of the LRU cache, everything pushed out past the end loses its cache score
+        nextCache.assign(corners, corners + 3);
+        for (unsigned int vertex : cache) {
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2]) nextCache.push_back(vertex);
+        }
+        std::swap(cache, nextCache);
+
+        for (size_t position = 0; position < cache.size(); position++) {
+            unsigned int vertex = cache[position];
+            cachePosition[vertex] = position < FORSYTH_CACHE_SIZE ? (int)position : -1;
+            float newScore = vertexScore(cachePosition[vertex], remaining[vertex]);
+            float change = newScore - score[vertex];
+            score[vertex] = newScore;
+            for (unsigned int i = 0; i < remaining[vertex]; i++) {
+                triangleScore[adjacency[adjacencyOffset[vertex] + i]] += change;
+            }
+        }
+        if (cache.size() > FORSYTH_CACHE_SIZE) cache.resize(FORSYTH_CACHE_SIZE);
+
+        // Only triangles of cached vertices changed score, so the best one is among them
+        bestTriangle = triangleCount;
+        float bestScore = -1e30f;
+        for (unsigned int vertex : cache) {
+            for (unsigned int i = 0; i < remaining[vertex]; i++) {
+                unsigned int triangle = adjacency[adjacencyOffset[vertex] + i];
+                if (triangleScore[triangle] > bestScore) {
+                    bestScore = triangleScore[triangle];
+                    bestTriangle = triangle;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride,
+                      size_t vertexCount) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) return;
+
+    auto position = [&](unsigned int vertex) {
+        const float* p = positions + vertex * positionStride;
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    // Split the triangles into clusters where the FIFO cache starts over anyway (a triangle with three misses),
+    // so moving the clusters around costs next to nothing in cache efficiency
+    std::vector<size_t> clusterStart;
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    std::vector<bool> seen(vertexCount, false);
+    size_t misses = 0;
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        int triangleMisses = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int vertex = indices[triangle * 3 + corner];
+            if (seen[vertex] && misses - loadedAt[vertex] < VERTEX_CACHE_FIFO_SIZE) continue;
+            seen[vertex] = true;
+            loadedAt[vertex] = misses++;
+            triangleMisses++;
+        }
+        if (triangle == 0 || triangleMisses == 3) clusterStart.push_back(triangle);
+    }
+    if (clusterStart.size() < 2) return;
+    clusterStart.push_back(triangleCount);
+
+    // Clusters far out from the middle of the mesh and facing away from it are likely to hide the others
+    size_t clusterCount = clusterStart.size() - 1;
+    std::vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+        float clusterArea = 0.0f;
+        for (size_t triangle = clusterStart[cluster]; triangle < clusterStart[cluster + 1]; triangle++) {
+            glm::vec3 a = position(indices[triangle * 3]);
+            glm::vec3 b = position(indices[triangle * 3 + 1]);
+            glm::vec3 c = position(indices[triangle * 3 + 2]);
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float area = glm::length(normal);
+            clusterCentroid[cluster] += (a + b + c) * (area / 3.0f);
+            clusterNormal[cluster] += normal;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroid[cluster];
+        meshArea += clusterArea;
+        clusterCentroid[cluster] = clusterArea > 0.0f ? clusterCentroid[cluster] / clusterArea : position(indices[clusterStart[cluster] * 3]);
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    std::vector<float> occluderScore(clusterCount);
+    std::vector<size_t> order(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+        float length = glm::length(clusterNormal[cluster]);
+        glm::vec3 normal = length > 0.0f ? clusterNormal[cluster] / length : glm::vec3(0.0f);
+        occluderScore[cluster] = glm::dot(clusterCentroid[cluster] - meshCentroid, normal);
+        order[cluster] = cluster;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return occluderScore[a] > occluderScore[b];
+    });
+
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    for (size_t cluster : order) {
+        output.insert(output.end(), indices + clusterStart[cluster] * 3, indices + clusterStart[cluster + 1] * 3);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+size_t optimizeVertexFetchRemap(std::vector<unsigned int>& remap, unsigned int* indices, size_t indexCount,
+                                size_t vertexCount) {
+    remap.assign(vertexCount, ~0u);
+    unsigned int next = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int& newIndex = remap[indices[i]];
+        if (newIndex == ~0u) newIndex = next++;
+        indices[i] = newIndex;
+    }
+    return next;
+}
+
+void remapVertices(void* vertices, size_t vertexCount, size_t vertexSize, const std::vector<unsigned int>& remap) {
+    unsigned char* bytes = (unsigned char*)vertices;
+    std::vector<unsigned char> original(bytes, bytes + vertexCount * vertexSize);
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        if (remap[vertex] == ~0u) continue;
+        memcpy(bytes + remap[vertex] * vertexSize, &original[vertex * vertexSize], vertexSize);
+    }
+}
+
+MeshOptimizationReport optimizeMesh(void* vertices, size_t vertexCount, size_t vertexSize, size_t positionOffset,
+                                    unsigned int* indices, size_t indexCount) {
+    MeshOptimizationReport report;
+    report.before = analyzeVertexCache(indices, indexCount, vertexCount);
+
+    optimizeVertexCache(indices, indexCount, vertexCount);
+    const float* positions = (const float*)((const unsigned char*)vertices + positionOffset);
+    optimizeOverdraw(indices, indexCount, positions, vertexSize / sizeof(float), vertexCount);
+
+    std::vector<unsigned int> remap;
+    report.vertexCount = optimizeVertexFetchRemap(remap, indices, indexCount, vertexCount);
+    remapVertices(vertices, vertexCount, vertexSize, remap);
+
+    report.after = analyzeVertexCache(indices, indexCount, report.vertexCount);
+    return report;
+}
+
+void printMeshOptimizationReport(const char* meshName, const MeshOptimizationReport& report) {
+    printf("%s: %zu triangles, %zu vertices. ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%i entry FIFO)\n",
+           meshName, report.after.triangleCount, report.after.vertexCount, report.before.acmr, report.after.acmr,
+           report.before.atvr, report.after.atvr, VERTEX_CACHE_FIFO_SIZE);
+}
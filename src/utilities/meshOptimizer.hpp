@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Reorders index and vertex buffers so the GPU does less work for the same triangles.
+//
+//  - optimizeVertexCache(): Forsyth's linear-speed vertex cache ordering, so triangles that share vertices are
+//    drawn close together and the post-transform cache catches more of them
+//  - optimizeOverdraw(): moves the outward facing clusters of triangles first, without undoing the cache order
+//  - optimizeVertexFetch(): puts the vertices in the order they are first used, so the vertex fetch reads
+//    memory front to back
+//
+// All of them work on plain triangle lists with 32 bit indices.
+
+// Post-transform cache simulation used for the reports, a 16 entry FIFO like most GPUs
+const int VERTEX_CACHE_FIFO_SIZE = 16;
+
+struct VertexCacheStats {
+    size_t triangleCount = 0;
+    size_t vertexCount = 0;         // distinct vertices referenced by the indices
+    size_t transformedCount = 0;    // cache misses
+    float acmr = 0.0f;              // average cache miss ratio, transformed vertices per triangle (0.5 - 3)
+    float atvr = 0.0f;              // average transformed vertex ratio, transformed per distinct vertex (1 is ideal)
+};
+
+struct MeshOptimizationReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    size_t vertexCount = 0;         // vertices left after optimizeVertexFetch() dropped the unused ones
+};
+
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+// Indices must be smaller than vertexCount
+void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+// Run after optimizeVertexCache(). positions points at the x of the first vertex, with positionStride floats
+// between vertices.
+void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride,
+                      size_t vertexCount);
+
+// Rewrites indices for the new vertex order and fills remap with the new index of every old vertex (~0u for
+// unused ones). Returns the number of vertices that are used.
+size_t optimizeVertexFetchRemap(std::vector<unsigned int>& remap, unsigned int* indices, size_t indexCount,
+                                size_t vertexCount);
+
+// Moves vertexSize byte vertices to their remapped slots, dropping the unused ones
+void remapVertices(void* vertices, size_t vertexCount, size_t vertexSize, const std::vector<unsigned int>& remap);
+
+// All three passes on an interleaved vertex buffer with float positions positionOffset bytes into each vertex.
+// The vertex count shrinks if some vertices were unused, see MeshOptimizationReport::vertexCount.
+MeshOptimizationReport optimizeMesh(void* vertices, size_t vertexCount, size_t vertexSize, size_t positionOffset,
+                                    unsigned int* indices, size_t indexCount);
+
+void printMeshOptimizationReport(const char* meshName, const MeshOptimizationReport& report);
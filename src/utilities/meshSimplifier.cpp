@@ -0,0 +1,269 @@
+#include "meshSimplifier.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include "meshOptimizer.hpp"
+
+namespace {
+
+// Sum of squared distances to a set of planes, weighted by triangle area: x^T A x + 2 b.x + c
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    double c = 0;
+    double weight = 0;
+
+    void addPlane(glm::dvec3 normal, double distance, double area) {
+        a00 += area * normal.x * normal.x;
+        a01 += area * normal.x * normal.y;
+        a02 += area * normal.x * normal.z;
+        a11 += area * normal.y * normal.y;
+        a12 += area * normal.y * normal.z;
+        a22 += area * normal.z * normal.z;
+        b0 += area * normal.x * distance;
+        b1 += area * normal.y * distance;
+        b2 += area * normal.z * distance;
+        c += area * distance * distance;
+        weight += area;
+    }
+
+    void add(const Quadric& other) {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02;
+        a11 += other.a11; a12 += other.a12; a22 += other.a22;
+        b0 += other.b0; b1 += other.b1; b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+    }
+
+    // Average squared distance of point to the planes
+    double error(glm::dvec3 p) const {
+        double quadratic = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                           2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z);
+        double value = quadratic + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return weight > 0.0 ? std::fabs(value) / weight : 0.0;
+    }
+};
+
+struct PositionKey {
+    uint32_t bits[3];
+    bool operator==(const PositionKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey& key) const {
+        return (size_t)(key.bits[0] * 73856093u ^ key.bits[1] * 19349663u ^ key.bits[2] * 83492791u);
+    }
+};
+
+struct Collapse {
+    unsigned int source;
+    unsigned int target;
+    double error;
+};
+
+} // namespace
+
+float simplifyMesh(std::vector<unsigned int>& result, const unsigned int* indices, size_t indexCount,
+                   const float* positions, size_t positionStride, size_t vertexCount,
+                   size_t targetIndexCount, float maxError) {
+    auto position = [&](unsigned int vertex) {
+        const float* p = positions + vertex * positionStride;
+        return glm::dvec3(p[0], p[1], p[2]);
+    };
+    result.assign(indices, indices + indexCount);
+
+    // Vertices that share their position with another one sit on a UV or normal seam, and vertices of edges
+    // that only have one triangle (or more than two) sit on a border. Neither kind may move.
+    std::vector<bool> locked(vertexCount, false);
+    std::unordered_map<PositionKey, unsigned int, PositionKeyHash> firstAtPosition;
+    for (unsigned int vertex = 0; vertex < vertexCount; vertex++) {
+        PositionKey key;
+        memcpy(key.bits, positions + vertex * positionStride, sizeof(key.bits));
+        auto inserted = firstAtPosition.emplace(key, vertex);
+        if (!inserted.second) {
+            locked[vertex] = true;
+            locked[inserted.first->second] = true;
+        }
+    }
+    std::unordered_map<uint64_t, int> edgeUses;
+    for (size_t i = 0; i < indexCount; i += 3) {
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int a = result[i + corner];
+            unsigned int b = result[i + (corner + 1) % 3];
+            edgeUses[(uint64_t)std::min(a, b) << 32 | std::max(a, b)]++;
+        }
+    }
+    for (const auto& edge : edgeUses) {
+        if (edge.second != 2) {
+            locked[edge.first >> 32] = true;
+            locked[edge.first & 0xffffffffu] = true;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indexCount; i += 3) {
+        glm::dvec3 a = position(result[i]), b = position(result[i + 1]), c = position(result[i + 2]);
+        glm::dvec3 normal = glm::cross(b - a, c - a);
+        double length = glm::length(normal);
+        if (length == 0.0) continue;
+        normal /= length;
+        for (int corner = 0; corner < 3; corner++) {
+            quadrics[result[i + corner]].addPlane(normal, -glm::dot(normal, a), length * 0.5);
+        }
+    }
+
+    double maxSquaredError = (double)maxError * maxError;
+    double resultError = 0.0;
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(vertexCount);
+    std::vector<unsigned int> collapseTarget(vertexCount);
+
+    // Each pass collapses the cheapest edges that do not share vertices, until the target or the error limit
+    while (result.size() > targetIndexCount) {
+        size_t triangleCount = result.size() / 3;
+
+        std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+        for (unsigned int vertex : result) adjacencyOffset[vertex + 1]++;
+        for (size_t vertex = 0; vertex < vertexCount; vertex++) adjacencyOffset[vertex + 1] += adjacencyOffset[vertex];
+        adjacency.resize(result.size());
+        std::vector<unsigned int> filled(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t i = 0; i < result.size(); i++) adjacency[filled[result[i]]++] = (unsigned int)(i / 3);
+
+        // The cheapest collapse of every vertex that may move
+        collapses.clear();
+        for (unsigned int source = 0; source < vertexCount; source++) {
+            if (locked[source] || adjacencyOffset[source] == adjacencyOffset[source + 1]) continue;
+            Collapse best = {source, source, 1e300};
+            for (unsigned int i = adjacencyOffset[source]; i < adjacencyOffset[source + 1]; i++) {
+                const unsigned int* triangle = &result[adjacency[i] * 3];
+                for (int corner = 0; corner < 3; corner++) {
+                    unsigned int target = triangle[corner];
+                    if (target == source) continue;
+                    Quadric combined = quadrics[source];
+                    combined.add(quadrics[target]);
+                    double error = combined.error(position(target));
+                    if (error < best.error) best = {source, target, error};
+                }
+            }
+            if (best.target != source && best.error <= maxSquaredError) collapses.push_back(best);
+        }
+        if (collapses.empty()) break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error || (a.error == b.error && a.source < b.source);
+        });
+
+        std::fill(touched.begin(), touched.end(), false);
+        for (unsigned int vertex = 0; vertex < vertexCount; vertex++) collapseTarget[vertex] = vertex;
+        size_t removedTriangles = 0;
+        size_t wantedTriangles = triangleCount - targetIndexCount / 3;
+        for (const Collapse& collapse : collapses) {
+            if (removedTriangles >= wantedTriangles) break;
+            if (touched[collapse.source] || touched[collapse.target]) continue;
+
+            // Reject collapses that flip one of the remaining triangles around the source
+            bool flips = false;
+            size_t removed = 0;
+            glm::dvec3 target = position(collapse.target);
+            for (unsigned int i = adjacencyOffset[collapse.source]; i < adjacencyOffset[collapse.source + 1] && !flips; i++) {
+                const unsigned int* triangle = &result[adjacency[i] * 3];
+                if (triangle[0] == collapse.target || triangle[1] == collapse.target || triangle[2] == collapse.target) {
+                    removed++;
+                    continue;
+                }
+                glm::dvec3 corners[3];
+                glm::dvec3 moved[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    corners[corner] = position(triangle[corner]);
+                    moved[corner] = triangle[corner] == collapse.source ? target : corners[corner];
+                }
+                glm::dvec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = glm::dot(before, after) <= 0.0;
+            }
+            if (flips) continue;
+
+            // Everything around the source changes shape, so none of it may be checked again in this pass
+            for (unsigned int i = adjacencyOffset[collapse.source]; i < adjacencyOffset[collapse.source + 1]; i++) {
+                const unsigned int* triangle = &result[adjacency[i] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+            collapseTarget[collapse.source] = collapse.target;
+            quadrics[collapse.target].add(quadrics[collapse.source]);
+            resultError = std::max(resultError, collapse.error);
+            removedTriangles += removed;
+        }
+        if (removedTriangles == 0) break;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            unsigned int a = collapseTarget[result[i]];
+            unsigned int b = collapseTarget[result[i + 1]];
+            unsigned int c = collapseTarget[result[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+    }
+
+    return (float)std::sqrt(resultError);
+}
+
+MeshLODSet buildMeshLODs(std::vector<unsigned int>& indices, const float* positions, size_t positionStride,
+                         size_t vertexCount, float maxErrorFraction) {
+    MeshLODSet lods;
+    glm::vec3 boundsMin(1e30f), boundsMax(-1e30f);
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        glm::vec3 p(positions[vertex * positionStride], positions[vertex * positionStride + 1], positions[vertex * positionStride + 2]);
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+    if (vertexCount > 0) {
+        lods.center = (boundsMin + boundsMax) * 0.5f;
+        lods.radius = glm::length(boundsMax - boundsMin) * 0.5f;
+    }
+    lods.levels.push_back({0, (unsigned int)indices.size(), 0.0f});
+
+    std::vector<unsigned int> current(indices);
+    std::vector<unsigned int> simplified;
+    float maxError = maxErrorFraction * lods.radius;
+    while ((int)lods.levels.size() < MAX_MESH_LODS) {
+        // The errors of consecutive levels add up, so each one may only use what the levels before it left
+        float errorBudget = maxError - lods.levels.back().error;
+        if (errorBudget <= 0.0f) break;
+        size_t target = current.size() / 6 * 3;
+        float error = lods.levels.back().error + simplifyMesh(simplified, current.data(), current.size(), positions,
+                                                              positionStride, vertexCount, target, errorBudget);
+        // Not worth a level of its own
+        if (simplified.empty() || simplified.size() > current.size() * 85 / 100) break;
+
+        optimizeVertexCache(simplified.data(), simplified.size(), vertexCount);
+        lods.levels.push_back({(unsigned int)indices.size(), (unsigned int)simplified.size(), error});
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+        current.swap(simplified);
+    }
+    return lods;
+}
+
+int selectMeshLOD(const MeshLODSet& lods, float pixelsPerUnit, float maxPixels) {
+    int level = 0;
+    while (level + 1 < (int)lods.levels.size() && lods.levels[level + 1].error * pixelsPerUnit <= maxPixels) {
+        level++;
+    }
+    return level;
+}
+
+void printMeshLODs(const char* meshName, const MeshLODSet& lods) {
+    printf("%s LODs:", meshName);
+    for (const MeshLOD& level : lods.levels) {
+        printf(" %u triangles (error %.3g)", level.indexCount / 3, level.error);
+        if (&level != &lods.levels.back()) printf(",");
+    }
+    printf(", radius %.3g\n", lods.radius);
+}
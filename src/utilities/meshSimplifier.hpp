@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Quadric error metric simplification (Garland & Heckbert) that only collapses edges onto existing vertices, so
+// every level of detail indexes the same vertex buffer and only needs its own range of indices.
+//
+// Vertices on open borders and on attribute seams (several vertices with the same position but a different
+// normal or UV) never move, so the silhouette and the texture mapping stay intact.
+
+const int MAX_MESH_LODS = 4;
+
+struct MeshLOD {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;                // how far the surface may have moved from full detail, in model units
+};
+
+// The levels of detail of one mesh, level 0 being the full mesh. All of them index the same vertices.
+struct MeshLODSet {
+    std::vector<MeshLOD> levels;
+    glm::vec3 center = glm::vec3(0.0f);    // bounding sphere in model units
+    float radius = 0.0f;
+};
+
+// Writes a simplified copy of a triangle list to result, with at most targetIndexCount indices unless that
+// would move the surface more than maxError. positions points at the x of vertex 0, positionStride floats apart.
+// Returns the error of the result in model units.
+float simplifyMesh(std::vector<unsigned int>& result, const unsigned int* indices, size_t indexCount,
+                   const float* positions, size_t positionStride, size_t vertexCount,
+                   size_t targetIndexCount, float maxError);
+
+// Builds up to MAX_MESH_LODS levels, each with about half the triangles of the one before, and appends the
+// indices of the new levels to indices (which hold level 0). Stops early once simplification stalls or a level
+// would move the surface by more than maxErrorFraction of the mesh radius.
+MeshLODSet buildMeshLODs(std::vector<unsigned int>& indices, const float* positions, size_t positionStride,
+                         size_t vertexCount, float maxErrorFraction = 0.05f);
+
+// Coarsest level whose error covers at most maxPixels on screen, where one model unit covers pixelsPerUnit
+int selectMeshLOD(const MeshLODSet& lods, float pixelsPerUnit, float maxPixels);
+
+void printMeshLODs(const char* meshName, const MeshLODSet& lods);
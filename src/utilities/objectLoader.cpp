@@ -1,10 +1,384 @@
 #include "objectLoader.hpp"
+#include "mappedFile.hpp"
+#include "meshCache.hpp"
+#include "threadPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
-bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+#include <unordered_map>
+
+namespace {
+
+// What the OBJ cache of a file was built from, stored as the extra blob of the cache file
+struct ObjCacheSource {
+    uint64_t size;
+    int64_t modifiedTime;
+    uint64_t contentHash;
+};
+
+// Files are only split into chunks of at least this size, below that the threads cost more than they save
+const size_t OBJ_MIN_CHUNK_BYTES = 1 << 20;
+
+// One face corner: 1-based v/vt/vn indices, 0 when the corner has no texture coordinate or normal
+struct ObjCorner {
+    int position;
+    int texCoord;
+    int normal;
+
+    bool operator==(const ObjCorner& other) const {
+        return position == other.position && texCoord == other.texCoord && normal == other.normal;
+    }
+};
+
+struct ObjCornerHash {
+    size_t operator()(const ObjCorner& corner) const {
+        size_t hash = (size_t)corner.position * 73856093u;
+        hash ^= (size_t)corner.texCoord * 19349663u;
+        hash ^= (size_t)corner.normal * 83492791u;
+        return hash;
+    }
+};
+
+// Set of distinct face corners for loadOBJ(), numbered in the order they were first inserted. Open addressing
+// in flat arrays: std::unordered_map allocates a node per vertex and chases a pointer per lookup, which was
+// most of the parse time for large meshes.
+const unsigned int NO_CORNER = ~0u;
+
+class ObjCornerTable {
+public:
+    explicit ObjCornerTable(size_t expectedCorners) {
+        size_t capacity = 64;
+        while (capacity < expectedCorners * 2) capacity *= 2;
+        slots.assign(capacity, NO_CORNER);
+        entries.reserve(expectedCorners);
+    }
+
+    // Number of corner in corners(), which is appended if it is new
+    unsigned int insert(const ObjCorner& corner) {
+        if ((entries.size() + 1) * 2 > slots.size()) grow();
+        size_t mask = slots.size() - 1;
+        for (size_t slot = hash(corner) & mask; ; slot = (slot + 1) & mask) {
+            unsigned int entry = slots[slot];
+            if (entry == NO_CORNER) {
+                slots[slot] = (unsigned int)entries.size();
+                entries.push_back(corner);
+                return slots[slot];
+            }
+            if (entries[entry] == corner) return entry;
+        }
+    }
+
+    const std::vector<ObjCorner>& corners() const { return entries; }
+
+private:
+    static size_t hash(const ObjCorner& corner) {
+        uint64_t key = (uint64_t)(uint32_t)corner.position * 0x9E3779B97F4A7C15ull;
+        key ^= ((uint64_t)(uint32_t)corner.texCoord << 32 | (uint32_t)corner.normal) * 0xC2B2AE3D27D4EB4Full;
+        return (size_t)(key ^ (key >> 29));
+    }
+
+    void grow() {
+        slots.assign(slots.size() * 2, NO_CORNER);
+        size_t mask = slots.size() - 1;
+        for (unsigned int entry = 0; entry < entries.size(); entry++) {
+            size_t slot = hash(entries[entry]) & mask;
+            while (slots[slot] != NO_CORNER) slot = (slot + 1) & mask;
+            slots[slot] = entry;
+        }
+    }
+
+    std::vector<unsigned int> slots;    // entry numbers, NO_CORNER for free slots
+    std::vector<ObjCorner> entries;
+};
+
+// Whitespace as std::istream sees it, and getline() leaves a '\r' at the end of Windows lines which the stream
+// then skips the same way
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char* skipSpace(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) p++;
+    return p;
+}
+
+inline const char* skipToken(const char* p, const char* end) {
+    while (p < end && !isSpace(*p)) p++;
+    return p;
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Parses a float at p like `stream >> value` does and returns the end of the number, or nullptr if there is
+// none. Numbers with up to 19 significant digits and small exponents, which is everything an exporter writes,
+// are converted with one correctly rounded double operation (Clinger's fast path). The rest goes to strtof().
+const char* parseFloat(const char* p, const char* end, float& value) {
+    static const double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    while (p < end && *p == '0') {
+        p++;
+        anyDigits = true;
+    }
+    for (; p < end && isDigit(*p); p++) {
+        if (digits < 19) mantissa = mantissa * 10 + (*p - '0');
+        else exponent++;
+        digits++;
+        anyDigits = true;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (digits == 0) {
+            while (p < end && *p == '0') {
+                p++;
+                exponent--;
+                anyDigits = true;
+            }
+        }
+        for (; p < end && isDigit(*p); p++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+            digits++;
+            anyDigits = true;
+        }
+    }
+    if (!anyDigits) return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        if (p < end && isDigit(*p)) {
+            int written = 0;
+            for (; p < end && isDigit(*p); p++) {
+                if (written < 100000) written = written * 10 + (*p - '0');
+            }
+            exponent += negativeExponent ? -written : written;
+        } else {
+            // The stream fails on "1e" and "1e+" rather than reading the 1
+            return nullptr;
+        }
+    }
+
+    if (digits <= 19 && mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double exact = exponent >= 0 ? (double)mantissa * powersOf10[exponent] : (double)mantissa / powersOf10[-exponent];
+        if (exponent >= 0 && exact >= 9007199254740992.0) {
+            // The product was rounded, fall through to strtof()
+        } else if (exact == 0.0 || (exact >= 1.1754943508222875e-38 && exact <= 3.4028234663852886e+38)) {
+            // Rounding the double to a float rounds twice, which only goes wrong when the double lands (almost)
+            // exactly halfway between two floats
+            uint64_t bits;
+            memcpy(&bits, &exact, sizeof(bits));
+            uint64_t dropped = bits & ((1ull << 29) - 1);
+            uint64_t halfway = 1ull << 28;
+            if (dropped + 1 < halfway || dropped > halfway + 1) {
+                value = negative ? -(float)exact : (float)exact;
+                return p;
+            }
+        }
+    }
+
+    char buffer[128];
+    size_t length = std::min((size_t)(p - start), sizeof(buffer) - 1);
+    memcpy(buffer, start, length);
+    buffer[length] = 0;
+    value = strtof(buffer, nullptr);
+    return p;
+}
+
+// Parses a face index like std::stoi(): an optional sign followed by digits, anything after them is ignored
+bool parseIndex(const char* p, const char* end, int& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end || !isDigit(*p)) return false;
+    long long result = 0;
+    for (; p < end && isDigit(*p); p++) {
+        result = result * 10 + (*p - '0');
+        if (result > (long long)INT_MAX + 1) return false;
+    }
+    result = negative ? -result : result;
+    if (result > INT_MAX || result < INT_MIN) return false;
+    value = (int)result;
+    return true;
+}
+
+// Line type of an OBJ line, from the first token
+enum class ObjLine { Position, TexCoord, Normal, Face, Other };
+
+ObjLine objLineType(const char* token, const char* tokenEnd) {
+    size_t length = tokenEnd - token;
+    if (length == 1 && token[0] == 'v') return ObjLine::Position;
+    if (length == 1 && token[0] == 'f') return ObjLine::Face;
+    if (length == 2 && token[0] == 'v' && token[1] == 't') return ObjLine::TexCoord;
+    if (length == 2 && token[0] == 'v' && token[1] == 'n') return ObjLine::Normal;
+    return ObjLine::Other;
+}
+
+inline const char* lineEnd(const char* p, const char* end) {
+    const char* newline = (const char*)memchr(p, '\n', end - p);
+    return newline != nullptr ? newline : end;
+}
+
+// A run of whole lines of an OBJ file that is parsed on its own
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+
+    // Elements defined in the chunk, and the index of its first ones in the whole file
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0, triangleCount = 0;
+    size_t firstPosition = 0, firstTexCoord = 0, firstNormal = 0, firstTriangle = 0;
+
+    // Distinct corners of the chunk. The chunk's triangles index into corners() until they are merged.
+    ObjCornerTable cornerTable{0};
+    std::vector<unsigned int> globalCorner;    // number of every corner in the merged table
+    std::string error;
+};
+
+void countObjChunk(ObjChunk& chunk) {
+    for (const char* line = chunk.begin; line < chunk.end; line = lineEnd(line, chunk.end) + 1) {
+        const char* eol = lineEnd(line, chunk.end);
+        const char* token = skipSpace(line, eol);
+        const char* tokenEnd = skipToken(token, eol);
+        switch (objLineType(token, tokenEnd)) {
+        case ObjLine::Position: chunk.positionCount++; break;
+        case ObjLine::TexCoord: chunk.texCoordCount++; break;
+        case ObjLine::Normal:   chunk.normalCount++; break;
+        case ObjLine::Face: {
+            size_t corners = 0;
+            for (const char* p = skipSpace(tokenEnd, eol); p < eol; p = skipSpace(skipToken(p, eol), eol)) corners++;
+            if (corners >= 3) chunk.triangleCount += corners - 2;
+            break;
+        }
+        case ObjLine::Other: break;
+        }
+    }
+}
+
+// Writes the chunk's positions, UVs and normals to their place in the file wide arrays, and its triangles to
+// its place in indices, as numbers of the chunk's own distinct corners. Faces may only use elements defined
+// above them, like in the reference parser.
+void parseObjChunk(ObjChunk& chunk, Vec3* positions, Vec2* texCoords, Vec3* normals, unsigned int* indices) {
+    size_t positionCount = chunk.firstPosition;
+    size_t texCoordCount = chunk.firstTexCoord;
+    size_t normalCount = chunk.firstNormal;
+    unsigned int* triangleCorner = indices + chunk.firstTriangle * 3;
+    chunk.cornerTable = ObjCornerTable(chunk.triangleCount);
+    std::vector<unsigned int> faceCorners;
+
+    for (const char* line = chunk.begin; line < chunk.end; line = lineEnd(line, chunk.end) + 1) {
+        const char* eol = lineEnd(line, chunk.end);
+        const char* token = skipSpace(line, eol);
+        const char* tokenEnd = skipToken(token, eol);
+        ObjLine type = objLineType(token, tokenEnd);
+
+        if (type == ObjLine::Position || type == ObjLine::Normal || type == ObjLine::TexCoord) {
+            // Like the stream, a missing or broken component reads as 0 and so does everything after it
+            float components[3] = {0.0f, 0.0f, 0.0f};
+            int componentCount = type == ObjLine::TexCoord ? 2 : 3;
+            const char* p = tokenEnd;
+            for (int i = 0; i < componentCount; i++) {
+                p = parseFloat(skipSpace(p, eol), eol, components[i]);
+                if (p == nullptr) break;
+            }
+            if (type == ObjLine::Position) positions[positionCount++] = {components[0], components[1], components[2]};
+            else if (type == ObjLine::Normal) normals[normalCount++] = {components[0], components[1], components[2]};
+            else texCoords[texCoordCount++] = {components[0], components[1]};
+        } else if (type == ObjLine::Face) {
+            faceCorners.clear();
+            for (const char* p = skipSpace(tokenEnd, eol); p < eol; p = skipSpace(p, eol)) {
+                const char* cornerEnd = skipToken(p, eol);
+                const char* firstSlash = (const char*)memchr(p, '/', cornerEnd - p);
+                const char* secondSlash = firstSlash != nullptr ? (const char*)memchr(firstSlash + 1, '/', cornerEnd - firstSlash - 1) : nullptr;
+
+                // Same formats as the reference parser: v, v//vn, v/vt and v/vt/vn
+                const char* vEnd = firstSlash != nullptr ? firstSlash : cornerEnd;
+                const char* vt = nullptr;
+                const char* vtEnd = nullptr;
+                const char* vn = nullptr;
+                if (firstSlash != nullptr) {
+                    vt = firstSlash + 1;
+                    vtEnd = secondSlash != nullptr ? secondSlash : cornerEnd;
+                    if (secondSlash != nullptr) vn = secondSlash + 1;
+                }
+
+                ObjCorner corner = {0, 0, 0};
+                bool valid = parseIndex(p, vEnd, corner.position);
+                if (valid && vt != nullptr && vt < vtEnd) valid = parseIndex(vt, vtEnd, corner.texCoord);
+                if (valid && vn != nullptr && vn < cornerEnd) valid = parseIndex(vn, cornerEnd, corner.normal);
+                valid = valid && corner.position >= 1 && (size_t)corner.position <= positionCount &&
+                        (corner.texCoord == 0 || (corner.texCoord >= 1 && (size_t)corner.texCoord <= texCoordCount)) &&
+                        (corner.normal == 0 || (corner.normal >= 1 && (size_t)corner.normal <= normalCount));
+                if (!valid) {
+                    chunk.error = "Failed to parse face: " + std::string(p, cornerEnd) + " | index out of range or not a number";
+                    return;
+                }
+                faceCorners.push_back(chunk.cornerTable.insert(corner));
+                p = cornerEnd;
+            }
+
+            // Triangulate polygon (fan method)
+            for (size_t i = 1; i + 1 < faceCorners.size(); ++i) {
+                *triangleCorner++ = faceCorners[0];
+                *triangleCorner++ = faceCorners[i];
+                *triangleCorner++ = faceCorners[i + 1];
+            }
+        }
+    }
+}
+
+// Runs body(chunk) for every chunk. Thread t takes chunks t, t + threads, ... so the heavy face lines at the end
+// of a file are spread over all threads.
+template <class Body>
+void forEachObjChunk(ThreadPool& pool, std::vector<ObjChunk>& chunks, Body body) {
+    int threads = (int)pool.size();
+    pool.parallelFor(0, threads, [&](int threadBegin, int threadEnd) {
+        for (int thread = threadBegin; thread < threadEnd; thread++) {
+            for (size_t chunk = thread; chunk < chunks.size(); chunk += threads) {
+                body(chunks[chunk]);
+            }
+        }
+    });
+}
+
+uint64_t hashFileContent(const std::string& path) {
+    MappedFile file;
+    CacheHash hash;
+    if (file.openRead(path)) hash.add(file.data(), file.size());
+    return hash.value;
+}
+
+} // namespace
+
+bool loadOBJReference(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
     std::ifstream file(filePath);
     if (!file.is_open()) {
         std::cerr << "Failed to open OBJ file: " << filePath << std::endl;
@@ -15,6 +389,9 @@ bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::ve
     std::vector<Vec3> normals;
     std::vector<Vec2> texCoords;
 
+    // Corners that share all three indices are the same vertex, so every one of them is only stored once
+    std::unordered_map<ObjCorner, unsigned int, ObjCornerHash> cornerVertex;
+
     std::string line;
     while (std::getline(file, line)) {
         std::istringstream ss(line);
@@ -34,11 +411,9 @@ bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::ve
             ss >> norm.x >> norm.y >> norm.z;
             normals.push_back(norm);
         } else if (prefix == "f") {
-            std::vector<Vertex> faceVertices;
+            std::vector<unsigned int> faceVertices;
             std::string token;
             while (ss >> token) {
-                Vertex vert{};
-                std::istringstream vss(token);
                 std::string vIdx, vtIdx, vnIdx;
 
                 size_t firstSlash = token.find('/');
@@ -66,11 +441,22 @@ bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::ve
                         vnIdx = token.substr(secondSlash + 1);
                     }
 
-                    vert.position = positions.at(std::stoi(vIdx) - 1);
-                    if (!vtIdx.empty()) vert.texCoord = texCoords.at(std::stoi(vtIdx) - 1);
-                    if (!vnIdx.empty()) vert.normal = normals.at(std::stoi(vnIdx) - 1);
+                    ObjCorner corner;
+                    corner.position = std::stoi(vIdx);
+                    corner.texCoord = vtIdx.empty() ? 0 : std::stoi(vtIdx);
+                    corner.normal = vnIdx.empty() ? 0 : std::stoi(vnIdx);
+
+                    auto found = cornerVertex.find(corner);
+                    if (found == cornerVertex.end()) {
+                        Vertex vert{};
+                        vert.position = positions.at(corner.position - 1);
+                        if (corner.texCoord != 0) vert.texCoord = texCoords.at(corner.texCoord - 1);
+                        if (corner.normal != 0) vert.normal = normals.at(corner.normal - 1);
 
-                    faceVertices.push_back(vert);
+                        found = cornerVertex.emplace(corner, static_cast<unsigned int>(vertices.size())).first;
+                        vertices.push_back(vert);
+                    }
+                    faceVertices.push_back(found->second);
                 } catch (const std::exception& e) {
                     std::cerr << "Failed to parse face: " << token << " | " << e.what() << std::endl;
                     return false;
@@ -79,13 +465,9 @@ bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::ve
 
             // Triangulate polygon (fan method)
             for (size_t i = 1; i + 1 < faceVertices.size(); ++i) {
-                vertices.push_back(faceVertices[0]);
-                vertices.push_back(faceVertices[i]);
-                vertices.push_back(faceVertices[i + 1]);
-
-                indices.push_back(static_cast<unsigned int>(indices.size()));
-                indices.push_back(static_cast<unsigned int>(indices.size()));
-                indices.push_back(static_cast<unsigned int>(indices.size()));
+                indices.push_back(faceVertices[0]);
+                indices.push_back(faceVertices[i]);
+                indices.push_back(faceVertices[i + 1]);
             }
         }
     }
@@ -93,3 +475,212 @@ bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::ve
     file.close();
     return true;
 }
+
+bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    return loadOBJ(filePath, vertices, indices, workerPool());
+}
+
+bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, ThreadPool& pool) {
+    MappedFile file;
+    if (!file.openRead(filePath)) {
+        // Empty files cannot be mapped, but they are valid (empty) meshes
+        std::ifstream probe(filePath);
+        if (!probe.is_open()) {
+            std::cerr << "Failed to open OBJ file: " << filePath << std::endl;
+            return false;
+        }
+        std::cout << "Loaded " << filePath << ": 0 triangles" << std::endl;
+        return true;
+    }
+    const char* begin = (const char*)file.data();
+    const char* end = begin + file.size();
+
+    // A few chunks per thread, each ending after a newline. Small files get one chunk.
+    size_t chunkCount = std::min((size_t)pool.size() * 4, file.size() / OBJ_MIN_CHUNK_BYTES + 1);
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* chunkBegin = begin;
+    for (size_t i = 0; i < chunkCount; i++) {
+        const char* chunkEnd = end;
+        if (i + 1 < chunkCount) {
+            chunkEnd = std::max(begin + file.size() * (i + 1) / chunkCount, chunkBegin);
+            chunkEnd = std::min(lineEnd(chunkEnd, end) + 1, end);
+        }
+        chunks[i].begin = chunkBegin;
+        chunks[i].end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    // Count everything first, so every array is allocated once and each chunk knows where its elements go
+    forEachObjChunk(pool, chunks, countObjChunk);
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0, triangleCount = 0;
+    for (ObjChunk& chunk : chunks) {
+        chunk.firstPosition = positionCount;
+        chunk.firstTexCoord = texCoordCount;
+        chunk.firstNormal = normalCount;
+        chunk.firstTriangle = triangleCount;
+        positionCount += chunk.positionCount;
+        texCoordCount += chunk.texCoordCount;
+        normalCount += chunk.normalCount;
+        triangleCount += chunk.triangleCount;
+    }
+
+    std::vector<Vec3> positions(positionCount);
+    std::vector<Vec3> normals(normalCount);
+    std::vector<Vec2> texCoords(texCoordCount);
+    size_t firstIndex = indices.size();
+    indices.resize(firstIndex + triangleCount * 3);
+    unsigned int* triangleCorners = indices.data() + firstIndex;
+
+    forEachObjChunk(pool, chunks, [&](ObjChunk& chunk) {
+        parseObjChunk(chunk, positions.data(), texCoords.data(), normals.data(), triangleCorners);
+    });
+    for (const ObjChunk& chunk : chunks) {
+        if (!chunk.error.empty()) {
+            std::cerr << chunk.error << std::endl;
+            indices.resize(firstIndex);
+            return false;
+        }
+    }
+
+    // Number the corners in the order they first appear in the file, the same vertex order a sequential parse
+    // gives. A chunk's corners are in that order already, so merging the chunks one after the other is enough,
+    // and only has to look at each chunk's distinct corners.
+    const std::vector<ObjCorner>* corners = &chunks[0].cornerTable.corners();
+    ObjCornerTable mergedTable(chunkCount > 1 ? positionCount : 0);
+    if (chunkCount > 1) {
+        for (ObjChunk& chunk : chunks) {
+            chunk.globalCorner.reserve(chunk.cornerTable.corners().size());
+            for (const ObjCorner& corner : chunk.cornerTable.corners()) {
+                chunk.globalCorner.push_back(mergedTable.insert(corner));
+            }
+        }
+        corners = &mergedTable.corners();
+    }
+
+    size_t firstVertex = vertices.size();
+    vertices.resize(firstVertex + corners->size());
+    forEachObjChunk(pool, chunks, [&](ObjChunk& chunk) {
+        unsigned int* corner = triangleCorners + chunk.firstTriangle * 3;
+        for (size_t i = 0; i < chunk.triangleCount * 3; i++) {
+            unsigned int number = chunkCount > 1 ? chunk.globalCorner[corner[i]] : corner[i];
+            corner[i] = (unsigned int)firstVertex + number;
+        }
+    });
+    pool.parallelFor(0, (int)corners->size(), [&](int cornerBegin, int cornerEnd) {
+        for (int i = cornerBegin; i < cornerEnd; i++) {
+            const ObjCorner& corner = (*corners)[i];
+            Vertex vert{};
+            vert.position = positions[corner.position - 1];
+            if (corner.texCoord != 0) vert.texCoord = texCoords[corner.texCoord - 1];
+            if (corner.normal != 0) vert.normal = normals[corner.normal - 1];
+            vertices[firstVertex + i] = vert;
+        }
+    });
+
+    std::cout << "Loaded " << filePath << ": " << triangleCount << " triangles, " << corners->size()
+              << " unique vertices (" << triangleCount * 3 << " before welding)" << std::endl;
+    return true;
+}
+
+bool loadCachedOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    auto startTime = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    };
+
+    ObjCacheSource source;
+    if (!fileSizeAndTime(filePath, source.size, source.modifiedTime)) {
+        // Let the loader report the missing file
+        return loadOBJ(filePath, vertices, indices);
+    }
+
+    CacheHash key;
+    key.add("obj v1");
+    key.add(filePath.c_str());
+    CacheHash layout;
+    layout.add("position 3f, normal 3f, uv 2f");
+    size_t slash = filePath.find_last_of("/\\");
+    char keyText[17];
+    snprintf(keyText, sizeof(keyText), "%016llx", (unsigned long long)key.value);
+    std::string cachePath = std::string(MESH_CACHE_DIRECTORY) + filePath.substr(slash == std::string::npos ? 0 : slash + 1) +
+                            "-" + keyText + ".bin";
+
+    size_t firstVertex = vertices.size();
+    MappedFile cacheFile;
+    MeshCacheData cached;
+    if (loadMeshCache(cachePath, key.value, layout.value, sizeof(Vertex), sizeof(unsigned int), cacheFile, cached)) {
+        ObjCacheSource cachedSource = {0, 0, 0};
+        if (cached.extraBytes == sizeof(ObjCacheSource)) memcpy(&cachedSource, cached.extra, sizeof(cachedSource));
+
+        // Only hash the file if it was touched, which is the only way to tell a touched file from an edited one
+        // of the same size
+        bool fresh = cachedSource.size == source.size && cachedSource.modifiedTime == source.modifiedTime;
+        bool touched = false;
+        if (!fresh && cachedSource.size == source.size) {
+            source.contentHash = hashFileContent(filePath);
+            fresh = touched = source.contentHash == cachedSource.contentHash;
+        }
+
+        if (fresh) {
+            const Vertex* cachedVertices = (const Vertex*)cached.vertices;
+            const unsigned int* cachedIndices = (const unsigned int*)cached.indices;
+            vertices.insert(vertices.end(), cachedVertices, cachedVertices + cached.vertexCount);
+            indices.reserve(indices.size() + cached.indexCount);
+            for (uint64_t i = 0; i < cached.indexCount; i++) {
+                indices.push_back((unsigned int)firstVertex + cachedIndices[i]);
+            }
+
+            if (touched) {
+                // Same content with a new time, store the new time so the next start does not hash it again
+                MeshCacheWriter cacheWriter;
+                if (cacheWriter.create(cachePath, key.value, layout.value, sizeof(Vertex), cached.vertexCount,
+                                       sizeof(unsigned int), cached.indexCount, sizeof(ObjCacheSource))) {
+                    memcpy(cacheWriter.data.vertices, cached.vertices, cached.vertexCount * sizeof(Vertex));
+                    memcpy(cacheWriter.data.indices, cached.indices, cached.indexCount * sizeof(unsigned int));
+                    memcpy(cacheWriter.data.extra, &source, sizeof(source));
+                    // Windows cannot replace a file that is still mapped
+                    cacheFile.close();
+                    cacheWriter.commit(cached.boundsMin, cached.boundsMax);
+                }
+            }
+
+            printf("OBJ %s loaded in %.1f ms (cache hit%s: %s, %llu vertices, %llu triangles)\n", filePath.c_str(),
+                   elapsedMs(), touched ? ", source touched but unchanged" : "", cachePath.c_str(),
+                   (unsigned long long)cached.vertexCount, (unsigned long long)cached.indexCount / 3);
+            return true;
+        }
+        printf("Mesh cache %s is stale (source file changed), rebuilding it\n", cachePath.c_str());
+        cacheFile.close();
+    }
+
+    size_t firstIndex = indices.size();
+    if (!loadOBJ(filePath, vertices, indices)) return false;
+    double parseMs = elapsedMs();
+
+    size_t vertexCount = vertices.size() - firstVertex;
+    size_t indexCount = indices.size() - firstIndex;
+    glm::vec3 boundsMin(vertexCount > 0 ? 1e30f : 0.0f);
+    glm::vec3 boundsMax(vertexCount > 0 ? -1e30f : 0.0f);
+    for (size_t i = firstVertex; i < vertices.size(); i++) {
+        glm::vec3 position(vertices[i].position.x, vertices[i].position.y, vertices[i].position.z);
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+    source.contentHash = hashFileContent(filePath);
+
+    MeshCacheWriter cacheWriter;
+    if (cacheWriter.create(cachePath, key.value, layout.value, sizeof(Vertex), vertexCount, sizeof(unsigned int), indexCount,
+                           sizeof(ObjCacheSource))) {
+        memcpy(cacheWriter.data.vertices, vertices.data() + firstVertex, vertexCount * sizeof(Vertex));
+        unsigned int* cachedIndices = (unsigned int*)cacheWriter.data.indices;
+        for (size_t i = 0; i < indexCount; i++) {
+            cachedIndices[i] = indices[firstIndex + i] - (unsigned int)firstVertex;
+        }
+        memcpy(cacheWriter.data.extra, &source, sizeof(source));
+        cacheWriter.commit(boundsMin, boundsMax);
+    }
+
+    printf("OBJ %s parsed in %.1f ms, %.1f ms with the cache file (cache miss: %s)\n", filePath.c_str(), parseMs,
+           elapsedMs(), cachePath.c_str());
+    return true;
+}
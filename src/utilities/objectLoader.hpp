@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+class ThreadPool;
+
 // Definer strukturer slik at de er tilgjengelige i gamelogic.cpp
 struct Vec3 {
     float x, y, z;
@@ -20,6 +22,19 @@ struct Vertex {
 };
 
 // Deklarasjon av loadOBJ()
+// Appends an indexed mesh: corners with the same v/vt/vn indices share one vertex. Polygons are fanned into triangles.
+// The file is memory mapped and parsed in place, in chunks on the threads of workerPool() (or pool). The result
+// does not depend on the number of threads.
 bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+bool loadOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, ThreadPool& pool);
+
+// loadOBJ() with a binary cache in MESH_CACHE_DIRECTORY (see meshCache.hpp). The first load writes the parsed
+// mesh to it, later loads copy it straight out of the mapped cache file. A cache file is rebuilt when the size of
+// the OBJ file changes, or when its modification time changes and so does the hash of its content.
+bool loadCachedOBJ(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// The original std::istream based parser. Gives the same results as loadOBJ(), only much slower. Kept as the
+// reference for the obj benchmark.
+bool loadOBJReference(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
 
 #endif 
@@ -0,0 +1,298 @@
+#include "perlinNoise.hpp"
+#include <cstdint>
+
+// This is the only translation unit that compiles stb_perlin, since the kernels below need its tables
+#define STB_PERLIN_IMPLEMENTATION
+#include "stb_perlin.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PERLIN_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PERLIN_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// stb's permutation table widened to 32 bits so it can be gathered, and the gradient basis vector of
+// every permutation entry looked up ahead of time, which saves one level of indirection per corner.
+struct PerlinTables {
+    int32_t hash[512];
+    float gradX[512];
+    float gradY[512];
+    float gradZ[512];
+};
+
+PerlinTables buildPerlinTables() {
+    PerlinTables tables;
+    for (int i = 0; i < 512; i++) {
+        int gradIdx = stb__perlin_randtab_grad_idx[i];
+        tables.hash[i] = stb__perlin_randtab[i];
+        tables.gradX[i] = stb__perlin_grad(gradIdx, 1, 0, 0);
+        tables.gradY[i] = stb__perlin_grad(gradIdx, 0, 1, 0);
+        tables.gradZ[i] = stb__perlin_grad(gradIdx, 0, 0, 1);
+    }
+    return tables;
+}
+
+const PerlinTables tables = buildPerlinTables();
+
+void noiseScalar(const float* x, const float* y, const float* z, float* out, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = stb_perlin_noise3(x[i], y[i], z[i], 0, 0, 0);
+    }
+}
+
+#ifdef PERLIN_HAS_SSE2
+
+inline __m128 easeSSE2(__m128 a) {
+    // ((a*6-15)*a + 10) * a * a * a, evaluated left to right like stb__perlin_ease
+    __m128 r = _mm_sub_ps(_mm_mul_ps(a, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+    r = _mm_add_ps(_mm_mul_ps(r, a), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(r, a), a), a);
+}
+
+inline __m128 lerpSSE2(__m128 a, __m128 b, __m128 t) {
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// Same as stb__perlin_fastfloor: truncate, then step down if we rounded towards zero from below
+inline __m128i floorSSE2(__m128 a) {
+    __m128i truncated = _mm_cvttps_epi32(a);
+    __m128 roundedDown = _mm_cmplt_ps(a, _mm_cvtepi32_ps(truncated));
+    return _mm_add_epi32(truncated, _mm_castps_si128(roundedDown)); // mask is -1 where a < trunc(a)
+}
+
+void noiseSSE2(const float* xs, const float* ys, const float* zs, float* out, int count) {
+    const __m128i mask = _mm_set1_epi32(255);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128 onef = _mm_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 y = _mm_loadu_ps(ys + i);
+        __m128 z = _mm_loadu_ps(zs + i);
+
+        __m128i px = floorSSE2(x);
+        __m128i py = floorSSE2(y);
+        __m128i pz = floorSSE2(z);
+
+        alignas(16) int32_t x0[4], x1[4], y0[4], y1[4], z0[4], z1[4];
+        _mm_store_si128((__m128i*)x0, _mm_and_si128(px, mask));
+        _mm_store_si128((__m128i*)x1, _mm_and_si128(_mm_add_epi32(px, one), mask));
+        _mm_store_si128((__m128i*)y0, _mm_and_si128(py, mask));
+        _mm_store_si128((__m128i*)y1, _mm_and_si128(_mm_add_epi32(py, one), mask));
+        _mm_store_si128((__m128i*)z0, _mm_and_si128(pz, mask));
+        _mm_store_si128((__m128i*)z1, _mm_and_si128(_mm_add_epi32(pz, one), mask));
+
+        x = _mm_sub_ps(x, _mm_cvtepi32_ps(px));
+        y = _mm_sub_ps(y, _mm_cvtepi32_ps(py));
+        z = _mm_sub_ps(z, _mm_cvtepi32_ps(pz));
+        __m128 u = easeSSE2(x);
+        __m128 v = easeSSE2(y);
+        __m128 w = easeSSE2(z);
+
+        // SSE2 has no gather, so the hashing is done per lane into corner-major gradient arrays
+        alignas(16) float gx[8][4], gy[8][4], gz[8][4];
+        for (int lane = 0; lane < 4; lane++) {
+            int r0 = tables.hash[x0[lane]];
+            int r1 = tables.hash[x1[lane]];
+            int r[4] = {
+                tables.hash[r0 + y0[lane]], tables.hash[r0 + y1[lane]],
+                tables.hash[r1 + y0[lane]], tables.hash[r1 + y1[lane]]
+            };
+            for (int corner = 0; corner < 8; corner++) {
+                int idx = r[corner >> 1] + ((corner & 1) ? z1[lane] : z0[lane]);
+                gx[corner][lane] = tables.gradX[idx];
+                gy[corner][lane] = tables.gradY[idx];
+                gz[corner][lane] = tables.gradZ[idx];
+            }
+        }
+
+        __m128 xm1 = _mm_sub_ps(x, onef);
+        __m128 ym1 = _mm_sub_ps(y, onef);
+        __m128 zm1 = _mm_sub_ps(z, onef);
+        __m128 n[8];
+        for (int corner = 0; corner < 8; corner++) {
+            __m128 cx = (corner & 4) ? xm1 : x;
+            __m128 cy = (corner & 2) ? ym1 : y;
+            __m128 cz = (corner & 1) ? zm1 : z;
+            n[corner] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(gx[corner]), cx),
+                                              _mm_mul_ps(_mm_load_ps(gy[corner]), cy)),
+                                   _mm_mul_ps(_mm_load_ps(gz[corner]), cz));
+        }
+
+        __m128 n00 = lerpSSE2(n[0], n[1], w);
+        __m128 n01 = lerpSSE2(n[2], n[3], w);
+        __m128 n10 = lerpSSE2(n[4], n[5], w);
+        __m128 n11 = lerpSSE2(n[6], n[7], w);
+        __m128 n0 = lerpSSE2(n00, n01, v);
+        __m128 n1 = lerpSSE2(n10, n11, v);
+        _mm_storeu_ps(out + i, lerpSSE2(n0, n1, u));
+    }
+    noiseScalar(xs + i, ys + i, zs + i, out + i, count - i);
+}
+
+#endif
+
+#ifdef PERLIN_HAS_AVX2
+
+__attribute__((target("avx2"))) inline __m256 easeAVX2(__m256 a) {
+    __m256 r = _mm256_sub_ps(_mm256_mul_ps(a, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f));
+    r = _mm256_add_ps(_mm256_mul_ps(r, a), _mm256_set1_ps(10.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(r, a), a), a);
+}
+
+__attribute__((target("avx2"))) inline __m256 lerpAVX2(__m256 a, __m256 b, __m256 t) {
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+__attribute__((target("avx2"))) inline __m256 gradAVX2(__m256i idx, __m256 x, __m256 y, __m256 z) {
+    __m256 gx = _mm256_i32gather_ps(tables.gradX, idx, 4);
+    __m256 gy = _mm256_i32gather_ps(tables.gradY, idx, 4);
+    __m256 gz = _mm256_i32gather_ps(tables.gradZ, idx, 4);
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y)), _mm256_mul_ps(gz, z));
+}
+
+__attribute__((target("avx2"))) void noiseAVX2(const float* xs, const float* ys, const float* zs, float* out, int count) {
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256 onef = _mm256_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        __m256 y = _mm256_loadu_ps(ys + i);
+        __m256 z = _mm256_loadu_ps(zs + i);
+
+        __m256 fx = _mm256_floor_ps(x);
+        __m256 fy = _mm256_floor_ps(y);
+        __m256 fz = _mm256_floor_ps(z);
+        __m256i px = _mm256_cvttps_epi32(fx);
+        __m256i py = _mm256_cvttps_epi32(fy);
+        __m256i pz = _mm256_cvttps_epi32(fz);
+
+        __m256i x0 = _mm256_and_si256(px, mask), x1 = _mm256_and_si256(_mm256_add_epi32(px, one), mask);
+        __m256i y0 = _mm256_and_si256(py, mask), y1 = _mm256_and_si256(_mm256_add_epi32(py, one), mask);
+        __m256i z0 = _mm256_and_si256(pz, mask), z1 = _mm256_and_si256(_mm256_add_epi32(pz, one), mask);
+
+        x = _mm256_sub_ps(x, fx);
+        y = _mm256_sub_ps(y, fy);
+        z = _mm256_sub_ps(z, fz);
+        __m256 u = easeAVX2(x);
+        __m256 v = easeAVX2(y);
+        __m256 w = easeAVX2(z);
+
+        __m256i r0 = _mm256_i32gather_epi32(tables.hash, x0, 4);
+        __m256i r1 = _mm256_i32gather_epi32(tables.hash, x1, 4);
+        __m256i r00 = _mm256_i32gather_epi32(tables.hash, _mm256_add_epi32(r0, y0), 4);
+        __m256i r01 = _mm256_i32gather_epi32(tables.hash, _mm256_add_epi32(r0, y1), 4);
+        __m256i r10 = _mm256_i32gather_epi32(tables.hash, _mm256_add_epi32(r1, y0), 4);
+        __m256i r11 = _mm256_i32gather_epi32(tables.hash, _mm256_add_epi32(r1, y1), 4);
+
+        __m256 xm1 = _mm256_sub_ps(x, onef);
+        __m256 ym1 = _mm256_sub_ps(y, onef);
+        __m256 zm1 = _mm256_sub_ps(z, onef);
+        __m256 n000 = gradAVX2(_mm256_add_epi32(r00, z0), x, y, z);
+        __m256 n001 = gradAVX2(_mm256_add_epi32(r00, z1), x, y, zm1);
+        __m256 n010 = gradAVX2(_mm256_add_epi32(r01, z0), x, ym1, z);
+        __m256 n011 = gradAVX2(_mm256_add_epi32(r01, z1), x, ym1, zm1);
+        __m256 n100 = gradAVX2(_mm256_add_epi32(r10, z0), xm1, y, z);
+        __m256 n101 = gradAVX2(_mm256_add_epi32(r10, z1), xm1, y, zm1);
+        __m256 n110 = gradAVX2(_mm256_add_epi32(r11, z0), xm1, ym1, z);
+        __m256 n111 = gradAVX2(_mm256_add_epi32(r11, z1), xm1, ym1, zm1);
+
+        __m256 n00 = lerpAVX2(n000, n001, w);
+        __m256 n01 = lerpAVX2(n010, n011, w);
+        __m256 n10 = lerpAVX2(n100, n101, w);
+        __m256 n11 = lerpAVX2(n110, n111, w);
+        __m256 n0 = lerpAVX2(n00, n01, v);
+        __m256 n1 = lerpAVX2(n10, n11, v);
+        _mm256_storeu_ps(out + i, lerpAVX2(n0, n1, u));
+    }
+    noiseScalar(xs + i, ys + i, zs + i, out + i, count - i);
+}
+
+#endif
+
+} // namespace
+
+bool noiseISASupported(NoiseISA isa) {
+    switch (isa) {
+        case NoiseISA::Scalar:
+            return true;
+        case NoiseISA::SSE2:
+#ifdef PERLIN_HAS_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case NoiseISA::AVX2:
+#ifdef PERLIN_HAS_AVX2
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+NoiseISA bestNoiseISA() {
+    static const NoiseISA best = noiseISASupported(NoiseISA::AVX2) ? NoiseISA::AVX2
+                               : noiseISASupported(NoiseISA::SSE2) ? NoiseISA::SSE2
+                               : NoiseISA::Scalar;
+    return best;
+}
+
+const char* noiseISAName(NoiseISA isa) {
+    switch (isa) {
+        case NoiseISA::Scalar: return "scalar";
+        case NoiseISA::SSE2:   return "SSE2";
+        case NoiseISA::AVX2:   return "AVX2";
+    }
+    return "unknown";
+}
+
+void perlinNoise3Batch(NoiseISA isa, const float* x, const float* y, const float* z, float* out, int count) {
+    switch (isa) {
+#ifdef PERLIN_HAS_AVX2
+        case NoiseISA::AVX2:
+            noiseAVX2(x, y, z, out, count);
+            return;
+#endif
+#ifdef PERLIN_HAS_SSE2
+        case NoiseISA::SSE2:
+            noiseSSE2(x, y, z, out, count);
+            return;
+#endif
+        default:
+            noiseScalar(x, y, z, out, count);
+            return;
+    }
+}
+
+void perlinNoise3Batch(const float* x, const float* y, const float* z, float* out, int count) {
+    perlinNoise3Batch(bestNoiseISA(), x, y, z, out, count);
+}
+
+void perlinNoise3Row(int xBegin, float xScale, float y, float z, float* out, int count) {
+    // Feed the kernel in small blocks so the coordinate arrays stay on the stack
+    const int blockSize = 256;
+    float xs[blockSize], ys[blockSize], zs[blockSize];
+    for (int i = 0; i < blockSize; i++) {
+        ys[i] = y;
+        zs[i] = z;
+    }
+    NoiseISA isa = bestNoiseISA();
+    for (int begin = 0; begin < count; begin += blockSize) {
+        int n = count - begin < blockSize ? count - begin : blockSize;
+        for (int i = 0; i < n; i++) {
+            xs[i] = (xBegin + begin + i) * xScale;
+        }
+        perlinNoise3Batch(isa, xs, ys, zs, out + begin, n);
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Batched evaluation of stb_perlin_noise3(x, y, z, 0, 0, 0), i.e. non-wrapping noise with seed 0.
+//
+// The SSE2 and AVX2 kernels do the same float operations in the same order as stb, so as long as the
+// compiler does not contract them into FMAs (it does not for plain SSE2/AVX2 builds) the results are
+// bit identical. The guaranteed bound is PERLIN_BATCH_TOLERANCE absolute error per sample.
+// The AVX2 kernel needs GCC or Clang; other compilers get the SSE2 or scalar path.
+
+const float PERLIN_BATCH_TOLERANCE = 1e-6f;
+
+enum class NoiseISA {
+    Scalar, SSE2, AVX2
+};
+
+bool noiseISASupported(NoiseISA isa);
+NoiseISA bestNoiseISA();
+const char* noiseISAName(NoiseISA isa);
+
+// out[i] = stb_perlin_noise3(x[i], y[i], z[i], 0, 0, 0), using the best kernel for this CPU
+void perlinNoise3Batch(const float* x, const float* y, const float* z, float* out, int count);
+void perlinNoise3Batch(NoiseISA isa, const float* x, const float* y, const float* z, float* out, int count);
+
+// Samples one row of a grid: out[i] = stb_perlin_noise3((xBegin + i) * xScale, y, z, 0, 0, 0)
+void perlinNoise3Row(int xBegin, float xScale, float y, float z, float* out, int count);
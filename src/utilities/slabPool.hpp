@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Refers to an object in a SlabPool. The generation tells the object apart from whatever later reuses its slot,
+// so a handle to a destroyed object stays invalid instead of pointing at a stranger.
+struct PoolHandle {
+    uint32_t index = ~0u;
+    uint32_t generation = 0;    // live objects have odd generations, so a default handle is never valid
+
+    bool operator==(const PoolHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const PoolHandle& other) const { return !(*this == other); }
+};
+
+// Allocates objects of one type in fixed size slabs that never move, so pointers to live objects stay valid
+// and neighbours in the pool are neighbours in memory. Destroyed slots go on a free list and are reused first,
+// so once the pool has grown to its peak size, creating and destroying objects does not allocate.
+template <typename T, size_t SLAB_SIZE = 256>
+class SlabPool {
+public:
+    SlabPool() = default;
+    ~SlabPool() {
+        for (uint32_t index = 0; index < slotCount; index++) {
+            Slot& slot = slotAt(index);
+            if (slot.generation & 1) object(slot)->~T();
+        }
+    }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    template <typename... Args>
+    PoolHandle create(Args&&... args) {
+        if (freeList == NO_SLOT) {
+            if (slotCount % SLAB_SIZE == 0) slabs.emplace_back(new Slot[SLAB_SIZE]);
+            Slot& slot = slotAt(slotCount);
+            slot.generation = 0;
+            slot.nextFree = NO_SLOT;
+            freeList = slotCount++;
+        }
+        uint32_t index = freeList;
+        Slot& slot = slotAt(index);
+        new (&slot.storage) T(std::forward<Args>(args)...);
+        freeList = slot.nextFree;
+        slot.generation++;
+        liveCount++;
+
+        PoolHandle handle;
+        handle.index = index;
+        handle.generation = slot.generation;
+        return handle;
+    }
+
+    // Does nothing for stale handles
+    void destroy(PoolHandle handle) {
+        if (!get(handle)) return;
+        Slot& slot = slotAt(handle.index);
+        object(slot)->~T();
+        slot.generation++;
+        slot.nextFree = freeList;
+        freeList = handle.index;
+        liveCount--;
+    }
+
+    // nullptr if the object was destroyed
+    T* get(PoolHandle handle) const {
+        if (handle.index >= slotCount) return nullptr;
+        Slot& slot = slotAt(handle.index);
+        return slot.generation == handle.generation && (slot.generation & 1) ? object(slot) : nullptr;
+    }
+
+    // Visits the live objects in memory order
+    template <typename Function>
+    void forEach(Function function) const {
+        for (uint32_t index = 0; index < slotCount; index++) {
+            Slot& slot = slotAt(index);
+            if (slot.generation & 1) function(object(slot));
+        }
+    }
+
+    size_t size() const { return liveCount; }
+    size_t capacity() const { return slabs.size() * SLAB_SIZE; }
+
+private:
+    static const uint32_t NO_SLOT = ~0u;
+
+    struct Slot {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        uint32_t generation;
+        uint32_t nextFree;
+    };
+
+    Slot& slotAt(uint32_t index) const { return slabs[index / SLAB_SIZE][index % SLAB_SIZE]; }
+    static T* object(Slot& slot) { return reinterpret_cast<T*>(&slot.storage); }
+
+    std::vector<std::unique_ptr<Slot[]>> slabs;
+    uint32_t slotCount = 0;     // slots ever handed out, the rest of the last slab is untouched
+    uint32_t freeList = NO_SLOT;
+    size_t liveCount = 0;
+};
@@ -0,0 +1,126 @@
+#include "threadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// Set on worker threads so that nested parallelFor() calls run inline instead of waiting on themselves
+static thread_local bool _isWorkerThread = false;
+
+static unsigned int _requestedThreadCount = 0;
+static std::unique_ptr<ThreadPool> _pool;
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    // The calling thread works on one band itself, so we only need threadCount - 1 helpers
+    for (unsigned int i = 1; i < std::max(threadCount, 1u); ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+    if (workers.empty()) {
+        job();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int, int)>& body) {
+    int count = end - begin;
+    if (count <= 0) return;
+
+    int bands = std::min((int)size(), count);
+    if (bands == 1 || _isWorkerThread) {
+        body(begin, end);
+        return;
+    }
+
+    // Bands are claimed by whoever gets to them first, the calling thread included. Helper jobs that a worker
+    // only picks up after all bands are claimed find nothing left to do, so they must not touch anything on
+    // this stack frame but the shared state.
+    struct Bands {
+        const std::function<void(int, int)>* body;
+        int begin, count, bands;
+        std::atomic<int> next{0};
+        std::mutex doneMutex;
+        std::condition_variable doneSignal;
+        int done = 0;
+    };
+    std::shared_ptr<Bands> state = std::make_shared<Bands>();
+    state->body = &body;
+    state->begin = begin;
+    state->count = count;
+    state->bands = bands;
+
+    // Band i covers [begin + count * i / bands, begin + count * (i + 1) / bands)
+    auto runBands = [](Bands& shared) {
+        int band;
+        while ((band = shared.next.fetch_add(1)) < shared.bands) {
+            int bandBegin = shared.begin + (int)((long long)shared.count * band / shared.bands);
+            int bandEnd = shared.begin + (int)((long long)shared.count * (band + 1) / shared.bands);
+            (*shared.body)(bandBegin, bandEnd);
+            std::lock_guard<std::mutex> lock(shared.doneMutex);
+            if (++shared.done == shared.bands) shared.doneSignal.notify_one();
+        }
+    };
+
+    // Ahead of background jobs, so a frame does not wait for the streaming workers' queue
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        for (int helper = 1; helper < bands; ++helper) {
+            jobs.push_front([state, runBands]() { runBands(*state); });
+        }
+    }
+    jobAvailable.notify_all();
+
+    // Workers that are busy with a long background job leave their bands to this thread
+    runBands(*state);
+
+    std::unique_lock<std::mutex> lock(state->doneMutex);
+    state->doneSignal.wait(lock, [&]() { return state->done == state->bands; });
+}
+
+void ThreadPool::workerLoop() {
+    _isWorkerThread = true;
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping && jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void setWorkerThreadCount(unsigned int threadCount) {
+    _requestedThreadCount = threadCount;
+    _pool.reset();
+}
+
+ThreadPool& workerPool() {
+    if (!_pool) {
+        unsigned int threadCount = _requestedThreadCount;
+        if (threadCount == 0) {
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        _pool.reset(new ThreadPool(threadCount));
+    }
+    return *_pool;
+}
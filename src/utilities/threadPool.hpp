@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads shared by the CPU heavy passes (terrain generation etc.).
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that take part in parallelFor(), including the calling thread
+    unsigned int size() const { return (unsigned int)workers.size() + 1; }
+
+    // Queue a job for the workers and return immediately. Jobs run in the order they were submitted, after
+    // any parallelFor() bands.
+    void submit(std::function<void()> job);
+
+    // Split [begin, end) into one contiguous band per thread and block until all bands are done.
+    // The bands only depend on the range and the thread count, so the split is deterministic. They go ahead of
+    // submitted jobs, and the calling thread runs the bands that no worker has started yet itself, so it never
+    // waits behind a queued background job.
+    void parallelFor(int begin, int end, const std::function<void(int bandBegin, int bandEnd)>& body);
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobMutex;
+    std::condition_variable jobAvailable;
+    bool stopping = false;
+};
+
+// Sets the number of threads used by workerPool(). 0 means one per hardware thread.
+// Must not be called while the pool is busy.
+void setWorkerThreadCount(unsigned int threadCount);
+
+// The shared pool, created on first use
+ThreadPool& workerPool();
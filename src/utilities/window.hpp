@@ -16,4 +16,9 @@ const int         windowSamples   = 4;
 struct CommandLineOptions {
     bool enableMusic;
     bool enableAutoplay;
+    int workerThreads;
+    bool streamTerrain;
+    bool compactVertices;
+    bool occlusionCulling;
+    bool checkGLState;
 };
\ No newline at end of file
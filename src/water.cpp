@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include "water.hpp"
+#include "utilities/compactVertex.hpp"
+#include "utilities/meshCache.hpp"
+#include "utilities/meshOptimizer.hpp"
+
+const int WATER_VERTEX_FLOATS = 8;
+const FloatVertexLayout WATER_FLOAT_LAYOUT = {WATER_VERTEX_FLOATS, 0, 5, 3};
+
+namespace {
+
+void buildWaterMesh(int size, glm::vec2 lakeCenter, float lakeRadius, float waterLevel, float uvScale,
+                    std::vector<float>& waterVertices, std::vector<unsigned int>& waterIndices) {
+    std::vector<int> validIndices(size * size, -1); //Keeps track of valid indices -> That is inside the lake
+
+    int index = 0;
+
+    //Precompute heights for normal calculation 
+    std::vector<float> heights(size * size, waterLevel);
+
+    // Generate vertices
+    for (int z = 0; z < size; ++z) {
+        for (int x = 0; x < size; ++x) {
+            // Create an elliptical lake shape
+            float ellipseFactorX = 1.3f;
+            float ellipseFactorZ = 0.8f;
+            float baseDistance = glm::distance(glm::vec2((x - lakeCenter.x) * ellipseFactorX,
+                                                         (z - lakeCenter.y) * ellipseFactorZ), glm::vec2(0.0f));
+            //If we are inside the lake
+            if (baseDistance < lakeRadius) { 
+                float height = waterLevel;
+
+                waterVertices.push_back((float)x - size * 0.5f);  // X
+                waterVertices.push_back(height);                 // Y 
+                waterVertices.push_back((float)z - size * 0.5f); // Z
+
+                heights[z * size + x] = height;
+
+                // UV coordinates
+                waterVertices.push_back((float)x / (size * uvScale));
+                waterVertices.push_back((float)z / (size * uvScale));
+
+                // Normal (initial: up)
+                waterVertices.push_back(0.0f); // Normal X
+                waterVertices.push_back(1.0f); // Normal Y
+                waterVertices.push_back(0.0f); // Normal Z
+
+                validIndices[z * size + x] = index++;
+            }
+        }
+    }
+    //Calculate normals based on surrounding height differences
+    for (int z = 1; z < size - 1; ++z) {
+        for (int x = 1; x < size - 1; ++x) {
+            if (validIndices[z * size + x] == -1) continue;
+
+            int index = validIndices[z * size + x] * 8; // 8 attributes per vertex
+
+            float hL = heights[z * size + (x - 1)];
+            float hR = heights[z * size + (x + 1)];
+            float hD = heights[(z - 1) * size + x];
+            float hU = heights[(z + 1) * size + x];
+
+            glm::vec3 normal = glm::normalize(glm::vec3(hL - hR, 2.0f, hD - hU));
+
+            // Update normal
+            waterVertices[index + 5] = normal.x;
+            waterVertices[index + 6] = normal.y;
+            waterVertices[index + 7] = normal.z;
+        }
+    }
+    //Genrerte indices for triangles. Two triangles per quad
+    for (int z = 0; z < size - 1; ++z) {
+        for (int x = 0; x < size - 1; ++x) {
+            int topLeft = z * size + x;
+            int topRight = topLeft + 1;
+            int bottomLeft = (z + 1) * size + x;
+            int bottomRight = bottomLeft + 1;
+
+            if (validIndices[topLeft] != -1 && validIndices[bottomLeft] != -1 && validIndices[topRight] != -1) {
+                waterIndices.push_back(validIndices[topLeft]);
+                waterIndices.push_back(validIndices[bottomLeft]);
+                waterIndices.push_back(validIndices[topRight]);
+            }
+            if (validIndices[topRight] != -1 && validIndices[bottomLeft] != -1 && validIndices[bottomRight] != -1) {
+                waterIndices.push_back(validIndices[topRight]);
+                waterIndices.push_back(validIndices[bottomLeft]);
+                waterIndices.push_back(validIndices[bottomRight]);
+            }
+        }
+    }
+}
+
+} // namespace
+
+WaterMesh generateWaterMesh(int size, glm::vec2 lakeCenter, float lakeRadius, float waterLevel, float uvScale) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    CacheHash key;
+    key.add("water v2");
+    key.add(size);
+    key.add(lakeCenter.x);
+    key.add(lakeCenter.y);
+    key.add(lakeRadius);
+    key.add(waterLevel);
+    key.add(uvScale);
+    bool compact = compactVerticesEnabled();
+    size_t vertexStride = compact ? sizeof(CompactVertex) : WATER_VERTEX_FLOATS * sizeof(float);
+    CacheHash layout;
+    layout.add(compact ? "compact position 3s, uv as normal 2s octahedral, normal xy as uv 2h" : "position 3f, uv 2f, normal 3f");
+    std::string cachePath = std::string(MESH_CACHE_DIRECTORY) + (compact ? "water-compact.bin" : "water.bin");
+
+    //Create and return a WaterMesh struct
+    WaterMesh waterMesh;
+
+    glGenVertexArrays(1, &waterMesh.VAO);
+    glGenBuffers(1, &waterMesh.VBO);
+    glGenBuffers(1, &waterMesh.EBO);
+
+    glBindVertexArray(waterMesh.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, waterMesh.VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, waterMesh.EBO);
+
+    MappedFile cacheFile;
+    MeshCacheData cached;
+    bool cacheHit = loadMeshCache(cachePath, key.value, layout.value, vertexStride, sizeof(unsigned int), cacheFile, cached);
+    if (cacheHit) {
+        waterMesh.indexCount = (int)cached.indexCount;
+        waterMesh.boundsMin = cached.boundsMin;
+        waterMesh.boundsMax = cached.boundsMax;
+        if (compact) waterMesh.quantization = vertexQuantization(cached.boundsMin, cached.boundsMax);
+        glBufferData(GL_ARRAY_BUFFER, cached.vertexCount * vertexStride, cached.vertices, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, cached.indexCount * sizeof(unsigned int), cached.indices, GL_STATIC_DRAW);
+        cacheFile.close();
+    } else {
+        std::vector<float> waterVertices; // Stores vertex atrributes, position, UV and normal
+        std::vector<unsigned int> waterIndices;// Triangle indices
+        buildWaterMesh(size, lakeCenter, lakeRadius, waterLevel, uvScale, waterVertices, waterIndices);
+        waterMesh.indexCount = waterIndices.size();
+
+        MeshOptimizationReport optimization = optimizeMesh(waterVertices.data(), waterVertices.size() / WATER_VERTEX_FLOATS,
+                                                           WATER_VERTEX_FLOATS * sizeof(float), 0,
+                                                           waterIndices.data(), waterIndices.size());
+        waterVertices.resize(optimization.vertexCount * WATER_VERTEX_FLOATS);
+        printMeshOptimizationReport("Water", optimization);
+
+        size_t vertexCount = waterVertices.size() / WATER_VERTEX_FLOATS;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        floatVertexBounds(waterVertices.data(), vertexCount, WATER_FLOAT_LAYOUT, boundsMin, boundsMax);
+        waterMesh.boundsMin = boundsMin;
+        waterMesh.boundsMax = boundsMax;
+
+        std::vector<CompactVertex> compactWaterVertices;
+        const void* vertices = waterVertices.data();
+        if (compact) {
+            // The float layout below feeds the UV to location 1 and the normal to location 2, and that is how
+            // the water has always been lit. So the compact vertex gets the UV as its normal and the normal's x
+            // and y as its UV. simple.vert normalizes the decoded normal, which gives the same direction.
+            std::vector<float> swapped(vertexCount * WATER_VERTEX_FLOATS);
+            for (size_t i = 0; i < vertexCount; i++) {
+                const float* vertex = &waterVertices[i * WATER_VERTEX_FLOATS];
+                float* out = &swapped[i * WATER_VERTEX_FLOATS];
+                out[0] = vertex[0];
+                out[1] = vertex[1];
+                out[2] = vertex[2];
+                out[3] = vertex[3];
+                out[4] = vertex[4];
+                out[5] = 0.0f;
+                out[6] = vertex[5];
+                out[7] = vertex[6];
+            }
+            const FloatVertexLayout swappedLayout = {WATER_VERTEX_FLOATS, 0, 3, 6};
+
+            waterMesh.quantization = vertexQuantization(boundsMin, boundsMax);
+            compactWaterVertices.resize(vertexCount);
+            CompactVertexReport report = compactVertices(swapped.data(), vertexCount, swappedLayout,
+                                                         waterMesh.quantization, compactWaterVertices.data());
+            printCompactVertexReport("Water", report);
+            vertices = compactWaterVertices.data();
+        }
+
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexStride, vertices, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, waterIndices.size() * sizeof(unsigned int), waterIndices.data(), GL_STATIC_DRAW);
+
+        MeshCacheWriter cacheWriter;
+        if (cacheWriter.create(cachePath, key.value, layout.value, vertexStride, vertexCount,
+                               sizeof(unsigned int), waterIndices.size(), 0)) {
+            memcpy(cacheWriter.data.vertices, vertices, vertexCount * vertexStride);
+            std::copy(waterIndices.begin(), waterIndices.end(), (unsigned int*)cacheWriter.data.indices);
+            cacheWriter.commit(boundsMin, boundsMax);
+        }
+    }
+
+    if (compact) {
+        // Same values at the same locations as the float layout, see above
+        setCompactVertexAttributes();
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);         // Posisjon
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float))); // UV
+        glEnableVertexAttribArray(1);
+
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float))); // Normal
+        glEnableVertexAttribArray(2);
+    }
+
+    glBindVertexArray(0);
+
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    printf("Water mesh %s in %.1f ms (cache %s: %s)\n", cacheHit ? "loaded" : "generated", elapsedMs,
+           cacheHit ? "hit" : "miss", cachePath.c_str());
+    return waterMesh;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "utilities/compactVertex.hpp"
+
+struct WaterMesh {
+    unsigned int VAO, VBO, EBO;
+    int indexCount;
+    VertexQuantization quantization;
+    glm::vec3 boundsMin;    // around every vertex, in the water's own space
+    glm::vec3 boundsMax;
+};
+
+// Builds a flat water surface at waterLevel that fills the elliptical lake of a size x size terrain.
+// Vertices are interleaved as position (3), UV (2), normal (3), or CompactVertex with compactVerticesEnabled().
+// The mesh is cached on disk like the terrain (see utilities/meshCache.hpp).
+WaterMesh generateWaterMesh(int size, glm::vec2 lakeCenter, float lakeRadius, float waterLevel, float uvScale);